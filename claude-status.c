@@ -17,7 +17,29 @@
 #define DEFAULT_YELLOW_THRESHOLD 25
 #define DEFAULT_ORANGE_THRESHOLD 50
 #define DEFAULT_RED_THRESHOLD 75
+#define DEFAULT_MAX_REQUESTS_PER_HOUR 120
 #define DEFAULT_CREDS_FILE "~/.claude/.credentials.json"
+#define DEFAULT_SHOW_SPARKLINE FALSE
+#define DEFAULT_SHOW_LIMITS TRUE
+#define DEFAULT_SHOW_CONTEXT TRUE
+#define DEFAULT_SHOW_TOTALS TRUE
+#define DEFAULT_PUBLISH_SHM FALSE
+#define DEFAULT_ARCHIVE_DIR ""
+#define DEFAULT_TRANSCRIPT_ROOTS ""
+#define DEFAULT_REMOTE_COMMAND ""
+
+/* Context timeline sizes */
+#define CTX_TIMELINE_MAX 32
+#define CTX_SPARK_WIDTH 8
+
+/* Context by tool: entries shown, and bytes of JSON per token for the estimate */
+#define CTX_TOOLS_MAX 5
+#define CTX_TOOL_BYTES_PER_TOKEN 4
+
+/* 5h usage sparkline */
+#define SPARK_MAX_SAMPLES 1024
+#define SPARK_WINDOW_SECS (3 * 3600)
+#define SPARK_WIDTH 40
 
 /* Plugin data structure */
 typedef struct {
@@ -32,6 +54,7 @@ typedef struct {
     GtkWidget *five_hour_lbl;
     GtkWidget *five_hour_bar;
     GtkWidget *five_hour_pct;
+    GtkWidget *five_hour_spark;
     GtkWidget *five_hour_reset;
 
     /* Row 2 widgets */
@@ -41,6 +64,9 @@ typedef struct {
     GtkWidget *seven_day_pct;
     GtkWidget *seven_day_reset;
 
+    /* Publish checkbox of the open settings dialog, if any */
+    GtkWidget *shm_check;
+
     /* Rust core handle */
     struct ClaudeStatusCore *core;
 
@@ -48,6 +74,9 @@ typedef struct {
     gchar *plan_name;
     gdouble five_hour_pct_val;
     gdouble seven_day_pct_val;
+    guint64 usage_generation;
+    gint64 five_hour_reset_ts;
+    gint64 seven_day_reset_ts;
     gchar *five_hour_reset_str;
     gchar *seven_day_reset_str;
     gchar *five_hour_reset_time;
@@ -55,15 +84,57 @@ typedef struct {
     gdouble context_pct;
     gint64 context_tokens;
     gint64 context_window_size;
+    gint64 turns_to_compact;
+    gint64 secs_to_compact;
+    gint64 sidechain_messages;
+    gint64 sidechain_tokens;
+    struct CTimelinePoint ctx_timeline[CTX_TIMELINE_MAX];
+    gsize ctx_timeline_len;
+    gchar *context_tools;
     gchar *model_name;
+    gchar *context_host;
     GDateTime *last_updated;
 
+    /* 5h usage history and its rendered sparkline */
+    struct CUsageSample *spark_samples;
+    gsize spark_len;
+    guint64 spark_generation;
+    gint64 spark_fetched_at;    /* right edge: the last fetch, changed or not */
+    cairo_surface_t *spark_surface;
+    gint spark_surface_width;
+    gint spark_surface_height;
+
+    /* Long-term token totals from the ledger */
+    gboolean ledger_valid;
+    guint64 ledger_tokens;
+    guint64 ledger_sessions;
+
     /* Configuration */
     gint update_interval;
     gint yellow_threshold;
     gint orange_threshold;
     gint red_threshold;
+    gint max_requests_per_hour;
     gchar *creds_file;
+    gchar *archive_dir;
+    gchar *transcript_roots;
+    gchar *remote_command;
+    gchar *export_dir;          /* pending export, taken by the fetch thread */
+    gchar *export_failed;       /* export the fetch thread could not write */
+    gchar *pending_archive_dir; /* changed in the dialog, taken by the fetch thread */
+    gchar *pending_transcript_roots;    /* likewise */
+    gchar *pending_remote_command;      /* likewise */
+    gint pending_max_requests;  /* likewise; 0 when unchanged */
+    gint pending_publish_shm;   /* likewise; -1 when unchanged */
+    gint shm_result;            /* whether that publishing started; -1 until applied */
+    gboolean show_sparkline;
+    gboolean show_limits;
+    gboolean show_context;
+    gboolean show_totals;
+    gboolean publish_shm;
+
+    /* Core metrics this panel is subscribed to, indexed by CMetric */
+    gboolean subscribed[MetricSessions + 1];
 
     /* Layout state */
     gboolean single_row;
@@ -72,6 +143,14 @@ typedef struct {
     /* Update timer */
     guint timeout_id;
 
+    /* Only one fetch runs at a time; asking during one queues another */
+    gboolean fetch_running;
+    gboolean fetch_queued;
+
+    /* Fetch waiting for request budget; further denials merge into it */
+    guint deferred_id;
+    guint retry_after_secs;
+
     /* Error state */
     gboolean has_credentials_error;
 
@@ -113,11 +192,120 @@ static gchar* make_bar(gdouble pct, int width) {
     return g_string_free(bar, FALSE);
 }
 
+/* Generate a sparkline of context size, highlighting compaction points */
+static gchar* make_sparkline(const struct CTimelinePoint *points, gsize n, gint64 window) {
+    static const gchar *levels[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+    GString *spark = g_string_new("");
+    for (gsize i = 0; i < n; i++) {
+        gint level = window > 0 ? (gint)(points[i].context_tokens * 8 / window) : 0;
+        level = CLAMP(level, 0, 7);
+        if (points[i].compacted) {
+            g_string_append_printf(spark, "<span color='#5f87d7'>%s</span>", levels[level]);
+        } else {
+            g_string_append(spark, levels[level]);
+        }
+    }
+    return g_string_free(spark, FALSE);
+}
+
+/* Format a token count compactly, e.g. 12.3M */
+static gchar* format_tokens(guint64 tokens) {
+    if (tokens >= 1000000000ULL) {
+        return g_strdup_printf("%.1fB", tokens / 1e9);
+    } else if (tokens >= 1000000ULL) {
+        return g_strdup_printf("%.1fM", tokens / 1e6);
+    } else if (tokens >= 1000ULL) {
+        return g_strdup_printf("%.1fK", tokens / 1e3);
+    }
+    return g_strdup_printf("%lu", (unsigned long)tokens);
+}
+
 /* Get color based on percentage - uses Rust core */
 static const gchar* get_color(ClaudeStatusPlugin *data, gdouble pct) {
     return claude_status_core_get_color(data->core, pct);
 }
 
+/* Drop the cached sparkline so the next draw renders it again */
+static void invalidate_sparkline(ClaudeStatusPlugin *data) {
+    if (data->spark_surface) {
+        cairo_surface_destroy(data->spark_surface);
+        data->spark_surface = NULL;
+    }
+    if (data->five_hour_spark) {
+        gtk_widget_queue_draw(data->five_hour_spark);
+    }
+}
+
+/* Render the 5h usage sparkline into an offscreen surface */
+static cairo_surface_t* render_sparkline(ClaudeStatusPlugin *data, GtkWidget *widget, gint width, gint height) {
+    cairo_surface_t *surface = gdk_window_create_similar_surface(
+        gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR_ALPHA, width, height);
+
+    if (data->spark_len == 0 || width < 2 || height < 2) {
+        return surface;
+    }
+
+    cairo_t *cr = cairo_create(surface);
+    GdkRGBA rgba;
+    gdk_rgba_parse(&rgba, get_color(data, data->five_hour_pct_val));
+    gdk_cairo_set_source_rgba(cr, &rgba);
+    cairo_set_line_width(cr, 1.0);
+
+    /* Samples are only taken when usage changes, so each value holds until
+     * the next one and the last one up to the latest fetch */
+    gint64 end = MAX(data->spark_samples[data->spark_len - 1].ts, data->spark_fetched_at);
+    gint64 start = end - SPARK_WINDOW_SECS;
+    gboolean started = FALSE;
+    gdouble y = 0.0;
+
+    for (gsize i = 0; i < data->spark_len; i++) {
+        const struct CUsageSample *sample = &data->spark_samples[i];
+        /* Of the samples before the window, the newest still holds at its start */
+        if (i + 1 < data->spark_len && data->spark_samples[i + 1].ts <= start) continue;
+
+        gdouble x = (gdouble)(MAX(sample->ts, start) - start) / SPARK_WINDOW_SECS * (width - 1) + 0.5;
+        if (started) {
+            cairo_line_to(cr, x, y);
+        }
+        y = (height - 1) * (1.0 - CLAMP(sample->five_hour_pct, 0.0, 100.0) / 100.0) + 0.5;
+        if (started) {
+            cairo_line_to(cr, x, y);
+        } else {
+            cairo_move_to(cr, x, y);
+            started = TRUE;
+        }
+    }
+    cairo_line_to(cr, width - 0.5, y);
+
+    cairo_stroke(cr);
+    cairo_destroy(cr);
+    return surface;
+}
+
+/* Paint the cached sparkline, rendering it first if stale */
+static gboolean on_sparkline_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    gint width = gtk_widget_get_allocated_width(widget);
+    gint height = gtk_widget_get_allocated_height(widget);
+
+    if (data->spark_surface &&
+        (data->spark_surface_width != width || data->spark_surface_height != height)) {
+        cairo_surface_destroy(data->spark_surface);
+        data->spark_surface = NULL;
+    }
+
+    if (!data->spark_surface) {
+        data->spark_surface = render_sparkline(data, widget, width, height);
+        data->spark_surface_width = width;
+        data->spark_surface_height = height;
+    }
+
+    cairo_set_source_surface(cr, data->spark_surface, 0, 0);
+    cairo_paint(cr);
+    return FALSE;
+}
+
 /* Load CSS styling */
 static void load_css(void) {
     GtkCssProvider *provider = gtk_css_provider_new();
@@ -156,7 +344,7 @@ static GtkWidget* create_label(ClaudeStatusPlugin *data, const gchar *text, cons
     return label;
 }
 
-/* Update a label's text and color */
+/* Update a label's text and color, skipping labels whose markup is unchanged */
 static void update_label(ClaudeStatusPlugin *data, GtkWidget *label, const gchar *text, const gchar *color, gboolean bold) {
     gchar *markup;
     if (bold) {
@@ -168,7 +356,9 @@ static void update_label(ClaudeStatusPlugin *data, GtkWidget *label, const gchar
             "<span font_family='monospace' font_size='%d' color='%s'>%s</span>",
             data->font_size, color, text);
     }
-    gtk_label_set_markup(GTK_LABEL(label), markup);
+    if (g_strcmp0(gtk_label_get_label(GTK_LABEL(label)), markup) != 0) {
+        gtk_label_set_markup(GTK_LABEL(label), markup);
+    }
     g_free(markup);
 }
 
@@ -229,39 +419,107 @@ static gchar* format_seven_day_reset(gint64 reset_ts, gchar **full_time_out) {
     return result;
 }
 
+/* Hand settings changed in the dialog to the core; runs in the fetch
+ * thread, the only one using the core while a fetch runs */
+static void apply_pending_settings(ClaudeStatusPlugin *data) {
+    gchar *archive_dir = g_atomic_pointer_exchange(&data->pending_archive_dir, NULL);
+    if (archive_dir) {
+        claude_status_core_set_archive_dir(data->core, archive_dir);
+        g_free(archive_dir);
+    }
+
+    gchar *roots = g_atomic_pointer_exchange(&data->pending_transcript_roots, NULL);
+    if (roots) {
+        claude_status_core_set_transcript_roots(data->core, roots);
+        g_free(roots);
+    }
+
+    gchar *remote_command = g_atomic_pointer_exchange(&data->pending_remote_command, NULL);
+    if (remote_command) {
+        claude_status_core_set_remote_command(data->core, remote_command);
+        g_free(remote_command);
+    }
+
+    /* A newer value set meanwhile stays pending for the next fetch */
+    gint per_hour = g_atomic_int_get(&data->pending_max_requests);
+    if (per_hour > 0 && g_atomic_int_compare_and_exchange(&data->pending_max_requests, per_hour, 0)) {
+        claude_status_core_set_max_requests_per_hour(data->core, per_hour);
+    }
+
+    /* Read back by show_shm_result on the main thread */
+    gint publish = g_atomic_int_get(&data->pending_publish_shm);
+    if (publish >= 0 && g_atomic_int_compare_and_exchange(&data->pending_publish_shm, publish, -1)) {
+        data->shm_result = claude_status_core_set_shm_enabled(data->core, publish) && publish;
+    }
+}
+
 /* Fetch usage from Rust core (runs in thread pool) */
 static void fetch_usage_thread(GTask *task, gpointer source_object,
                                 gpointer task_data, GCancellable *cancellable) {
     ClaudeStatusPlugin *data = task_data;
 
-    /* Load credentials if needed */
-    enum CResultCode cred_result = claude_status_core_load_credentials(
-        data->core, data->creds_file);
+    apply_pending_settings(data);
 
-    if (cred_result != Ok) {
-        g_task_return_int(task, cred_result);
-        return;
+    /* Export requested from the menu; no other fetch runs meanwhile, so
+     * the core is not refreshed under it */
+    gchar *export_dir = g_atomic_pointer_exchange(&data->export_dir, NULL);
+    if (export_dir) {
+        if (claude_status_core_export_arrow(data->core, export_dir) != Ok) {
+            /* Reported by fetch_usage_done on the main thread */
+            g_free(data->export_failed);
+            data->export_failed = export_dir;
+        } else {
+            g_free(export_dir);
+        }
     }
 
-    /* Fetch usage */
-    enum CResultCode usage_result = claude_status_core_fetch_usage(data->core);
-    if (usage_result != Ok) {
-        g_task_return_int(task, usage_result);
-        return;
-    }
+    /* Credentials, usage, context and ledger, here or in the daemon */
+    g_task_return_int(task, claude_status_core_refresh(data->core, data->creds_file));
+}
 
-    /* Read context */
-    claude_status_core_read_context(data->core);
+static gboolean on_deferred_fetch(gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->deferred_id = 0;
+    claude_status_fetch_usage(data);
+    return G_SOURCE_REMOVE;
+}
 
-    g_task_return_int(task, Ok);
+/* Retry once the request budget allows; later denials reuse the same retry */
+static void schedule_deferred_fetch(ClaudeStatusPlugin *data) {
+    struct CDiagnostics diag = claude_status_core_get_diagnostics(data->core);
+    data->retry_after_secs = diag.retry_after_secs;
+    if (data->deferred_id == 0) {
+        data->deferred_id = g_timeout_add_seconds(MAX(diag.retry_after_secs, 1),
+                                                  on_deferred_fetch, data);
+    }
 }
 
-static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
-    ClaudeStatusPlugin *data = user_data;
-    GTask *task = G_TASK(result);
+static void show_export_error(ClaudeStatusPlugin *data) {
+    gchar *dir = data->export_failed;
+    data->export_failed = NULL;
+    if (dir) {
+        xfce_dialog_show_error(NULL, NULL, "Could not export usage data to %s", dir);
+        g_free(dir);
+    }
+}
 
-    enum CResultCode code = g_task_propagate_int(task, NULL);
+/* Only one instance can publish; untick the box if this one lost */
+static void show_shm_result(ClaudeStatusPlugin *data) {
+    gint published = data->shm_result;
+    data->shm_result = -1;
+
+    /* Ticked and not toggled again since */
+    if (published != 0 || !data->publish_shm || g_atomic_int_get(&data->pending_publish_shm) >= 0) {
+        return;
+    }
+    data->publish_shm = FALSE;
+    claude_status_save_config(data);
+    if (data->shm_check) {
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->shm_check), FALSE);
+    }
+}
 
+static void handle_fetch_result(ClaudeStatusPlugin *data, enum CResultCode code) {
     if (code == AuthError) {
         /* Handle auth error with retry */
         if (data->auth_retry_count >= 2) {
@@ -286,11 +544,20 @@ static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpoin
 
     data->has_credentials_error = FALSE;
 
+    if (code == Deferred) {
+        schedule_deferred_fetch(data);
+    } else {
+        data->retry_after_secs = 0;
+    }
+
     /* Get usage data from core */
     struct CUsageData usage = claude_status_core_get_usage(data->core);
-    if (usage.valid) {
+    if (usage.valid && usage.generation != data->usage_generation) {
+        data->usage_generation = usage.generation;
         data->five_hour_pct_val = usage.five_hour_pct;
         data->seven_day_pct_val = usage.seven_day_pct;
+        data->five_hour_reset_ts = usage.five_hour_reset_ts;
+        data->seven_day_reset_ts = usage.seven_day_reset_ts;
 
         g_free(data->five_hour_reset_str);
         g_free(data->five_hour_reset_time);
@@ -301,6 +568,28 @@ static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpoin
         g_free(data->seven_day_reset_time);
         data->seven_day_reset_str = format_seven_day_reset(
             usage.seven_day_reset_ts, &data->seven_day_reset_time);
+    } else if (usage.valid) {
+        /* Same snapshot as before: only the countdowns move */
+        g_free(data->five_hour_reset_str);
+        data->five_hour_reset_str = format_five_hour_reset(data->five_hour_reset_ts, NULL);
+
+        g_free(data->seven_day_reset_str);
+        data->seven_day_reset_str = format_seven_day_reset(data->seven_day_reset_ts, NULL);
+    }
+
+    /* The sparkline runs up to the last fetch, even an unchanged one */
+    if (usage.valid && usage.fetched_at != data->spark_fetched_at) {
+        data->spark_fetched_at = usage.fetched_at;
+        invalidate_sparkline(data);
+    }
+
+    /* Copy usage history only when a new sample arrived */
+    guint64 generation = claude_status_core_get_history_generation(data->core);
+    if (generation != data->spark_generation) {
+        data->spark_generation = generation;
+        data->spark_len = claude_status_core_get_history(
+            data->core, data->spark_samples, SPARK_MAX_SAMPLES);
+        invalidate_sparkline(data);
     }
 
     /* Get context info from core */
@@ -309,9 +598,47 @@ static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpoin
         data->context_pct = ctx.context_pct;
         data->context_tokens = ctx.context_tokens;
         data->context_window_size = ctx.context_window_size;
+        data->turns_to_compact = ctx.turns_to_compact;
+        data->secs_to_compact = ctx.secs_to_compact;
+        data->sidechain_messages = ctx.sidechain_messages;
+        data->sidechain_tokens = ctx.sidechain_input_tokens + ctx.sidechain_output_tokens;
+        data->ctx_timeline_len = claude_status_core_get_context_timeline(
+            data->core, data->ctx_timeline, CTX_TIMELINE_MAX);
+
+        /* Names are only valid until the next call, so format them now */
+        struct CToolShare tools[CTX_TOOLS_MAX];
+        gsize n_tools = claude_status_core_get_context_tools(data->core, tools, CTX_TOOLS_MAX);
+        g_free(data->context_tools);
+        data->context_tools = NULL;
+        if (n_tools > 0) {
+            GString *lines = g_string_new("Context by tool:\n");
+            for (gsize i = 0; i < n_tools; i++) {
+                gchar *tokens_str = format_tokens(tools[i].bytes / CTX_TOOL_BYTES_PER_TOKEN);
+                /* The tooltip is markup; tool names come from transcripts */
+                gchar *name = g_markup_escape_text(tools[i].name, -1);
+                g_string_append_printf(lines, "  %s ~%s tokens (%ld %s)\n",
+                                       name, tokens_str, (long)tools[i].calls,
+                                       tools[i].calls == 1 ? "call" : "calls");
+                g_free(name);
+                g_free(tokens_str);
+            }
+            data->context_tools = g_string_free(lines, FALSE);
+        }
 
         g_free(data->model_name);
         data->model_name = ctx.model_name ? g_strdup(ctx.model_name) : NULL;
+
+        g_free(data->context_host);
+        data->context_host = ctx.host ? g_strdup(ctx.host) : NULL;
+    }
+
+    /* Get long-term totals from the ledger */
+    struct CLedgerTotals totals = claude_status_core_get_ledger_totals(data->core);
+    data->ledger_valid = totals.valid;
+    if (totals.valid) {
+        data->ledger_tokens = totals.input_tokens + totals.output_tokens +
+                              totals.cache_creation_tokens + totals.cache_read_tokens;
+        data->ledger_sessions = totals.sessions;
     }
 
     /* Get credentials info for plan name */
@@ -331,8 +658,30 @@ static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpoin
     claude_status_update(data);
 }
 
-/* Fetch usage from API */
+static void fetch_usage_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    GTask *task = G_TASK(result);
+
+    data->fetch_running = FALSE;
+    handle_fetch_result(data, g_task_propagate_int(task, NULL));
+    show_export_error(data);
+    show_shm_result(data);
+
+    /* Asked for while this one ran, e.g. an export */
+    if (data->fetch_queued && !data->fetch_running) {
+        data->fetch_queued = FALSE;
+        claude_status_fetch_usage(data);
+    }
+}
+
+/* Fetch usage from API, or queue a fetch if one is running */
 static void claude_status_fetch_usage(ClaudeStatusPlugin *data) {
+    if (data->fetch_running) {
+        data->fetch_queued = TRUE;
+        return;
+    }
+    data->fetch_running = TRUE;
+
     GTask *task = g_task_new(NULL, NULL, fetch_usage_done, data);
     g_task_set_task_data(task, data, NULL);
     g_task_run_in_thread(task, fetch_usage_thread);
@@ -359,64 +708,131 @@ static gboolean claude_status_update(ClaudeStatusPlugin *data) {
     /* Row 1: Plan, 5h */
     update_label(data, data->plan_label, data->plan_name ? data->plan_name : "—", "#d4a574", TRUE);
 
-    gchar *bar5 = make_bar(data->five_hour_pct_val, 8);
-    const gchar *color5 = get_color(data, data->five_hour_pct_val);
-    update_label(data, data->five_hour_bar, bar5, color5, FALSE);
-    g_free(bar5);
+    if (data->show_limits) {
+        gchar *bar5 = make_bar(data->five_hour_pct_val, 8);
+        const gchar *color5 = get_color(data, data->five_hour_pct_val);
+        update_label(data, data->five_hour_bar, bar5, color5, FALSE);
+        g_free(bar5);
 
-    gchar *pct5 = g_strdup_printf("%3.0f%%", data->five_hour_pct_val);
-    update_label(data, data->five_hour_pct, pct5, color5, FALSE);
-    g_free(pct5);
+        gchar *pct5 = g_strdup_printf("%3.0f%%", data->five_hour_pct_val);
+        update_label(data, data->five_hour_pct, pct5, color5, FALSE);
+        g_free(pct5);
 
-    update_label(data, data->five_hour_reset, data->five_hour_reset_str ? data->five_hour_reset_str : "", "#666", FALSE);
+        update_label(data, data->five_hour_reset, data->five_hour_reset_str ? data->five_hour_reset_str : "", "#666", FALSE);
+    }
 
     /* Row 2 / continued: Context, 7d */
-    gchar *ctx = g_strdup_printf("Ctx:%3.0f%%", data->context_pct);
-    const gchar *color_ctx = get_color(data, data->context_pct);
-    update_label(data, data->ctx_label, ctx, color_ctx, FALSE);
-    g_free(ctx);
+    if (data->show_context) {
+        GString *ctx_str = g_string_new("");
+        g_string_append_printf(ctx_str, "Ctx:%3.0f%%", data->context_pct);
+        if (data->turns_to_compact >= 0) {
+            g_string_append_printf(ctx_str, " ~%ldt", (long)data->turns_to_compact);
+        }
+        if (data->ctx_timeline_len > 1) {
+            gsize spark_len = MIN(data->ctx_timeline_len, CTX_SPARK_WIDTH);
+            gchar *spark = make_sparkline(data->ctx_timeline + data->ctx_timeline_len - spark_len,
+                                          spark_len, data->context_window_size);
+            g_string_append_printf(ctx_str, " %s", spark);
+            g_free(spark);
+        }
+        gchar *ctx = g_string_free(ctx_str, FALSE);
+        const gchar *color_ctx = get_color(data, data->context_pct);
+        update_label(data, data->ctx_label, ctx, color_ctx, FALSE);
+        g_free(ctx);
+    }
 
-    gchar *bar7 = make_bar(data->seven_day_pct_val, 8);
-    const gchar *color7 = get_color(data, data->seven_day_pct_val);
-    update_label(data, data->seven_day_bar, bar7, color7, FALSE);
-    g_free(bar7);
+    if (data->show_limits) {
+        gchar *bar7 = make_bar(data->seven_day_pct_val, 8);
+        const gchar *color7 = get_color(data, data->seven_day_pct_val);
+        update_label(data, data->seven_day_bar, bar7, color7, FALSE);
+        g_free(bar7);
 
-    gchar *pct7 = g_strdup_printf("%3.0f%%", data->seven_day_pct_val);
-    update_label(data, data->seven_day_pct, pct7, color7, FALSE);
-    g_free(pct7);
+        gchar *pct7 = g_strdup_printf("%3.0f%%", data->seven_day_pct_val);
+        update_label(data, data->seven_day_pct, pct7, color7, FALSE);
+        g_free(pct7);
 
-    update_label(data, data->seven_day_reset, data->seven_day_reset_str ? data->seven_day_reset_str : "", "#666", FALSE);
+        update_label(data, data->seven_day_reset, data->seven_day_reset_str ? data->seven_day_reset_str : "", "#666", FALSE);
+    }
 
-    /* Update tooltip */
+    /* Update tooltip; names from transcripts and remote hosts are escaped */
     GString *tooltip = g_string_new("");
+    gchar *escaped;
 
-    g_string_append_printf(tooltip, "<b>Claude %s</b>\n",
-                           data->plan_name ? data->plan_name : "—");
+    escaped = g_markup_printf_escaped("<b>Claude %s</b>\n",
+                                      data->plan_name ? data->plan_name : "—");
+    g_string_append(tooltip, escaped);
+    g_free(escaped);
     g_string_append(tooltip, "─────────────────\n");
 
-    g_string_append_printf(tooltip, "5-hour:  %.1f%%", data->five_hour_pct_val);
-    if (data->five_hour_reset_time) {
-        g_string_append_printf(tooltip, " (resets%s)", data->five_hour_reset_time);
-    }
-    g_string_append(tooltip, "\n");
+    if (data->show_limits) {
+        g_string_append_printf(tooltip, "5-hour:  %.1f%%", data->five_hour_pct_val);
+        if (data->five_hour_reset_time) {
+            g_string_append_printf(tooltip, " (resets%s)", data->five_hour_reset_time);
+        }
+        g_string_append(tooltip, "\n");
 
-    g_string_append_printf(tooltip, "7-day:   %.1f%%", data->seven_day_pct_val);
-    if (data->seven_day_reset_time) {
-        g_string_append_printf(tooltip, " (resets %s)", data->seven_day_reset_time);
+        g_string_append_printf(tooltip, "7-day:   %.1f%%", data->seven_day_pct_val);
+        if (data->seven_day_reset_time) {
+            g_string_append_printf(tooltip, " (resets %s)", data->seven_day_reset_time);
+        }
+        g_string_append(tooltip, "\n");
     }
-    g_string_append(tooltip, "\n");
 
-    if (data->context_window_size > 0) {
+    if (data->show_context && data->context_window_size > 0) {
         gchar *tokens_str = g_strdup_printf("%ld", (long)data->context_tokens);
         gchar *window_str = g_strdup_printf("%ld", (long)data->context_window_size);
-        g_string_append_printf(tooltip, "Context: %s / %s tokens (%.0f%%)\n",
+        if (data->context_host) {
+            escaped = g_markup_printf_escaped("Context on %s:\n         ", data->context_host);
+            g_string_append(tooltip, escaped);
+            g_free(escaped);
+        } else {
+            g_string_append(tooltip, "Context: ");
+        }
+        g_string_append_printf(tooltip, "%s / %s tokens (%.0f%%)\n",
                                tokens_str, window_str, data->context_pct);
         g_free(tokens_str);
         g_free(window_str);
+
+        if (data->turns_to_compact >= 0) {
+            g_string_append_printf(tooltip, "         ~%ld turns to compact",
+                                   (long)data->turns_to_compact);
+            if (data->secs_to_compact >= 0) {
+                g_string_append_printf(tooltip, " (~%ld min)",
+                                       (long)((data->secs_to_compact + 59) / 60));
+            }
+            g_string_append(tooltip, "\n");
+        }
+
+        if (data->ctx_timeline_len > 1) {
+            gchar *spark = make_sparkline(data->ctx_timeline, data->ctx_timeline_len,
+                                          data->context_window_size);
+            g_string_append_printf(tooltip, "         %s\n", spark);
+            g_free(spark);
+        }
+
+        if (data->sidechain_messages > 0) {
+            gchar *sub_str = format_tokens(data->sidechain_tokens);
+            g_string_append_printf(tooltip, "Subagents: %s tokens in %ld messages\n",
+                                   sub_str, (long)data->sidechain_messages);
+            g_free(sub_str);
+        }
+
+        if (data->context_tools) {
+            g_string_append(tooltip, data->context_tools);
+        }
+    }
+
+    if (data->show_totals && data->ledger_valid) {
+        gchar *tokens_str = format_tokens(data->ledger_tokens);
+        g_string_append_printf(tooltip, "All time: %s tokens in %lu sessions\n",
+                               tokens_str, (unsigned long)data->ledger_sessions);
+        g_free(tokens_str);
     }
 
     if (data->model_name) {
-        g_string_append_printf(tooltip, "\nModel: %s", data->model_name);
+        escaped = g_markup_printf_escaped("\nModel: %s", data->model_name);
+        g_string_append(tooltip, escaped);
+        g_free(escaped);
     }
 
     if (data->last_updated) {
@@ -425,6 +841,11 @@ static gboolean claude_status_update(ClaudeStatusPlugin *data) {
         g_free(updated_str);
     }
 
+    if (data->deferred_id > 0) {
+        g_string_append_printf(tooltip, "\nRequest budget reached, next fetch in %us",
+                               data->retry_after_secs);
+    }
+
     gtk_widget_set_tooltip_markup(data->box, tooltip->str);
     g_string_free(tooltip, TRUE);
 
@@ -465,9 +886,24 @@ static void claude_status_read_config(ClaudeStatusPlugin *data) {
             data->yellow_threshold = xfce_rc_read_int_entry(rc, "yellow_threshold", DEFAULT_YELLOW_THRESHOLD);
             data->orange_threshold = xfce_rc_read_int_entry(rc, "orange_threshold", DEFAULT_ORANGE_THRESHOLD);
             data->red_threshold = xfce_rc_read_int_entry(rc, "red_threshold", DEFAULT_RED_THRESHOLD);
+            data->max_requests_per_hour = xfce_rc_read_int_entry(rc, "max_requests_per_hour", DEFAULT_MAX_REQUESTS_PER_HOUR);
+            data->show_sparkline = xfce_rc_read_bool_entry(rc, "show_sparkline", DEFAULT_SHOW_SPARKLINE);
+            data->show_limits = xfce_rc_read_bool_entry(rc, "show_limits", DEFAULT_SHOW_LIMITS);
+            data->show_context = xfce_rc_read_bool_entry(rc, "show_context", DEFAULT_SHOW_CONTEXT);
+            data->show_totals = xfce_rc_read_bool_entry(rc, "show_totals", DEFAULT_SHOW_TOTALS);
+            data->publish_shm = xfce_rc_read_bool_entry(rc, "publish_shm", DEFAULT_PUBLISH_SHM);
             const gchar *creds = xfce_rc_read_entry(rc, "creds_file", DEFAULT_CREDS_FILE);
             g_free(data->creds_file);
             data->creds_file = g_strdup(creds);
+            const gchar *archive = xfce_rc_read_entry(rc, "archive_dir", DEFAULT_ARCHIVE_DIR);
+            g_free(data->archive_dir);
+            data->archive_dir = g_strdup(archive);
+            const gchar *roots = xfce_rc_read_entry(rc, "transcript_roots", DEFAULT_TRANSCRIPT_ROOTS);
+            g_free(data->transcript_roots);
+            data->transcript_roots = g_strdup(roots);
+            const gchar *remote = xfce_rc_read_entry(rc, "remote_command", DEFAULT_REMOTE_COMMAND);
+            g_free(data->remote_command);
+            data->remote_command = g_strdup(remote);
             xfce_rc_close(rc);
 
             /* Update Rust core with thresholds */
@@ -475,6 +911,11 @@ static void claude_status_read_config(ClaudeStatusPlugin *data) {
             claude_status_core_set_yellow_threshold(data->core, data->yellow_threshold);
             claude_status_core_set_orange_threshold(data->core, data->orange_threshold);
             claude_status_core_set_red_threshold(data->core, data->red_threshold);
+            claude_status_core_set_max_requests_per_hour(data->core, data->max_requests_per_hour);
+            claude_status_core_set_archive_dir(data->core, data->archive_dir);
+            claude_status_core_set_transcript_roots(data->core, data->transcript_roots);
+            claude_status_core_set_remote_command(data->core, data->remote_command);
+            claude_status_core_set_shm_enabled(data->core, data->publish_shm);
             return;
         }
     }
@@ -484,14 +925,31 @@ static void claude_status_read_config(ClaudeStatusPlugin *data) {
     data->yellow_threshold = DEFAULT_YELLOW_THRESHOLD;
     data->orange_threshold = DEFAULT_ORANGE_THRESHOLD;
     data->red_threshold = DEFAULT_RED_THRESHOLD;
+    data->max_requests_per_hour = DEFAULT_MAX_REQUESTS_PER_HOUR;
+    data->show_sparkline = DEFAULT_SHOW_SPARKLINE;
+    data->show_limits = DEFAULT_SHOW_LIMITS;
+    data->show_context = DEFAULT_SHOW_CONTEXT;
+    data->show_totals = DEFAULT_SHOW_TOTALS;
+    data->publish_shm = DEFAULT_PUBLISH_SHM;
     g_free(data->creds_file);
     data->creds_file = g_strdup(DEFAULT_CREDS_FILE);
+    g_free(data->archive_dir);
+    data->archive_dir = g_strdup(DEFAULT_ARCHIVE_DIR);
+    g_free(data->transcript_roots);
+    data->transcript_roots = g_strdup(DEFAULT_TRANSCRIPT_ROOTS);
+    g_free(data->remote_command);
+    data->remote_command = g_strdup(DEFAULT_REMOTE_COMMAND);
 
     /* Update Rust core with defaults */
     claude_status_core_set_update_interval(data->core, data->update_interval);
     claude_status_core_set_yellow_threshold(data->core, data->yellow_threshold);
     claude_status_core_set_orange_threshold(data->core, data->orange_threshold);
     claude_status_core_set_red_threshold(data->core, data->red_threshold);
+    claude_status_core_set_max_requests_per_hour(data->core, data->max_requests_per_hour);
+    claude_status_core_set_archive_dir(data->core, data->archive_dir);
+    claude_status_core_set_transcript_roots(data->core, data->transcript_roots);
+    claude_status_core_set_remote_command(data->core, data->remote_command);
+    claude_status_core_set_shm_enabled(data->core, data->publish_shm);
 }
 
 /* Save configuration to rc file */
@@ -507,14 +965,76 @@ static void claude_status_save_config(ClaudeStatusPlugin *data) {
             xfce_rc_write_int_entry(rc, "yellow_threshold", data->yellow_threshold);
             xfce_rc_write_int_entry(rc, "orange_threshold", data->orange_threshold);
             xfce_rc_write_int_entry(rc, "red_threshold", data->red_threshold);
+            xfce_rc_write_int_entry(rc, "max_requests_per_hour", data->max_requests_per_hour);
+            xfce_rc_write_bool_entry(rc, "show_sparkline", data->show_sparkline);
+            xfce_rc_write_bool_entry(rc, "show_limits", data->show_limits);
+            xfce_rc_write_bool_entry(rc, "show_context", data->show_context);
+            xfce_rc_write_bool_entry(rc, "show_totals", data->show_totals);
+            xfce_rc_write_bool_entry(rc, "publish_shm", data->publish_shm);
             xfce_rc_write_entry(rc, "creds_file", data->creds_file ? data->creds_file : DEFAULT_CREDS_FILE);
+            xfce_rc_write_entry(rc, "archive_dir", data->archive_dir ? data->archive_dir : DEFAULT_ARCHIVE_DIR);
+            xfce_rc_write_entry(rc, "transcript_roots", data->transcript_roots ? data->transcript_roots : DEFAULT_TRANSCRIPT_ROOTS);
+            xfce_rc_write_entry(rc, "remote_command", data->remote_command ? data->remote_command : DEFAULT_REMOTE_COMMAND);
             xfce_rc_close(rc);
         }
     }
 }
 
+/* Create the drawing area for the 5h usage sparkline */
+static GtkWidget* create_sparkline(ClaudeStatusPlugin *data) {
+    GtkWidget *area = gtk_drawing_area_new();
+    gtk_widget_set_size_request(area, SPARK_WIDTH, -1);
+    gtk_widget_set_no_show_all(area, !data->show_sparkline);
+    gtk_widget_set_visible(area, data->show_sparkline);
+    g_signal_connect(area, "draw", G_CALLBACK(on_sparkline_draw), data);
+    return area;
+}
+
+/* Subscribe the core to exactly the metrics the panel shows */
+static void update_subscriptions(ClaudeStatusPlugin *data) {
+    const gboolean wanted[] = {
+        [MetricLimits] = data->show_limits,
+        [MetricHistory] = data->show_limits && data->show_sparkline,
+        [MetricContext] = data->show_context,
+        [MetricSessions] = data->show_totals,
+    };
+
+    for (gsize i = 0; i < G_N_ELEMENTS(wanted); i++) {
+        if (wanted[i] == data->subscribed[i]) continue;
+        if (wanted[i]) {
+            claude_status_core_subscribe(data->core, (enum CMetric)i);
+        } else {
+            claude_status_core_unsubscribe(data->core, (enum CMetric)i);
+        }
+        data->subscribed[i] = wanted[i];
+    }
+}
+
+static void set_shown(GtkWidget *widget, gboolean shown) {
+    gtk_widget_set_no_show_all(widget, !shown);
+    gtk_widget_set_visible(widget, shown);
+}
+
+/* Hide the parts of the panel whose metrics are turned off */
+static void apply_visibility(ClaudeStatusPlugin *data) {
+    GtkWidget *limits[] = {
+        data->five_hour_lbl, data->five_hour_bar, data->five_hour_pct,
+        data->seven_day_lbl, data->seven_day_bar, data->seven_day_pct,
+    };
+    for (gsize i = 0; i < G_N_ELEMENTS(limits); i++) {
+        set_shown(limits[i], data->show_limits);
+    }
+    /* Single-row layout never shows the reset times */
+    set_shown(data->five_hour_reset, data->show_limits && !data->single_row);
+    set_shown(data->seven_day_reset, data->show_limits && !data->single_row);
+    set_shown(data->five_hour_spark, data->show_limits && data->show_sparkline);
+    set_shown(data->ctx_label, data->show_context);
+}
+
 /* Build the plugin UI based on current layout settings */
 static void claude_status_rebuild_ui(ClaudeStatusPlugin *data) {
+    update_subscriptions(data);
+
     if (data->grid) {
         gtk_widget_destroy(data->grid);
         data->grid = NULL;
@@ -522,6 +1042,7 @@ static void claude_status_rebuild_ui(ClaudeStatusPlugin *data) {
         data->five_hour_lbl = NULL;
         data->five_hour_bar = NULL;
         data->five_hour_pct = NULL;
+        data->five_hour_spark = NULL;
         data->five_hour_reset = NULL;
         data->ctx_label = NULL;
         data->seven_day_lbl = NULL;
@@ -554,23 +1075,26 @@ static void claude_status_rebuild_ui(ClaudeStatusPlugin *data) {
         data->five_hour_pct = create_label(data, "  0%", "#5faf5f", FALSE);
         gtk_grid_attach(GTK_GRID(data->grid), data->five_hour_pct, 3, 0, 1, 1);
 
+        data->five_hour_spark = create_sparkline(data);
+        gtk_grid_attach(GTK_GRID(data->grid), data->five_hour_spark, 4, 0, 1, 1);
+
         data->five_hour_reset = create_label(data, "", "#666", FALSE);
         gtk_widget_set_visible(data->five_hour_reset, FALSE);
 
         data->seven_day_lbl = create_label(data, "7d:", "#888", FALSE);
-        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_lbl, 4, 0, 1, 1);
+        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_lbl, 5, 0, 1, 1);
 
         data->seven_day_bar = create_label(data, "░░░░░░░░", "#5faf5f", FALSE);
-        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_bar, 5, 0, 1, 1);
+        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_bar, 6, 0, 1, 1);
 
         data->seven_day_pct = create_label(data, "  0%", "#5faf5f", FALSE);
-        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_pct, 6, 0, 1, 1);
+        gtk_grid_attach(GTK_GRID(data->grid), data->seven_day_pct, 7, 0, 1, 1);
 
         data->seven_day_reset = create_label(data, "", "#666", FALSE);
         gtk_widget_set_visible(data->seven_day_reset, FALSE);
 
         data->ctx_label = create_label(data, "Ctx:  0%", "#5faf5f", FALSE);
-        gtk_grid_attach(GTK_GRID(data->grid), data->ctx_label, 7, 0, 1, 1);
+        gtk_grid_attach(GTK_GRID(data->grid), data->ctx_label, 8, 0, 1, 1);
     } else {
         data->plan_label = create_label(data, "—", "#d4a574", TRUE);
         gtk_grid_attach(GTK_GRID(data->grid), data->plan_label, 0, 0, 1, 1);
@@ -587,6 +1111,9 @@ static void claude_status_rebuild_ui(ClaudeStatusPlugin *data) {
         data->five_hour_reset = create_label(data, "", "#666", FALSE);
         gtk_grid_attach(GTK_GRID(data->grid), data->five_hour_reset, 4, 0, 1, 1);
 
+        data->five_hour_spark = create_sparkline(data);
+        gtk_grid_attach(GTK_GRID(data->grid), data->five_hour_spark, 5, 0, 1, 1);
+
         data->ctx_label = create_label(data, "Ctx:  0%", "#5faf5f", FALSE);
         gtk_grid_attach(GTK_GRID(data->grid), data->ctx_label, 0, 1, 1, 1);
 
@@ -604,6 +1131,8 @@ static void claude_status_rebuild_ui(ClaudeStatusPlugin *data) {
     }
 
     gtk_widget_show_all(data->grid);
+    apply_visibility(data);
+    invalidate_sparkline(data);
     claude_status_update(data);
 }
 
@@ -640,6 +1169,12 @@ static void on_update_interval_changed(GtkSpinButton *btn, gpointer user_data) {
     claude_status_core_set_update_interval(data->core, data->update_interval);
 }
 
+static void on_max_requests_changed(GtkSpinButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->max_requests_per_hour = gtk_spin_button_get_value_as_int(btn);
+    g_atomic_int_set(&data->pending_max_requests, data->max_requests_per_hour);
+}
+
 static void on_yellow_threshold_changed(GtkSpinButton *btn, gpointer user_data) {
     ClaudeStatusPlugin *data = user_data;
     data->yellow_threshold = gtk_spin_button_get_value_as_int(btn);
@@ -658,6 +1193,39 @@ static void on_red_threshold_changed(GtkSpinButton *btn, gpointer user_data) {
     claude_status_core_set_red_threshold(data->core, data->red_threshold);
 }
 
+static void on_show_sparkline_toggled(GtkToggleButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->show_sparkline = gtk_toggle_button_get_active(btn);
+    claude_status_rebuild_ui(data);
+}
+
+/* Turned-on metrics fill in with the next refresh */
+static void on_show_limits_toggled(GtkToggleButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->show_limits = gtk_toggle_button_get_active(btn);
+    claude_status_rebuild_ui(data);
+}
+
+static void on_show_context_toggled(GtkToggleButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->show_context = gtk_toggle_button_get_active(btn);
+    claude_status_rebuild_ui(data);
+}
+
+static void on_show_totals_toggled(GtkToggleButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    data->show_totals = gtk_toggle_button_get_active(btn);
+    claude_status_rebuild_ui(data);
+}
+
+static void on_publish_shm_toggled(GtkToggleButton *btn, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+
+    /* Started by the next fetch, which reports back in show_shm_result */
+    data->publish_shm = gtk_toggle_button_get_active(btn);
+    g_atomic_int_set(&data->pending_publish_shm, data->publish_shm);
+}
+
 static void on_creds_file_set(GtkFileChooserButton *button, gpointer user_data) {
     ClaudeStatusPlugin *data = user_data;
     gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(button));
@@ -676,11 +1244,46 @@ static void on_creds_file_set(GtkFileChooserButton *button, gpointer user_data)
     }
 }
 
+static void on_archive_dir_set(GtkFileChooserButton *button, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(button));
+
+    if (filename) {
+        const gchar *home = g_get_home_dir();
+        if (g_str_has_prefix(filename, home)) {
+            gchar *relative = g_strdup_printf("~%s", filename + strlen(home));
+            g_free(data->archive_dir);
+            data->archive_dir = relative;
+        } else {
+            g_free(data->archive_dir);
+            data->archive_dir = g_strdup(filename);
+        }
+        g_free(filename);
+        g_free(g_atomic_pointer_exchange(&data->pending_archive_dir, g_strdup(data->archive_dir)));
+    }
+}
+
+static void on_transcript_roots_changed(GtkEditable *editable, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    g_free(data->transcript_roots);
+    data->transcript_roots = g_strdup(gtk_entry_get_text(GTK_ENTRY(editable)));
+}
+
+static void on_remote_command_changed(GtkEditable *editable, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    g_free(data->remote_command);
+    data->remote_command = g_strdup(gtk_entry_get_text(GTK_ENTRY(editable)));
+}
+
 static void on_configure_response(GtkDialog *dialog, gint response, ClaudeStatusPlugin *data) {
     if (response == GTK_RESPONSE_OK || response == GTK_RESPONSE_APPLY) {
         claude_status_save_config(data);
         claude_status_restart_timer(data);
 
+        /* Handed over here rather than per keystroke: both start workers */
+        g_free(g_atomic_pointer_exchange(&data->pending_transcript_roots, g_strdup(data->transcript_roots)));
+        g_free(g_atomic_pointer_exchange(&data->pending_remote_command, g_strdup(data->remote_command)));
+
         /* Restart file monitor with new path */
         claude_status_core_start_monitor(data->core, data->creds_file);
 
@@ -701,7 +1304,10 @@ static void claude_status_configure(XfcePanelPlugin *plugin, ClaudeStatusPlugin
     GtkWidget *grid;
     GtkWidget *label;
     GtkWidget *spin;
+    GtkWidget *check;
     GtkWidget *file_chooser;
+    GtkWidget *folder_chooser;
+    GtkWidget *entry;
 
     xfce_panel_plugin_block_menu(plugin);
 
@@ -733,53 +1339,100 @@ static void claude_status_configure(XfcePanelPlugin *plugin, ClaudeStatusPlugin
     g_signal_connect(spin, "value-changed", G_CALLBACK(on_update_interval_changed), data);
     gtk_grid_attach(GTK_GRID(grid), spin, 1, 0, 1, 1);
 
+    /* Request budget */
+    label = gtk_label_new("Max requests per hour:");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 1, 1, 1);
+
+    spin = gtk_spin_button_new_with_range(10, 600, 10);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin), data->max_requests_per_hour);
+    g_signal_connect(spin, "value-changed", G_CALLBACK(on_max_requests_changed), data);
+    gtk_grid_attach(GTK_GRID(grid), spin, 1, 1, 1, 1);
+
     /* Color thresholds header */
     label = gtk_label_new(NULL);
     gtk_label_set_markup(GTK_LABEL(label), "<b>Color thresholds (%)</b>");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
     gtk_widget_set_margin_top(label, 12);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 1, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 2, 2, 1);
 
     /* Yellow threshold */
     label = gtk_label_new("Yellow (warning):");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 3, 1, 1);
 
     spin = gtk_spin_button_new_with_range(1, 99, 5);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin), data->yellow_threshold);
     g_signal_connect(spin, "value-changed", G_CALLBACK(on_yellow_threshold_changed), data);
-    gtk_grid_attach(GTK_GRID(grid), spin, 1, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), spin, 1, 3, 1, 1);
 
     /* Orange threshold */
     label = gtk_label_new("Orange (caution):");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 4, 1, 1);
 
     spin = gtk_spin_button_new_with_range(1, 99, 5);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin), data->orange_threshold);
     g_signal_connect(spin, "value-changed", G_CALLBACK(on_orange_threshold_changed), data);
-    gtk_grid_attach(GTK_GRID(grid), spin, 1, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), spin, 1, 4, 1, 1);
 
     /* Red threshold */
     label = gtk_label_new("Red (critical):");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 5, 1, 1);
 
     spin = gtk_spin_button_new_with_range(1, 99, 5);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin), data->red_threshold);
     g_signal_connect(spin, "value-changed", G_CALLBACK(on_red_threshold_changed), data);
-    gtk_grid_attach(GTK_GRID(grid), spin, 1, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), spin, 1, 5, 1, 1);
+
+    /* Display options */
+    label = gtk_label_new(NULL);
+    gtk_label_set_markup(GTK_LABEL(label), "<b>Display</b>");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_widget_set_margin_top(label, 12);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 6, 2, 1);
+
+    check = gtk_check_button_new_with_label("Show rate limits");
+    gtk_widget_set_tooltip_text(check, "Without rate limits, no usage requests are made");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), data->show_limits);
+    g_signal_connect(check, "toggled", G_CALLBACK(on_show_limits_toggled), data);
+    gtk_grid_attach(GTK_GRID(grid), check, 0, 7, 2, 1);
+
+    check = gtk_check_button_new_with_label("Show session context");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), data->show_context);
+    g_signal_connect(check, "toggled", G_CALLBACK(on_show_context_toggled), data);
+    gtk_grid_attach(GTK_GRID(grid), check, 0, 8, 2, 1);
+
+    check = gtk_check_button_new_with_label("Show all-time totals");
+    gtk_widget_set_tooltip_text(check, "Without context or totals, transcripts are not read");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), data->show_totals);
+    g_signal_connect(check, "toggled", G_CALLBACK(on_show_totals_toggled), data);
+    gtk_grid_attach(GTK_GRID(grid), check, 0, 9, 2, 1);
+
+    check = gtk_check_button_new_with_label("Show 5h usage sparkline");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), data->show_sparkline);
+    g_signal_connect(check, "toggled", G_CALLBACK(on_show_sparkline_toggled), data);
+    gtk_grid_attach(GTK_GRID(grid), check, 0, 10, 2, 1);
+
+    check = gtk_check_button_new_with_label("Publish snapshot for other programs");
+    gtk_widget_set_tooltip_text(check, "Keep current values in /dev/shm for status bars and shell prompts");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), data->publish_shm);
+    g_signal_connect(check, "toggled", G_CALLBACK(on_publish_shm_toggled), data);
+    gtk_grid_attach(GTK_GRID(grid), check, 0, 11, 2, 1);
+    data->shm_check = check;
+    g_object_add_weak_pointer(G_OBJECT(check), (gpointer *)&data->shm_check);
 
     /* Credentials file */
     label = gtk_label_new(NULL);
     gtk_label_set_markup(GTK_LABEL(label), "<b>Credentials</b>");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
     gtk_widget_set_margin_top(label, 12);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 5, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 12, 2, 1);
 
     label = gtk_label_new("Credentials file:");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 6, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 13, 1, 1);
 
     file_chooser = gtk_file_chooser_button_new("Select Credentials File", GTK_FILE_CHOOSER_ACTION_OPEN);
 
@@ -806,7 +1459,49 @@ static void claude_status_configure(XfcePanelPlugin *plugin, ClaudeStatusPlugin
     gtk_file_chooser_set_show_hidden(GTK_FILE_CHOOSER(file_chooser), TRUE);
 
     g_signal_connect(file_chooser, "file-set", G_CALLBACK(on_creds_file_set), data);
-    gtk_grid_attach(GTK_GRID(grid), file_chooser, 1, 6, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), file_chooser, 1, 13, 1, 1);
+
+    /* Transcript archive */
+    label = gtk_label_new(NULL);
+    gtk_label_set_markup(GTK_LABEL(label), "<b>History</b>");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_widget_set_margin_top(label, 12);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 14, 2, 1);
+
+    label = gtk_label_new("Transcript archive:");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 15, 1, 1);
+
+    folder_chooser = gtk_file_chooser_button_new("Select Archive Folder", GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER);
+    if (data->archive_dir && data->archive_dir[0] != '\0') {
+        gchar *archive_path = expand_path(data->archive_dir);
+        gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(folder_chooser), archive_path);
+        g_free(archive_path);
+    }
+    g_signal_connect(folder_chooser, "file-set", G_CALLBACK(on_archive_dir_set), data);
+    gtk_grid_attach(GTK_GRID(grid), folder_chooser, 1, 15, 1, 1);
+
+    label = gtk_label_new("Extra transcript folders:");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 16, 1, 1);
+
+    entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "~/work/.devcontainer/claude/projects:...");
+    gtk_entry_set_text(GTK_ENTRY(entry), data->transcript_roots ? data->transcript_roots : "");
+    gtk_widget_set_tooltip_text(entry,
+        "Projects folders to scan besides ~/.claude/projects and $CLAUDE_CONFIG_DIR/projects, separated by ':'");
+    g_signal_connect(entry, "changed", G_CALLBACK(on_transcript_roots_changed), data);
+    gtk_grid_attach(GTK_GRID(grid), entry, 1, 16, 1, 1);
+
+    label = gtk_label_new("Remote agent command:");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 17, 1, 1);
+
+    entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "ssh host claude-status-cli agent");
+    gtk_entry_set_text(GTK_ENTRY(entry), data->remote_command ? data->remote_command : "");
+    g_signal_connect(entry, "changed", G_CALLBACK(on_remote_command_changed), data);
+    gtk_grid_attach(GTK_GRID(grid), entry, 1, 17, 1, 1);
 
     /* Info label */
     label = gtk_label_new(NULL);
@@ -815,13 +1510,30 @@ static void claude_status_configure(XfcePanelPlugin *plugin, ClaudeStatusPlugin
         "Narrow panels use single-row compact mode.</small>");
     gtk_label_set_xalign(GTK_LABEL(label), 0.0);
     gtk_widget_set_margin_top(label, 12);
-    gtk_grid_attach(GTK_GRID(grid), label, 0, 7, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 18, 2, 1);
 
     g_signal_connect(dialog, "response", G_CALLBACK(on_configure_response), data);
 
     gtk_widget_show_all(dialog);
 }
 
+/* Export usage data */
+static void on_export_activate(GtkMenuItem *item, gpointer user_data) {
+    ClaudeStatusPlugin *data = user_data;
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Export Usage Data", NULL,
+        GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Export", GTK_RESPONSE_ACCEPT,
+        NULL);
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        gchar *dir = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+        g_free(g_atomic_pointer_exchange(&data->export_dir, dir));
+        claude_status_fetch_usage(data);
+    }
+    gtk_widget_destroy(chooser);
+}
+
 /* About dialog */
 static void claude_status_about(XfcePanelPlugin *plugin) {
     const gchar *authors[] = {
@@ -846,10 +1558,18 @@ static void claude_status_construct(XfcePanelPlugin *plugin) {
     data->plugin = plugin;
     data->five_hour_reset_str = g_strdup("");
     data->seven_day_reset_str = g_strdup("");
+    data->turns_to_compact = -1;
+    data->secs_to_compact = -1;
+    data->pending_publish_shm = -1;
+    data->shm_result = -1;
+    data->spark_samples = g_new0(struct CUsageSample, SPARK_MAX_SAMPLES);
 
     /* Create Rust core */
     data->core = claude_status_core_new();
 
+    /* Share the user daemon's core if it runs; otherwise work in-process */
+    claude_status_core_connect_daemon(data->core, NULL);
+
     /* Load configuration */
     claude_status_read_config(data);
 
@@ -883,6 +1603,11 @@ static void claude_status_construct(XfcePanelPlugin *plugin) {
     xfce_panel_plugin_menu_show_about(plugin);
     g_signal_connect(plugin, "about", G_CALLBACK(claude_status_about), NULL);
 
+    GtkWidget *export_item = gtk_menu_item_new_with_mnemonic("E_xport Usage Data...");
+    g_signal_connect(export_item, "activate", G_CALLBACK(on_export_activate), data);
+    xfce_panel_plugin_menu_insert_item(plugin, GTK_MENU_ITEM(export_item));
+    gtk_widget_show(export_item);
+
     /* Start file monitor via Rust */
     claude_status_core_start_monitor(data->core, data->creds_file);
 
@@ -898,6 +1623,9 @@ static void claude_status_free(XfcePanelPlugin *plugin, ClaudeStatusPlugin *data
     if (data->timeout_id > 0) {
         g_source_remove(data->timeout_id);
     }
+    if (data->deferred_id > 0) {
+        g_source_remove(data->deferred_id);
+    }
 
     /* Stop Rust file monitor */
     claude_status_core_stop_monitor(data->core);
@@ -912,6 +1640,20 @@ static void claude_status_free(XfcePanelPlugin *plugin, ClaudeStatusPlugin *data
     g_free(data->seven_day_reset_time);
     g_free(data->model_name);
     g_free(data->creds_file);
+    g_free(data->archive_dir);
+    g_free(data->transcript_roots);
+    g_free(data->remote_command);
+    g_free(data->export_dir);
+    g_free(data->export_failed);
+    g_free(data->pending_archive_dir);
+    g_free(data->pending_transcript_roots);
+    g_free(data->pending_remote_command);
+    g_free(data->context_host);
+    g_free(data->context_tools);
+    g_free(data->spark_samples);
+    if (data->spark_surface) {
+        cairo_surface_destroy(data->spark_surface);
+    }
     if (data->last_updated) {
         g_date_time_unref(data->last_updated);
     }
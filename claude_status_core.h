@@ -16,8 +16,72 @@ typedef enum CResultCode {
   NetworkError = 3,
   ParseError = 4,
   AuthError = 5,
+  /**
+   * Request budget exhausted; retry after `retry_after_secs`
+   */
+  Deferred = 6,
 } CResultCode;
 
+/**
+ * Grouping of a ledger query
+ */
+typedef enum CQueryGroup {
+  GroupTotal = 0,
+  GroupProject = 1,
+  GroupModel = 2,
+  GroupSession = 3,
+  /**
+   * Calendar day, UTC
+   */
+  GroupDay = 4,
+  /**
+   * Weekday and hour, UTC
+   */
+  GroupHourOfWeek = 5,
+} CQueryGroup;
+
+/**
+ * Ordering of ledger query results, largest first
+ */
+typedef enum CQueryOrder {
+  /**
+   * Chronological for days and hours, by name otherwise
+   */
+  OrderNatural = 0,
+  OrderRows = 1,
+  OrderInput = 2,
+  OrderOutput = 3,
+  OrderCacheCreation = 4,
+  OrderCacheRead = 5,
+  /**
+   * Input plus cache creation tokens
+   */
+  OrderCacheMiss = 6,
+  OrderTotal = 7,
+} CQueryOrder;
+
+/**
+ * Metric a consumer can subscribe to
+ */
+typedef enum CMetric {
+  /**
+   * 5-hour and 7-day usage windows; needs the usage API
+   */
+  MetricLimits = 0,
+  /**
+   * Usage history for the sparkline
+   */
+  MetricHistory = 1,
+  /**
+   * Current session context; needs the transcript scan
+   */
+  MetricContext = 2,
+  /**
+   * Long-term ledger totals; needs the transcript scan and ledger refresh
+   */
+  MetricSessions = 3,
+} CMetric;
+
 /**
  * Opaque handle to the Rust core state
  */
@@ -57,12 +121,110 @@ typedef struct CUsageData {
    * 7-day reset time as Unix timestamp
    */
   int64_t seven_day_reset_ts;
+  /**
+   * Changes only when a different response is published
+   */
+  uint64_t generation;
+  /**
+   * Time of the last successful fetch as Unix timestamp
+   */
+  int64_t fetched_at;
   /**
    * Whether the data is valid
    */
   bool valid;
 } CUsageData;
 
+/**
+ * Connection attempts to one address family
+ */
+typedef struct CConnectStats {
+  /**
+   * Connects started to addresses of this family
+   */
+  uint64_t attempts;
+  /**
+   * Connects that failed or timed out
+   */
+  uint64_t failures;
+  /**
+   * New connections that went to this family
+   */
+  uint64_t wins;
+  /**
+   * Duration of the last successful connect in milliseconds
+   */
+  uint32_t last_ms;
+  /**
+   * Moving average of successful connects in milliseconds
+   */
+  uint32_t avg_ms;
+} CConnectStats;
+
+/**
+ * Fetch diagnostics returned to C
+ */
+typedef struct CDiagnostics {
+  /**
+   * Usage requests that reached the network
+   */
+  uint64_t requests;
+  /**
+   * Responses that changed the published usage
+   */
+  uint64_t published;
+  /**
+   * Responses identical to the previous one, not republished
+   */
+  uint64_t unchanged;
+  /**
+   * Fetches refused by the request budget
+   */
+  uint64_t denied;
+  /**
+   * Requests that may currently be made back to back
+   */
+  uint32_t budget_available;
+  /**
+   * Burst size of the request budget
+   */
+  uint32_t budget_capacity;
+  /**
+   * Whether a refused fetch is waiting for budget
+   */
+  bool deferred;
+  /**
+   * Seconds until the budget allows the next fetch
+   */
+  uint32_t retry_after_secs;
+  /**
+   * Connects to IPv4 addresses
+   */
+  struct CConnectStats ipv4;
+  /**
+   * Connects to IPv6 addresses
+   */
+  struct CConnectStats ipv6;
+} CDiagnostics;
+
+/**
+ * Usage history sample returned to C
+ */
+typedef struct CUsageSample {
+  /**
+   * Fetch time as Unix timestamp
+   */
+  int64_t ts;
+  /**
+   * 5-hour utilization percentage (0-100)
+   */
+  double five_hour_pct;
+  /**
+   * 7-day utilization percentage (0-100)
+   */
+  double seven_day_pct;
+} CUsageSample;
+
 /**
  * Context window info returned to C
  */
@@ -83,12 +245,129 @@ typedef struct CContextInfo {
    * Model name (owned by Rust, valid until next call)
    */
   const char *model_name;
+  /**
+   * Host of a remote session, null for local (owned by Rust, valid until next call)
+   */
+  const char *host;
+  /**
+   * Predicted assistant turns until auto-compact, -1 if unknown
+   */
+  int64_t turns_to_compact;
+  /**
+   * Predicted seconds until auto-compact, -1 if unknown
+   */
+  int64_t secs_to_compact;
+  /**
+   * Subagent API messages in this session
+   */
+  int64_t sidechain_messages;
+  /**
+   * Subagent input tokens, including cache reads and writes
+   */
+  int64_t sidechain_input_tokens;
+  /**
+   * Subagent output tokens
+   */
+  int64_t sidechain_output_tokens;
   /**
    * Whether the data is valid
    */
   bool valid;
 } CContextInfo;
 
+/**
+ * One point of the context timeline returned to C
+ */
+typedef struct CTimelinePoint {
+  /**
+   * Peak context tokens within the point's span
+   */
+  int64_t context_tokens;
+  /**
+   * Whether the session compacted within the point's span
+   */
+  bool compacted;
+} CTimelinePoint;
+
+/**
+ * Context taken by one tool, returned to C
+ */
+typedef struct CToolShare {
+  /**
+   * Tool name (valid until the next call)
+   */
+  const char *name;
+  /**
+   * Calls made in the current context
+   */
+  int64_t calls;
+  /**
+   * Serialized size of the tool's inputs and results
+   */
+  int64_t bytes;
+} CToolShare;
+
+/**
+ * Token ledger totals returned to C
+ */
+typedef struct CLedgerTotals {
+  /**
+   * Number of usage rows
+   */
+  uint64_t rows;
+  /**
+   * Number of distinct sessions
+   */
+  uint64_t sessions;
+  uint64_t input_tokens;
+  uint64_t output_tokens;
+  uint64_t cache_creation_tokens;
+  uint64_t cache_read_tokens;
+  /**
+   * Changes whenever rows are added
+   */
+  uint64_t version;
+  /**
+   * Whether the data is valid
+   */
+  bool valid;
+} CLedgerTotals;
+
+/**
+ * Ledger query passed from C
+ */
+typedef struct CQuery {
+  /**
+   * Start of the range as Unix timestamp, inclusive; 0 for none
+   */
+  int64_t since;
+  /**
+   * End of the range as Unix timestamp, exclusive; 0 for none
+   */
+  int64_t until;
+  /**
+   * Only rows of this project, null for all
+   */
+  const char *project;
+  enum CQueryGroup group_by;
+  enum CQueryOrder order_by;
+} CQuery;
+
+/**
+ * One group of a ledger query result
+ */
+typedef struct CQueryRow {
+  /**
+   * Group name, valid until the next query on this thread
+   */
+  const char *key;
+  uint64_t rows;
+  uint64_t input_tokens;
+  uint64_t output_tokens;
+  uint64_t cache_creation_tokens;
+  uint64_t cache_read_tokens;
+} CQueryRow;
+
 /**
  * Create a new core instance
  *
@@ -97,6 +376,25 @@ typedef struct CContextInfo {
  */
 struct ClaudeStatusCore *claude_status_core_new(void);
 
+/**
+ * Hand the core's work to the user daemon
+ *
+ * Connects to the daemon socket at `path`, or to
+ * `$XDG_RUNTIME_DIR/claude-status.sock` if null, which fails when
+ * `XDG_RUNTIME_DIR` is unset. Afterwards
+ * `claude_status_core_refresh` and exports run in the daemon and the
+ * getters return what it last reported; settings and subscriptions are
+ * sent along with every refresh. A lost connection is reopened on the
+ * next call; if that fails too, the refresh takes the work back and the
+ * core does it itself from then on. Returns false, leaving the core to do
+ * the work itself, if nothing listens on the socket. Call right after
+ * `claude_status_core_new`.
+ *
+ * # Safety
+ * `core` must be valid, `path` must be a valid C string or null
+ */
+bool claude_status_core_connect_daemon(struct ClaudeStatusCore *core, const char *path);
+
 /**
  * Free the core instance
  *
@@ -114,6 +412,19 @@ void claude_status_core_free(struct ClaudeStatusCore *core);
 enum CResultCode claude_status_core_load_credentials(struct ClaudeStatusCore *core,
                                                      const char *path);
 
+/**
+ * Reload credentials, fetch usage, read context and refresh the ledger
+ *
+ * A missing credentials file only fails the refresh while rate limits are
+ * needed. Returns the result of the usage fetch, which may be `Deferred`.
+ * Runs in the daemon when connected to one.
+ *
+ * # Safety
+ * `core` must be valid, `creds_path` must be a valid C string or null for
+ * default
+ */
+enum CResultCode claude_status_core_refresh(struct ClaudeStatusCore *core, const char *creds_path);
+
 /**
  * Get credentials info
  *
@@ -138,6 +449,37 @@ enum CResultCode claude_status_core_fetch_usage(struct ClaudeStatusCore *core);
  */
 struct CUsageData claude_status_core_get_usage(const struct ClaudeStatusCore *core);
 
+/**
+ * Get fetch diagnostics
+ *
+ * # Safety
+ * `core` must be valid
+ */
+struct CDiagnostics claude_status_core_get_diagnostics(const struct ClaudeStatusCore *core);
+
+/**
+ * Get the usage history generation
+ *
+ * Changes whenever a new sample is recorded, so callers can skip copying
+ * and redrawing while it stays the same.
+ *
+ * # Safety
+ * `core` must be valid
+ */
+uint64_t claude_status_core_get_history_generation(const struct ClaudeStatusCore *core);
+
+/**
+ * Copy the newest usage history samples, oldest first
+ *
+ * Writes at most `max_samples` samples and returns the number written.
+ *
+ * # Safety
+ * `core` must be valid, `samples` must have room for `max_samples` entries
+ */
+uintptr_t claude_status_core_get_history(const struct ClaudeStatusCore *core,
+                                         struct CUsageSample *samples,
+                                         uintptr_t max_samples);
+
 /**
  * Read context info from the latest transcript
  *
@@ -154,6 +496,74 @@ enum CResultCode claude_status_core_read_context(struct ClaudeStatusCore *core);
  */
 struct CContextInfo claude_status_core_get_context(const struct ClaudeStatusCore *core);
 
+/**
+ * Copy the context timeline of the last read session, oldest first
+ *
+ * Writes at most `max_points` points and returns the number written.
+ *
+ * # Safety
+ * `core` must be valid, `points` must have room for `max_points` entries
+ */
+uintptr_t claude_status_core_get_context_timeline(const struct ClaudeStatusCore *core,
+                                                  struct CTimelinePoint *points,
+                                                  uintptr_t max_points);
+
+/**
+ * Copy the tools taking the most context in the last read session
+ *
+ * Writes at most `max_tools` entries, largest first, and returns the
+ * number written. Names stay valid until the next call.
+ *
+ * # Safety
+ * `core` must be valid, `tools` must have room for `max_tools` entries
+ */
+uintptr_t claude_status_core_get_context_tools(const struct ClaudeStatusCore *core,
+                                               struct CToolShare *tools,
+                                               uintptr_t max_tools);
+
+/**
+ * Ingest new usage rows from live transcripts and the archive directory
+ *
+ * # Safety
+ * `core` must be valid
+ */
+enum CResultCode claude_status_core_refresh_ledger(struct ClaudeStatusCore *core);
+
+/**
+ * Get token totals over the whole ledger
+ *
+ * # Safety
+ * `core` must be valid
+ */
+struct CLedgerTotals claude_status_core_get_ledger_totals(const struct ClaudeStatusCore *core);
+
+/**
+ * Export the usage history and token ledger as Arrow IPC files
+ *
+ * Writes `usage-history.arrow` and `token-ledger.arrow` into `dir`.
+ *
+ * # Safety
+ * `core` must be valid, `dir` must be a valid C string
+ */
+enum CResultCode claude_status_core_export_arrow(const struct ClaudeStatusCore *core,
+                                                 const char *dir);
+
+/**
+ * Run an aggregation query over the ledger
+ *
+ * Writes at most `max_rows` groups and returns the number written.
+ * Results are cached until the ledger changes. Queries run over the local
+ * ledger only, which is empty while connected to the daemon.
+ *
+ * # Safety
+ * `core` and `query` must be valid, `rows` must have room for `max_rows`
+ * entries
+ */
+uintptr_t claude_status_core_query(struct ClaudeStatusCore *core,
+                                   const struct CQuery *query,
+                                   struct CQueryRow *rows,
+                                   uintptr_t max_rows);
+
 /**
  * Start monitoring the credentials file for changes
  *
@@ -211,6 +621,86 @@ void claude_status_core_set_orange_threshold(struct ClaudeStatusCore *core, int3
  */
 void claude_status_core_set_red_threshold(struct ClaudeStatusCore *core, int32_t threshold);
 
+/**
+ * Set configuration value: hard cap on usage requests per hour
+ *
+ * # Safety
+ * `core` must be valid
+ */
+void claude_status_core_set_max_requests_per_hour(struct ClaudeStatusCore *core,
+                                                  int32_t per_hour);
+
+/**
+ * Set configuration value: directory of archived transcripts
+ *
+ * Pass null or an empty string to disable archive ingestion.
+ *
+ * # Safety
+ * `core` must be valid, `path` must be a valid C string or null
+ */
+void claude_status_core_set_archive_dir(struct ClaudeStatusCore *core, const char *path);
+
+/**
+ * Set additional transcript roots, separated by `:`
+ *
+ * Each root is a projects directory like `~/.claude/projects`, e.g. a
+ * devcontainer bind mount. The default directory and the one under
+ * `CLAUDE_CONFIG_DIR` are always scanned. Pass null or an empty string
+ * to scan only those.
+ *
+ * # Safety
+ * `core` must be valid, `paths` must be a valid C string or null
+ */
+void claude_status_core_set_transcript_roots(struct ClaudeStatusCore *core, const char *paths);
+
+/**
+ * Set the command that starts a remote agent
+ *
+ * The command is run through `sh -c`, e.g.
+ * `ssh devbox claude-status-cli agent`. Its sessions are reported
+ * alongside local ones. Pass null or an empty string to disconnect.
+ *
+ * # Safety
+ * `core` must be valid, `command` must be a valid C string or null
+ */
+void claude_status_core_set_remote_command(struct ClaudeStatusCore *core, const char *command);
+
+/**
+ * Enable or disable publishing the shared-memory snapshot
+ *
+ * The snapshot lives in `/dev/shm/claude-status-<uid>`; see
+ * `claude_status_shm.h` for the layout and a reader. Returns false if it
+ * could not be created, e.g. because another instance publishes already.
+ * While connected to the daemon, the daemon publishes it and this always
+ * returns true.
+ *
+ * # Safety
+ * `core` must be valid
+ */
+bool claude_status_core_set_shm_enabled(struct ClaudeStatusCore *core, bool enabled);
+
+/**
+ * Subscribe to a metric
+ *
+ * Work is only done for metrics with at least one subscriber: without
+ * limits no usage requests are made, and without context or totals the
+ * transcripts are not scanned. Each subscription must be matched by one
+ * call to `claude_status_core_unsubscribe`. May be called while a refresh
+ * runs on another thread.
+ *
+ * # Safety
+ * `core` must be valid
+ */
+void claude_status_core_subscribe(const struct ClaudeStatusCore *core, enum CMetric metric);
+
+/**
+ * Drop a subscription made with `claude_status_core_subscribe`
+ *
+ * # Safety
+ * `core` must be valid
+ */
+void claude_status_core_unsubscribe(const struct ClaudeStatusCore *core, enum CMetric metric);
+
 /**
  * Get the color code for a percentage value based on thresholds
  * Returns a static string pointer (do not free)
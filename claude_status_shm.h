@@ -0,0 +1,156 @@
+/*
+ * Reader for the Claude status shared-memory snapshot
+ *
+ * When "Publish snapshot for other programs" is enabled, the panel plugin
+ * keeps its current values in /dev/shm/claude-status-<uid>. A reader maps
+ * the file once and then gets consistent values with plain loads, no
+ * syscalls and no coordination with the plugin:
+ *
+ *     struct claude_status_shm shm;
+ *     struct claude_status_snapshot snap;
+ *     if (claude_status_shm_open(&shm, NULL) == 0) {
+ *         if (claude_status_shm_read(&shm, &snap) && snap.context_valid)
+ *             printf("ctx %.0f%%\n", snap.context_pct);
+ *         claude_status_shm_close(&shm);
+ *     }
+ *
+ * Layout (native endian), mirrored from core/src/shm.rs:
+ *
+ *   offset  0  uint32_t  magic, CLAUDE_STATUS_SHM_MAGIC
+ *   offset  4  uint32_t  layout version, CLAUDE_STATUS_SHM_VERSION
+ *   offset  8  uint64_t  sequence; odd while a write is in progress
+ *   offset 16  uint64_t  payload words, see claude_status_shm_read()
+ *
+ * Header-only; needs a C11 compiler with GCC-style __atomic builtins.
+ */
+
+#ifndef CLAUDE_STATUS_SHM_H
+#define CLAUDE_STATUS_SHM_H
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CLAUDE_STATUS_SHM_MAGIC 0x31535343u
+#define CLAUDE_STATUS_SHM_VERSION 1u
+#define CLAUDE_STATUS_SHM_PAYLOAD_WORDS 13
+#define CLAUDE_STATUS_SHM_FILE_SIZE 4096
+#define CLAUDE_STATUS_SHM_MAX_ATTEMPTS 1000
+
+struct claude_status_shm_region {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+    uint64_t words[CLAUDE_STATUS_SHM_PAYLOAD_WORDS];
+};
+
+struct claude_status_shm {
+    const struct claude_status_shm_region *region;
+};
+
+struct claude_status_snapshot {
+    int64_t updated_at;
+    bool usage_valid;
+    bool context_valid;
+    double five_hour_pct;
+    double seven_day_pct;
+    int64_t five_hour_reset_ts;
+    int64_t seven_day_reset_ts;
+    uint64_t usage_generation;
+    double context_pct;
+    int64_t context_tokens;
+    int64_t context_window_size;
+    int64_t turns_to_compact;   /* -1 if unknown */
+    int64_t secs_to_compact;    /* -1 if unknown */
+    int64_t sidechain_tokens;
+};
+
+/* Map the snapshot; path NULL means the current user's default. Returns 0 on success.
+ * The file must be a regular file of the calling user with mode 0600, since the
+ * default path is predictable and anyone could have created it first. */
+static inline int claude_status_shm_open(struct claude_status_shm *shm, const char *path) {
+    char default_path[64];
+    if (!path) {
+        snprintf(default_path, sizeof(default_path), "/dev/shm/claude-status-%u",
+                 (unsigned)getuid());
+        path = default_path;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & 07777) != 0600 || st.st_size < CLAUDE_STATUS_SHM_FILE_SIZE) {
+        close(fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, CLAUDE_STATUS_SHM_FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -1;
+
+    shm->region = addr;
+    if (__atomic_load_n(&shm->region->magic, __ATOMIC_ACQUIRE) != CLAUDE_STATUS_SHM_MAGIC ||
+        __atomic_load_n(&shm->region->version, __ATOMIC_RELAXED) != CLAUDE_STATUS_SHM_VERSION) {
+        munmap(addr, CLAUDE_STATUS_SHM_FILE_SIZE);
+        shm->region = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void claude_status_shm_close(struct claude_status_shm *shm) {
+    if (shm->region) {
+        munmap((void *)shm->region, CLAUDE_STATUS_SHM_FILE_SIZE);
+        shm->region = NULL;
+    }
+}
+
+static inline double claude_status_shm_f64(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* Copy a consistent snapshot. Returns false only if the writer never pauses. */
+static inline bool claude_status_shm_read(const struct claude_status_shm *shm,
+                                          struct claude_status_snapshot *out) {
+    const struct claude_status_shm_region *r = shm->region;
+    uint64_t w[CLAUDE_STATUS_SHM_PAYLOAD_WORDS];
+
+    for (int attempt = 0; attempt < CLAUDE_STATUS_SHM_MAX_ATTEMPTS; attempt++) {
+        uint64_t before = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        for (int i = 0; i < CLAUDE_STATUS_SHM_PAYLOAD_WORDS; i++)
+            w[i] = __atomic_load_n(&r->words[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != before)
+            continue;
+
+        out->updated_at = (int64_t)w[0];
+        out->usage_valid = (w[1] & 1) != 0;
+        out->context_valid = (w[1] & 2) != 0;
+        out->five_hour_pct = claude_status_shm_f64(w[2]);
+        out->seven_day_pct = claude_status_shm_f64(w[3]);
+        out->five_hour_reset_ts = (int64_t)w[4];
+        out->seven_day_reset_ts = (int64_t)w[5];
+        out->usage_generation = w[6];
+        out->context_pct = claude_status_shm_f64(w[7]);
+        out->context_tokens = (int64_t)w[8];
+        out->context_window_size = (int64_t)w[9];
+        out->turns_to_compact = (int64_t)w[10];
+        out->secs_to_compact = (int64_t)w[11];
+        out->sidechain_tokens = (int64_t)w[12];
+        return true;
+    }
+    return false;
+}
+
+#endif /* CLAUDE_STATUS_SHM_H */
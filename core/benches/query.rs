@@ -0,0 +1,150 @@
+//! Query engine and export benchmark on a synthetic ledger
+//!
+//! Run with `cargo bench --bench query`. The ledger has 50M rows by
+//! default (about 2 GB of columns); set `CLAUDE_STATUS_BENCH_ROWS` for a
+//! smaller one.
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+use claude_status_core::arrow::{self, ArrowFormat};
+use claude_status_core::ledger::{Ledger, LedgerRow};
+use claude_status_core::query::{self, GroupBy, Metric, Query, QueryCache};
+
+const DEFAULT_ROWS: usize = 50_000_000;
+const PROJECTS: usize = 40;
+const SESSIONS_PER_PROJECT: usize = 500;
+const MODELS: [&str; 3] = ["claude-opus-4-1", "claude-sonnet-4-5", "claude-haiku-4-5"];
+const BATCH_ROWS: usize = 65_536;
+const RUNS: usize = 5;
+
+/// Two years of rows, one every ~1.26 s at 50M rows, in arrival order
+const SPAN_SECS: i64 = 2 * 365 * 86_400;
+const START_TS: i64 = 1_700_000_000;
+
+fn build_ledger(rows: usize) -> Ledger {
+    let mut ledger = Ledger::new();
+    let mut state = 0x9e37_79b9_7f4a_7c15u64;
+    let mut next = || {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        state
+    };
+
+    let step = SPAN_SECS as f64 / rows as f64;
+    let mut batch = Vec::with_capacity(BATCH_ROWS);
+    let mut written = 0;
+    while written < rows {
+        // Sessions run in bursts, so each batch belongs to one project
+        let project = format!("-home-dev-project-{:02}", next() as usize % PROJECTS);
+        let n = BATCH_ROWS.min(rows - written);
+        batch.clear();
+        for i in 0..n {
+            let r = next();
+            batch.push(LedgerRow {
+                key: None,
+                ts: START_TS + ((written + i) as f64 * step) as i64,
+                session: format!("{}-{}", project, r as usize % SESSIONS_PER_PROJECT),
+                model: Some(MODELS[(r >> 20) as usize % MODELS.len()].to_string()),
+                input_tokens: (r >> 32) as u32 % 2_000,
+                output_tokens: (r >> 40) as u32 % 4_000,
+                cache_creation_tokens: (r >> 24) as u32 % 10_000,
+                cache_read_tokens: (r >> 8) as u32 % 150_000,
+            });
+        }
+        ledger.ingest_rows(&project, &batch);
+        written += n;
+    }
+    ledger
+}
+
+fn bench(name: &str, rows: usize, mut f: impl FnMut() -> usize) {
+    let mut times: Vec<Duration> = (0..RUNS)
+        .map(|_| {
+            let start = Instant::now();
+            black_box(f());
+            start.elapsed()
+        })
+        .collect();
+    times.sort();
+    let median = times[RUNS / 2];
+    println!(
+        "{:<40} {:>10.2} ms  {:>8.0} Mrows/s",
+        name,
+        median.as_secs_f64() * 1e3,
+        rows as f64 / median.as_secs_f64() / 1e6
+    );
+}
+
+fn main() {
+    let rows = std::env::var("CLAUDE_STATUS_BENCH_ROWS")
+        .ok()
+        .and_then(|v| v.parse().ok())
+        .unwrap_or(DEFAULT_ROWS);
+
+    let start = Instant::now();
+    let ledger = build_ledger(rows);
+    println!("built {} rows in {:.1} s\n", ledger.len(), start.elapsed().as_secs_f64());
+
+    let end = START_TS + SPAN_SECS;
+    let (since, _) = Query::last_days(30, end);
+    let cases = [
+        ("total, all time", Query::default()),
+        (
+            "by day, last 30 days",
+            Query {
+                since,
+                group_by: GroupBy::Day,
+                ..Default::default()
+            },
+        ),
+        (
+            "by model, one project, last 30 days",
+            Query {
+                since,
+                project: Some("-home-dev-project-07".into()),
+                group_by: GroupBy::Model,
+                ..Default::default()
+            },
+        ),
+        (
+            "by project, all time",
+            Query {
+                group_by: GroupBy::Project,
+                order_by: Some(Metric::Total),
+                ..Default::default()
+            },
+        ),
+        (
+            "top 10 sessions by cache miss",
+            Query {
+                group_by: GroupBy::Session,
+                order_by: Some(Metric::CacheMiss),
+                limit: Some(10),
+                ..Default::default()
+            },
+        ),
+        (
+            "hour-of-week heatmap, all time",
+            Query {
+                group_by: GroupBy::HourOfWeek,
+                ..Default::default()
+            },
+        ),
+    ];
+
+    for (name, q) in &cases {
+        bench(name, rows, || query::run(&ledger, q).rows.len());
+    }
+
+    let mut cache = QueryCache::new();
+    let q = &cases[1].1;
+    cache.run(&ledger, q);
+    bench("by day, last 30 days (cached)", rows, || cache.run(&ledger, q).rows.len());
+
+    bench("arrow file export to memory", rows, || {
+        arrow::write_ledger(&ledger, Vec::with_capacity(rows * 36), ArrowFormat::File)
+            .map_or(0, |out| out.len())
+    });
+}
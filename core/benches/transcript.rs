@@ -0,0 +1,153 @@
+//! Transcript JSON backends on a corpus of transcripts
+//!
+//! Run with `cargo bench --bench transcript`. Every `.jsonl` file below
+//! `CLAUDE_STATUS_BENCH_CORPUS` is read, e.g. a tree written by
+//! `claude-status-cli anonymize`; without it a synthetic corpus of about
+//! 30 MB is generated. Each run reads every file from the start with a
+//! fresh tracker, and both backends must arrive at the same context.
+
+use std::fs;
+use std::hint::black_box;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use claude_status_core::transcript::{JsonBackend, TranscriptTracker};
+use serde_json::json;
+
+const SESSIONS: usize = 20;
+const TURNS_PER_SESSION: usize = 400;
+const RUNS: usize = 5;
+
+fn find_jsonl(dir: &Path, out: &mut Vec<PathBuf>) {
+    let entries = match fs::read_dir(dir) {
+        Ok(entries) => entries,
+        Err(_) => return,
+    };
+    for entry in entries.flatten() {
+        let path = entry.path();
+        if path.is_dir() {
+            find_jsonl(&path, out);
+        } else if path.extension().map_or(false, |ext| ext == "jsonl") {
+            out.push(path);
+        }
+    }
+}
+
+/// Sessions shaped like real ones: each turn is a user line and an
+/// assistant line whose content carries text, code and tool calls
+fn write_synthetic(dir: &Path) {
+    let mut state = 0x9e37_79b9_7f4a_7c15u64;
+    let mut next = || {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        state
+    };
+    let prose =
+        "Reading the file first: \"src/main.rs\" has\tthe\nentry point — then {patching} [it]. ";
+    let code = "fn main() {\n    println!(\"{}\", \\\"escaped\\\");\n}\n";
+
+    fs::create_dir_all(dir).unwrap();
+    for session in 0..SESSIONS {
+        let mut out = String::new();
+        let mut context = 20_000;
+        for turn in 0..TURNS_PER_SESSION {
+            let r = next();
+            let user = json!({
+                "type": "user",
+                "timestamp": format!("2026-01-01T{:02}:{:02}:00Z", turn / 60 % 24, turn % 60),
+                "message": {"role": "user", "content": [{"type": "tool_result", "content": code.repeat(1 + r as usize % 40)}]},
+            });
+            context += 200 + (r >> 16) as i64 % 3_000;
+            let assistant = json!({
+                "type": "assistant",
+                "isSidechain": r % 10 == 0,
+                "timestamp": format!("2026-01-01T{:02}:{:02}:30Z", turn / 60 % 24, turn % 60),
+                "message": {
+                    "id": format!("msg_{}_{}", session, turn),
+                    "model": "claude-sonnet-4-5",
+                    "content": [
+                        {"type": "text", "text": prose.repeat(1 + (r >> 8) as usize % 30)},
+                        {"type": "tool_use", "name": "Edit", "input": {"file_path": "src/main.rs", "old_string": code.repeat(1 + (r >> 24) as usize % 20), "new_string": code}},
+                    ],
+                    "usage": {"input_tokens": 4, "output_tokens": 300, "cache_creation_input_tokens": 500, "cache_read_input_tokens": context},
+                },
+            });
+            out.push_str(&user.to_string());
+            out.push('\n');
+            out.push_str(&assistant.to_string());
+            out.push('\n');
+        }
+        fs::write(dir.join(format!("session-{:02}.jsonl", session)), out).unwrap();
+    }
+}
+
+fn bench(name: &str, bytes: u64, mut f: impl FnMut() -> usize) -> Duration {
+    let mut times: Vec<Duration> = (0..RUNS)
+        .map(|_| {
+            let start = Instant::now();
+            black_box(f());
+            start.elapsed()
+        })
+        .collect();
+    times.sort();
+    let median = times[RUNS / 2];
+    println!(
+        "{:<40} {:>10.2} ms  {:>8.0} MB/s",
+        name,
+        median.as_secs_f64() * 1e3,
+        bytes as f64 / median.as_secs_f64() / 1e6
+    );
+    median
+}
+
+fn main() {
+    let synthetic =
+        std::env::temp_dir().join(format!("claude-status-bench-{}", std::process::id()));
+    let root = match std::env::var_os("CLAUDE_STATUS_BENCH_CORPUS") {
+        Some(dir) => PathBuf::from(dir),
+        None => {
+            write_synthetic(&synthetic);
+            synthetic.clone()
+        }
+    };
+    let mut files = Vec::new();
+    find_jsonl(&root, &mut files);
+    let bytes: u64 = files
+        .iter()
+        .filter_map(|f| fs::metadata(f).ok())
+        .map(|m| m.len())
+        .sum();
+    println!("{} transcripts, {:.1} MB", files.len(), bytes as f64 / 1e6);
+
+    let read_all = |backend: JsonBackend| {
+        files
+            .iter()
+            .map(|path| {
+                let mut tracker = TranscriptTracker::new();
+                tracker.set_json_backend(backend);
+                tracker.read_context_from(path).ok()
+            })
+            .collect::<Vec<_>>()
+    };
+    for (path, (serde, tape)) in files.iter().zip(
+        read_all(JsonBackend::Serde)
+            .into_iter()
+            .zip(read_all(JsonBackend::Tape)),
+    ) {
+        assert_eq!(serde, tape, "backends disagree on {}", path.display());
+    }
+
+    let serde = bench("read_context_from (serde)", bytes, || {
+        read_all(JsonBackend::Serde).len()
+    });
+    let tape = bench("read_context_from (tape)", bytes, || {
+        read_all(JsonBackend::Tape).len()
+    });
+    println!(
+        "tape speedup: {:.2}x",
+        serde.as_secs_f64() / tape.as_secs_f64()
+    );
+
+    let _ = fs::remove_dir_all(&synthetic);
+}
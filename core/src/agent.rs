@@ -0,0 +1,283 @@
+//! Headless agent that streams transcript state over stdio
+//!
+//! Sessions on a remote machine write their transcripts there, out of reach
+//! of the local plugin. `claude-status-cli agent` runs next to them, tails
+//! the transcripts incrementally and writes compact updates to stdout, so
+//! any pipe (ssh, a container exec) can carry them to the local core.
+//!
+//! The protocol is one JSON object per line. The agent sends:
+//!
+//! - `{"t":"hello","v":1,"host":"devbox"}` once at start
+//! - `{"t":"ctx",...}` whenever the latest session's context changes
+//! - `{"t":"rows","project":"p","rows":[...]}` with new ledger rows
+//!
+//! Each line the agent reads on stdin asks for an immediate scan; the
+//! agent also scans on its own at a fixed interval. It exits when stdin
+//! closes, so it goes away with the connection that started it.
+
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+use std::fs;
+use std::io::{self, BufRead, BufReader, Read, Write};
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{self, RecvTimeoutError};
+use std::thread;
+use std::time::Duration;
+
+use crate::forecast::ContextForecast;
+use crate::ledger::{self, LedgerRow};
+use crate::timeline::TimelinePoint;
+use crate::tools::ToolShare;
+use crate::transcript::{ContextInfo, SidechainUsage, TailReader, TranscriptTracker};
+
+/// Protocol version sent in the hello message
+pub const PROTOCOL_VERSION: u32 = 1;
+
+/// Rows per `rows` message
+const ROWS_PER_MESSAGE: usize = 1024;
+
+/// Ledger row on the wire: key, ts, session, model, input, output,
+/// cache creation, cache read
+pub type WireRow = (Option<u64>, i64, String, Option<String>, u32, u32, u32, u32);
+
+/// Context of the most recently active remote session
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct WireContext {
+    /// Transcript modification time as Unix timestamp
+    pub active_at: i64,
+    pub pct: f64,
+    pub tokens: i64,
+    pub window: i64,
+    pub model: Option<String>,
+    pub turns: Option<i64>,
+    pub secs: Option<i64>,
+    pub side_msgs: i64,
+    pub side_in: i64,
+    pub side_out: i64,
+    /// Timeline points as (tokens, compacted)
+    pub timeline: Vec<(i64, bool)>,
+    /// Top tools as (name, calls, bytes); absent from older agents
+    #[serde(default)]
+    pub tools: Vec<(String, i64, i64)>,
+}
+
+impl WireContext {
+    fn from_info(info: &ContextInfo, active_at: i64) -> Self {
+        WireContext {
+            active_at,
+            pct: info.context_pct,
+            tokens: info.context_tokens,
+            window: info.context_window_size,
+            model: info.model_name.clone(),
+            turns: info.forecast.map(|f| f.turns),
+            secs: info.forecast.and_then(|f| f.secs),
+            side_msgs: info.sidechain.messages,
+            side_in: info.sidechain.input_tokens,
+            side_out: info.sidechain.output_tokens,
+            timeline: info.timeline.iter().map(|p| (p.tokens, p.compacted)).collect(),
+            tools: info.tools.iter().map(|t| (t.name.clone(), t.calls, t.bytes)).collect(),
+        }
+    }
+
+    pub fn into_info(self, host: Option<String>) -> ContextInfo {
+        ContextInfo {
+            context_pct: self.pct,
+            context_tokens: self.tokens,
+            context_window_size: self.window,
+            model_name: self.model,
+            forecast: self.turns.map(|turns| ContextForecast {
+                turns,
+                secs: self.secs,
+            }),
+            timeline: self
+                .timeline
+                .into_iter()
+                .map(|(tokens, compacted)| TimelinePoint { tokens, compacted })
+                .collect(),
+            sidechain: SidechainUsage {
+                messages: self.side_msgs,
+                input_tokens: self.side_in,
+                output_tokens: self.side_out,
+            },
+            tools: self
+                .tools
+                .into_iter()
+                .map(|(name, calls, bytes)| ToolShare { name, calls, bytes })
+                .collect(),
+            host,
+        }
+    }
+}
+
+pub fn row_to_wire(row: &LedgerRow) -> WireRow {
+    (
+        row.key,
+        row.ts,
+        row.session.clone(),
+        row.model.clone(),
+        row.input_tokens,
+        row.output_tokens,
+        row.cache_creation_tokens,
+        row.cache_read_tokens,
+    )
+}
+
+pub fn row_from_wire(row: WireRow) -> LedgerRow {
+    let (key, ts, session, model, input, output, cache_creation, cache_read) = row;
+    LedgerRow {
+        key,
+        ts,
+        session,
+        model,
+        input_tokens: input,
+        output_tokens: output,
+        cache_creation_tokens: cache_creation,
+        cache_read_tokens: cache_read,
+    }
+}
+
+/// One protocol message from the agent
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(tag = "t", rename_all = "snake_case")]
+pub enum AgentMsg {
+    Hello { v: u32, host: String },
+    Ctx(WireContext),
+    Rows { project: String, rows: Vec<WireRow> },
+}
+
+fn hostname() -> String {
+    let mut buf = [0u8; 256];
+    let ok = unsafe { libc::gethostname(buf.as_mut_ptr() as *mut libc::c_char, buf.len()) } == 0;
+    let len = buf.iter().position(|&b| b == 0).unwrap_or(buf.len());
+    if ok && len > 0 {
+        String::from_utf8_lossy(&buf[..len]).into_owned()
+    } else {
+        "remote".to_string()
+    }
+}
+
+/// Incremental state behind the agent's updates
+struct AgentState {
+    root: PathBuf,
+    transcripts: TranscriptTracker,
+    live: HashMap<PathBuf, TailReader>,
+    last_sent: Option<WireContext>,
+}
+
+impl AgentState {
+    fn new(root: PathBuf) -> Self {
+        AgentState {
+            transcripts: TranscriptTracker::with_root(root.clone()),
+            root,
+            live: HashMap::new(),
+            last_sent: None,
+        }
+    }
+
+    /// Write whatever changed since the previous scan
+    fn scan(&mut self, out: &mut impl Write) -> io::Result<()> {
+        if let Ok(info) = self.transcripts.read_context() {
+            let ctx = WireContext::from_info(&info, self.transcripts.last_active().unwrap_or(0));
+            if self.last_sent.as_ref() != Some(&ctx) {
+                send(out, &AgentMsg::Ctx(ctx.clone()))?;
+                self.last_sent = Some(ctx);
+            }
+        }
+
+        let projects = match fs::read_dir(&self.root) {
+            Ok(dir) => dir,
+            Err(_) => return Ok(()),
+        };
+        for project in projects.flatten() {
+            let project_path = project.path();
+            let files = match fs::read_dir(&project_path) {
+                Ok(dir) if project_path.is_dir() => dir,
+                _ => continue,
+            };
+            let project_name = project.file_name().to_string_lossy().into_owned();
+            for file in files.flatten() {
+                let path = file.path();
+                if path.extension().map_or(false, |ext| ext == "jsonl") {
+                    self.scan_file(&path, &project_name, out)?;
+                }
+            }
+        }
+        Ok(())
+    }
+
+    fn scan_file(&mut self, path: &Path, project: &str, out: &mut impl Write) -> io::Result<()> {
+        let session = path
+            .file_stem()
+            .map(|s| s.to_string_lossy().into_owned())
+            .unwrap_or_default();
+        let tail = self.live.entry(path.to_path_buf()).or_default();
+
+        let mut rows = Vec::new();
+        let mut on_line = |line: &[u8]| {
+            if let Some(row) = ledger::parse_row(line, &session) {
+                rows.push(row_to_wire(&row));
+            }
+        };
+        // A shrunk file is read again from the start; the ledger drops repeats
+        let read = match tail.read_appended(path, &mut on_line) {
+            Ok(false) => tail.read_appended(path, &mut on_line),
+            other => other,
+        };
+        if read.is_err() {
+            self.live.remove(path);
+            return Ok(());
+        }
+
+        for chunk in rows.chunks(ROWS_PER_MESSAGE) {
+            send(
+                out,
+                &AgentMsg::Rows {
+                    project: project.to_string(),
+                    rows: chunk.to_vec(),
+                },
+            )?;
+        }
+        Ok(())
+    }
+}
+
+fn send(out: &mut impl Write, msg: &AgentMsg) -> io::Result<()> {
+    serde_json::to_writer(&mut *out, msg)?;
+    out.write_all(b"\n")
+}
+
+/// Run the agent until `input` reaches end of file or `output` breaks
+pub fn run_agent(
+    root: &Path,
+    input: impl Read + Send + 'static,
+    mut output: impl Write,
+    interval: Duration,
+) -> io::Result<()> {
+    let (tx, rx) = mpsc::channel();
+    thread::spawn(move || {
+        for line in BufReader::new(input).lines() {
+            if line.is_err() || tx.send(()).is_err() {
+                break;
+            }
+        }
+    });
+
+    send(
+        &mut output,
+        &AgentMsg::Hello {
+            v: PROTOCOL_VERSION,
+            host: hostname(),
+        },
+    )?;
+
+    let mut state = AgentState::new(root.to_path_buf());
+    loop {
+        state.scan(&mut output)?;
+        output.flush()?;
+
+        match rx.recv_timeout(interval) {
+            Ok(()) | Err(RecvTimeoutError::Timeout) => {}
+            Err(RecvTimeoutError::Disconnected) => return Ok(()),
+        }
+    }
+}
@@ -0,0 +1,310 @@
+//! Transcript anonymizer for shareable fixtures
+//!
+//! Rewrites a transcript tree so that it can be checked in as a benchmark
+//! or test fixture. Lines are rewritten byte for byte: every string value
+//! is overwritten in place with filler of the same byte length, so line
+//! lengths, file sizes and the JSON nesting shape stay exactly as they were.
+//! Object keys, numbers, booleans and the handful of string fields that
+//! drive parsing (entry types, timestamps, models, message ids) are kept,
+//! but only where the parsers read them: the same key inside a tool's
+//! input or result is filled like any other value.
+
+use std::fs::{self, File};
+use std::io::{self, BufRead, BufReader, BufWriter, Read, Write};
+use std::path::Path;
+use thiserror::Error;
+
+#[derive(Debug, Error)]
+pub enum AnonymizeError {
+    #[error("Failed to anonymize transcripts: {0}")]
+    IoError(#[from] io::Error),
+}
+
+/// Where in an entry a container sits; only a few places keep values
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Place {
+    /// The entry object itself
+    Entry,
+    /// `message`
+    Message,
+    /// `message.content`
+    Content,
+    /// An object in `message.content`
+    Block,
+    Other,
+}
+
+impl Place {
+    /// Place of a container opened inside this one, at `key` in objects
+    fn child(self, key: Option<&[u8]>) -> Place {
+        match (self, key) {
+            (Place::Entry, Some(b"message")) => Place::Message,
+            (Place::Message, Some(b"content")) => Place::Content,
+            (Place::Content, None) => Place::Block,
+            _ => Place::Other,
+        }
+    }
+
+    /// String fields whose values are kept verbatim here
+    fn kept(self) -> &'static [&'static str] {
+        match self {
+            Place::Entry => &["type", "subtype", "timestamp", "uuid", "sessionId", "requestId", "version"],
+            Place::Message => &["id", "model"],
+            Place::Block => &["type", "id", "name", "tool_use_id"],
+            Place::Content | Place::Other => &[],
+        }
+    }
+}
+
+/// Kept values longer than this are filled anyway
+const MAX_KEPT_VALUE: usize = 128;
+
+/// Longest key kept verbatim; longer ones are most likely data
+const MAX_KEPT_KEY: usize = 64;
+
+/// Filler for one byte of string content
+fn filler(b: u8) -> u8 {
+    if b == b' ' {
+        b' '
+    } else {
+        b'x'
+    }
+}
+
+fn is_plain_key(key: &[u8]) -> bool {
+    key.len() <= MAX_KEPT_KEY
+        && key
+            .iter()
+            .all(|&b| b.is_ascii_alphanumeric() || b == b'_' || b == b'-')
+}
+
+/// End of the string starting at `start` (just past the opening quote);
+/// returns the index of the closing quote, or `line.len()` if truncated
+fn string_end(line: &[u8], start: usize) -> usize {
+    let mut i = start;
+    while i < line.len() {
+        match line[i] {
+            b'\\' => i += 2,
+            b'"' => return i,
+            _ => i += 1,
+        }
+    }
+    line.len()
+}
+
+/// Anonymize one transcript line, keeping its exact byte length
+///
+/// Works on raw bytes rather than parsed JSON, so truncated lines,
+/// invalid UTF-8 and other damage survive with the same shape.
+pub fn anonymize_line(line: &[u8]) -> Vec<u8> {
+    let mut out = line.to_vec();
+    // Key of the value about to be scanned, if it was a plain one
+    let mut last_key: Option<(usize, usize)> = None;
+    // Opening bracket and place of each open container
+    let mut open: Vec<(u8, Place)> = Vec::new();
+    // Set at a mismatched bracket; from there on every value is filled
+    let mut damaged = false;
+    let mut i = 0;
+
+    while i < line.len() {
+        let b = line[i];
+        if b != b'"' {
+            match b {
+                b'{' | b'[' => {
+                    let place = match open.last() {
+                        None => Place::Entry,
+                        Some((_, parent)) => parent.child(last_key.map(|(s, e)| &line[s..e])),
+                    };
+                    open.push((b, place));
+                    last_key = None;
+                }
+                b'}' | b']' => {
+                    let opener = if b == b'}' { b'{' } else { b'[' };
+                    damaged |= open.pop().map(|(o, _)| o) != Some(opener);
+                }
+                b',' => last_key = None,
+                _ if b >= 0x80 => out[i] = b'x',
+                _ => {}
+            }
+            i += 1;
+            continue;
+        }
+
+        let start = i + 1;
+        let end = string_end(line, start);
+        let content = &line[start..end.min(line.len())];
+
+        let mut j = end + 1;
+        while j < line.len() && line[j].is_ascii_whitespace() {
+            j += 1;
+        }
+        let is_key = j < line.len() && line[j] == b':';
+
+        let keep = if is_key {
+            is_plain_key(content)
+        } else {
+            let kept = match open.last() {
+                Some((_, place)) if !damaged => place.kept(),
+                _ => &[],
+            };
+            content.len() <= MAX_KEPT_VALUE
+                && last_key.map_or(false, |(s, e)| kept.iter().any(|k| k.as_bytes() == &line[s..e]))
+        };
+
+        if !keep {
+            for k in start..end.min(line.len()) {
+                out[k] = filler(line[k]);
+            }
+        }
+
+        last_key = if is_key && keep { Some((start, end)) } else { None };
+        i = end + 1;
+    }
+
+    out
+}
+
+/// Copy lines from `input` to `output`, anonymizing each
+///
+/// A final line without a newline is kept unterminated.
+pub fn anonymize_stream(input: impl Read, mut output: impl Write) -> io::Result<u64> {
+    let mut reader = BufReader::new(input);
+    let mut buf = Vec::new();
+    let mut lines = 0;
+    loop {
+        buf.clear();
+        if reader.read_until(b'\n', &mut buf)? == 0 {
+            break;
+        }
+        let terminated = buf.last() == Some(&b'\n');
+        let body = if terminated { &buf[..buf.len() - 1] } else { &buf[..] };
+        output.write_all(&anonymize_line(body))?;
+        if terminated {
+            output.write_all(b"\n")?;
+        }
+        lines += 1;
+    }
+    output.flush()?;
+    Ok(lines)
+}
+
+/// Anonymized name for a project directory, which encodes a local path
+fn project_name(index: usize) -> String {
+    format!("-project-{:04}", index)
+}
+
+fn anonymize_file(src: &Path, dst: &Path) -> io::Result<u64> {
+    let name = src.file_name().and_then(|n| n.to_str()).unwrap_or_default();
+    let input = File::open(src)?;
+    let output = BufWriter::new(File::create(dst)?);
+
+    let lines = if name.ends_with(".jsonl.gz") {
+        let mut encoder = flate2::write::GzEncoder::new(output, flate2::Compression::default());
+        let lines = anonymize_stream(flate2::read::MultiGzDecoder::new(input), &mut encoder)?;
+        encoder.finish()?;
+        lines
+    } else if name.ends_with(".jsonl.zst") {
+        let mut encoder = zstd::stream::Encoder::new(output, 0)?;
+        let lines = anonymize_stream(zstd::stream::Decoder::new(input)?, &mut encoder)?;
+        encoder.finish()?;
+        lines
+    } else {
+        anonymize_stream(input, output)?
+    };
+
+    // Keep modification times so "latest transcript" picks the same file
+    if let Ok(modified) = fs::metadata(src).and_then(|m| m.modified()) {
+        File::options().write(true).open(dst)?.set_modified(modified)?;
+    }
+    Ok(lines)
+}
+
+fn is_transcript(path: &Path) -> bool {
+    let name = path.file_name().and_then(|n| n.to_str()).unwrap_or_default();
+    name.ends_with(".jsonl") || name.ends_with(".jsonl.gz") || name.ends_with(".jsonl.zst")
+}
+
+/// Summary of an anonymized tree
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+pub struct AnonymizeStats {
+    pub files: u64,
+    pub lines: u64,
+}
+
+/// Rewrite a projects tree (`<root>/<project>/<session>.jsonl`) into `dst`
+///
+/// Project directories are renamed, since their names encode local paths;
+/// session file names are random ids and are kept.
+pub fn anonymize_tree(src: &Path, dst: &Path) -> Result<AnonymizeStats, AnonymizeError> {
+    let mut stats = AnonymizeStats::default();
+    let mut projects: Vec<_> = fs::read_dir(src)?
+        .filter_map(|e| e.ok())
+        .map(|e| e.path())
+        .filter(|p| p.is_dir())
+        .collect();
+    projects.sort();
+
+    for (index, project) in projects.iter().enumerate() {
+        let out_dir = dst.join(project_name(index));
+        fs::create_dir_all(&out_dir)?;
+
+        let mut files: Vec<_> = fs::read_dir(project)?
+            .filter_map(|e| e.ok())
+            .map(|e| e.path())
+            .filter(|p| p.is_file() && is_transcript(p))
+            .collect();
+        files.sort();
+
+        for file in files {
+            let name = file.file_name().unwrap_or_default();
+            stats.lines += anonymize_file(&file, &out_dir.join(name))?;
+            stats.files += 1;
+        }
+    }
+
+    Ok(stats)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_content_replaced_shape_kept() {
+        let line = r#"{"type":"assistant","cwd":"/home/alice/secret","timestamp":"2026-01-01T00:00:00Z","message":{"id":"msg_1","model":"claude-test","content":[{"type":"text","text":"café \"quoted\""}],"usage":{"input_tokens":42}}}"#.as_bytes();
+        let out = anonymize_line(line);
+
+        assert_eq!(out.len(), line.len());
+        let text = String::from_utf8(out).unwrap();
+        assert!(!text.contains("alice"));
+        assert!(!text.contains("quoted"));
+        assert!(text.contains(r#""model":"claude-test""#));
+        assert!(text.contains(r#""timestamp":"2026-01-01T00:00:00Z""#));
+        assert!(text.contains(r#""input_tokens":42"#));
+
+        let value: serde_json::Value = serde_json::from_str(&text).unwrap();
+        assert_eq!(value["message"]["content"][0]["type"], "text");
+        assert_eq!(value["type"], "assistant");
+    }
+
+    #[test]
+    fn test_kept_names_filled_inside_tool_data() {
+        let line = r#"{"type":"user","uuid":"u-1","message":{"id":"msg_2","role":"user","content":[{"type":"tool_use","id":"toolu_1","name":"Bash","input":{"name":"acme-secret-merger","type":"Alice Johnson","id":"ssn-123-45-6789"}},{"type":"tool_result","tool_use_id":"toolu_1","content":[{"type":"text","text":"ok"}]}]},"toolUseResult":{"type":"Alice Johnson","id":"ssn-123-45-6789","version":"acme-confidential-v2","model":"acme-model"}}"#.as_bytes();
+        let out = anonymize_line(line);
+
+        assert_eq!(out.len(), line.len());
+        let text = String::from_utf8(out).unwrap();
+        for secret in ["acme", "Alice", "ssn-"] {
+            assert!(!text.contains(secret), "{} kept in {}", secret, text);
+        }
+
+        let value: serde_json::Value = serde_json::from_str(&text).unwrap();
+        assert_eq!(value["uuid"], "u-1");
+        assert_eq!(value["message"]["id"], "msg_2");
+        let blocks = &value["message"]["content"];
+        assert_eq!(blocks[0]["type"], "tool_use");
+        assert_eq!(blocks[0]["id"], "toolu_1");
+        assert_eq!(blocks[0]["name"], "Bash");
+        assert_eq!(blocks[1]["tool_use_id"], "toolu_1");
+    }
+}
@@ -2,8 +2,13 @@
 
 use chrono::{DateTime, Utc};
 use serde::Deserialize;
+use std::collections::hash_map::DefaultHasher;
+use std::hash::Hasher;
+use std::sync::Arc;
 use thiserror::Error;
 
+use crate::net::{ConnectStats, Family, HappyEyeballs};
+
 #[derive(Debug, Error)]
 pub enum ApiError {
     #[error("Authentication failed (401)")]
@@ -26,6 +31,15 @@ pub struct UsagePeriod {
     pub resets_at: DateTime<Utc>,
 }
 
+/// Result of a usage fetch
+#[derive(Debug, Clone)]
+pub enum FetchOutcome {
+    /// The response differs from the previous one
+    Changed(UsageData),
+    /// Same body as last time (or 304 Not Modified)
+    Unchanged,
+}
+
 #[derive(Debug, Deserialize)]
 struct ApiResponse {
     five_hour: ApiPeriod,
@@ -41,43 +55,164 @@ struct ApiPeriod {
 const USAGE_API_URL: &str = "https://api.anthropic.com/api/oauth/usage";
 const USER_AGENT: &str = "xfce-claude-status/0.1";
 
-/// Fetch usage data from the Anthropic API
-pub fn fetch_usage(access_token: &str) -> Result<UsageData, ApiError> {
-    let response = ureq::get(USAGE_API_URL)
-        .set("Authorization", &format!("Bearer {}", access_token))
-        .set("anthropic-beta", "oauth-2025-04-20")
-        .set("User-Agent", USER_AGENT)
-        .call();
-
-    match response {
-        Ok(resp) => {
-            let body = resp
-                .into_string()
-                .map_err(|e| ApiError::ParseError(e.to_string()))?;
-
-            let api_resp: ApiResponse =
-                serde_json::from_str(&body).map_err(|e| ApiError::ParseError(e.to_string()))?;
-
-            let five_hour_reset = DateTime::parse_from_rfc3339(&api_resp.five_hour.resets_at)
-                .map_err(|e| ApiError::ParseError(e.to_string()))?
-                .with_timezone(&Utc);
-
-            let seven_day_reset = DateTime::parse_from_rfc3339(&api_resp.seven_day.resets_at)
-                .map_err(|e| ApiError::ParseError(e.to_string()))?
-                .with_timezone(&Utc);
-
-            Ok(UsageData {
-                five_hour: UsagePeriod {
-                    utilization: api_resp.five_hour.utilization,
-                    resets_at: five_hour_reset,
-                },
-                seven_day: UsagePeriod {
-                    utilization: api_resp.seven_day.utilization,
-                    resets_at: seven_day_reset,
-                },
-            })
+/// Parse a usage response body
+fn parse_usage(body: &str) -> Result<UsageData, ApiError> {
+    let api_resp: ApiResponse =
+        serde_json::from_str(body).map_err(|e| ApiError::ParseError(e.to_string()))?;
+
+    let five_hour_reset = DateTime::parse_from_rfc3339(&api_resp.five_hour.resets_at)
+        .map_err(|e| ApiError::ParseError(e.to_string()))?
+        .with_timezone(&Utc);
+
+    let seven_day_reset = DateTime::parse_from_rfc3339(&api_resp.seven_day.resets_at)
+        .map_err(|e| ApiError::ParseError(e.to_string()))?
+        .with_timezone(&Utc);
+
+    Ok(UsageData {
+        five_hour: UsagePeriod {
+            utilization: api_resp.five_hour.utilization,
+            resets_at: five_hour_reset,
+        },
+        seven_day: UsagePeriod {
+            utilization: api_resp.seven_day.utilization,
+            resets_at: seven_day_reset,
+        },
+    })
+}
+
+fn fingerprint(body: &str) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    hasher.write(body.as_bytes());
+    hasher.finish()
+}
+
+/// Usage fetcher that recognizes repeated responses
+///
+/// Sends the server's validators back when it provided any, and otherwise
+/// compares a hash of the body with the previous one, so an unchanged
+/// response is neither parsed nor republished. Requests go through one
+/// agent, so connections are reused and new ones are raced across
+/// address families.
+pub struct UsageFetcher {
+    agent: ureq::Agent,
+    eyeballs: Arc<HappyEyeballs>,
+    fingerprint: Option<u64>,
+    etag: Option<String>,
+    last_modified: Option<String>,
+}
+
+impl Default for UsageFetcher {
+    fn default() -> Self {
+        UsageFetcher::new()
+    }
+}
+
+impl UsageFetcher {
+    pub fn new() -> Self {
+        let eyeballs = Arc::new(HappyEyeballs::default());
+        let resolver = Arc::clone(&eyeballs);
+        let agent = ureq::AgentBuilder::new()
+            .resolver(move |netloc: &str| resolver.resolve(netloc))
+            .build();
+        UsageFetcher {
+            agent,
+            eyeballs,
+            fingerprint: None,
+            etag: None,
+            last_modified: None,
         }
-        Err(ureq::Error::Status(401, _)) => Err(ApiError::AuthError),
-        Err(e) => Err(ApiError::NetworkError(e.to_string())),
+    }
+
+    /// Connection attempts made for new connections, per address family
+    pub fn connect_stats(&self, family: Family) -> ConnectStats {
+        self.eyeballs.stats(family)
+    }
+
+    /// Fetch usage data from the Anthropic API
+    pub fn fetch(&mut self, access_token: &str) -> Result<FetchOutcome, ApiError> {
+        let mut request = self
+            .agent
+            .get(USAGE_API_URL)
+            .set("Authorization", &format!("Bearer {}", access_token))
+            .set("anthropic-beta", "oauth-2025-04-20")
+            .set("User-Agent", USER_AGENT);
+        if let Some(etag) = &self.etag {
+            request = request.set("If-None-Match", etag);
+        }
+        if let Some(last_modified) = &self.last_modified {
+            request = request.set("If-Modified-Since", last_modified);
+        }
+
+        match request.call() {
+            Ok(resp) if resp.status() == 304 => Ok(FetchOutcome::Unchanged),
+            Ok(resp) => {
+                let etag = resp.header("ETag").map(|s| s.to_string());
+                let last_modified = resp.header("Last-Modified").map(|s| s.to_string());
+                let body = resp
+                    .into_string()
+                    .map_err(|e| ApiError::ParseError(e.to_string()))?;
+                self.accept(&body, etag, last_modified)
+            }
+            Err(ureq::Error::Status(401, _)) => Err(ApiError::AuthError),
+            Err(e) => {
+                // ureq's own connect to the raced address may be what failed
+                if let ureq::Error::Transport(_) = e {
+                    self.eyeballs.forget_winners();
+                }
+                Err(ApiError::NetworkError(e.to_string()))
+            }
+        }
+    }
+
+    /// Compare a full response body with the previous one, parsing it and
+    /// keeping its validators only if it changed
+    fn accept(
+        &mut self,
+        body: &str,
+        etag: Option<String>,
+        last_modified: Option<String>,
+    ) -> Result<FetchOutcome, ApiError> {
+        let sum = fingerprint(body);
+        if self.fingerprint == Some(sum) {
+            return Ok(FetchOutcome::Unchanged);
+        }
+
+        let usage = parse_usage(body)?;
+        self.fingerprint = Some(sum);
+        self.etag = etag;
+        self.last_modified = last_modified;
+        Ok(FetchOutcome::Changed(usage))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_usage() {
+        let body = r#"{"five_hour":{"utilization":12.5,"resets_at":"2026-01-01T05:00:00Z"},"seven_day":{"utilization":40.0,"resets_at":"2026-01-07T00:00:00+00:00"}}"#;
+        let usage = parse_usage(body).unwrap();
+        assert_eq!(usage.five_hour.utilization, 12.5);
+        assert_eq!(usage.seven_day.resets_at.timestamp(), 1767744000);
+    }
+
+    #[test]
+    fn test_repeated_body_unchanged() {
+        let body = r#"{"five_hour":{"utilization":12.5,"resets_at":"2026-01-01T05:00:00Z"},"seven_day":{"utilization":40.0,"resets_at":"2026-01-07T00:00:00Z"}}"#;
+        let moved = body.replace("12.5", "13.0");
+        let mut fetcher = UsageFetcher::new();
+
+        assert!(matches!(fetcher.accept(body, None, None), Ok(FetchOutcome::Changed(_))));
+        assert!(matches!(fetcher.accept(body, None, None), Ok(FetchOutcome::Unchanged)));
+        match fetcher.accept(&moved, Some("\"v2\"".into()), None) {
+            Ok(FetchOutcome::Changed(usage)) => assert_eq!(usage.five_hour.utilization, 13.0),
+            other => panic!("unexpected {:?}", other),
+        }
+        assert_eq!(fetcher.etag.as_deref(), Some("\"v2\""));
+
+        // A body that fails to parse is not remembered as the last one
+        assert!(fetcher.accept("{}", None, None).is_err());
+        assert!(fetcher.accept("{}", None, None).is_err());
     }
 }
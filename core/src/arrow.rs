@@ -0,0 +1,541 @@
+//! Arrow IPC export of the usage history and token ledger
+//!
+//! Writes the Arrow IPC file (Feather v2) and stream formats without an
+//! Arrow dependency. Column buffers go from the in-memory columns straight
+//! to the writer; only the small metadata flatbuffers and the name
+//! dictionaries are built on the side.
+//!
+//! The ledger is exported as `ts` (timestamp[s, UTC]), dictionary-encoded
+//! `project`, `session` and `model`, and uint32 token columns. The history
+//! has `ts`, `five_hour_pct` and `seven_day_pct`.
+
+use std::io::{self, Write};
+
+use crate::history::UsageHistory;
+use crate::ledger::{Ledger, NameColumn};
+
+const FILE_MAGIC: &[u8; 6] = b"ARROW1";
+
+/// Continuation marker in front of every message
+const CONTINUATION: u32 = 0xFFFF_FFFF;
+
+/// MetadataVersion.V5
+const METADATA_V5: i16 = 4;
+
+/// Rows per record batch of the ledger
+const LEDGER_BATCH_ROWS: usize = 1 << 20;
+
+/// IPC container to write
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ArrowFormat {
+    /// Random-access file, also readable as Feather v2
+    File,
+    /// Stream format, e.g. for a pipe
+    Stream,
+}
+
+/// Minimal FlatBuffers encoder, enough for Arrow metadata
+mod fb {
+    #[derive(Debug, Clone)]
+    pub enum Value {
+        Bool(bool),
+        U8(u8),
+        I16(i16),
+        I32(i32),
+        I64(i64),
+        Str(String),
+        Table(Table),
+        Tables(Vec<Table>),
+        /// Vector of structs, already laid out, 8-byte aligned
+        Structs(Vec<u8>, usize),
+    }
+
+    impl Value {
+        /// Inline size in a table; references take a 4-byte offset
+        fn inline_size(&self) -> usize {
+            match self {
+                Value::Bool(_) | Value::U8(_) => 1,
+                Value::I16(_) => 2,
+                Value::I64(_) => 8,
+                _ => 4,
+            }
+        }
+    }
+
+    #[derive(Debug, Clone, Default)]
+    pub struct Table {
+        fields: Vec<(u16, Value)>,
+    }
+
+    impl Table {
+        pub fn new() -> Self {
+            Table::default()
+        }
+
+        pub fn with(mut self, id: u16, value: Value) -> Self {
+            self.fields.push((id, value));
+            self
+        }
+    }
+
+    fn align(buf: &mut Vec<u8>, to: usize) {
+        while buf.len() % to != 0 {
+            buf.push(0);
+        }
+    }
+
+    fn patch_u32(buf: &mut [u8], at: usize, value: u32) {
+        buf[at..at + 4].copy_from_slice(&value.to_le_bytes());
+    }
+
+    /// Serialize `root`; the result is padded to a multiple of 8 bytes
+    pub fn finish(root: &Table) -> Vec<u8> {
+        let mut buf = vec![0u8; 4];
+        let pos = write_table(&mut buf, root);
+        patch_u32(&mut buf, 0, pos as u32);
+        align(&mut buf, 8);
+        buf
+    }
+
+    /// Objects are laid out after whatever refers to them, so every
+    /// offset points forward as the format requires
+    fn write_table(buf: &mut Vec<u8>, table: &Table) -> usize {
+        let slots = table.fields.iter().map(|(id, _)| *id as usize + 1).max().unwrap_or(0);
+        align(buf, 2);
+        let vtable_pos = buf.len();
+        buf.resize(vtable_pos + 4 + 2 * slots, 0);
+
+        align(buf, 8);
+        let table_pos = buf.len();
+        buf.extend_from_slice(&((table_pos - vtable_pos) as i32).to_le_bytes());
+
+        let mut order: Vec<&(u16, Value)> = table.fields.iter().collect();
+        order.sort_by_key(|(_, v)| std::cmp::Reverse(v.inline_size()));
+        let mut pending = Vec::new();
+        for (id, value) in order {
+            align(buf, value.inline_size());
+            let at = buf.len();
+            let slot = vtable_pos + 4 + 2 * *id as usize;
+            buf[slot..slot + 2].copy_from_slice(&((at - table_pos) as u16).to_le_bytes());
+            match value {
+                Value::Bool(b) => buf.push(*b as u8),
+                Value::U8(n) => buf.push(*n),
+                Value::I16(n) => buf.extend_from_slice(&n.to_le_bytes()),
+                Value::I32(n) => buf.extend_from_slice(&n.to_le_bytes()),
+                Value::I64(n) => buf.extend_from_slice(&n.to_le_bytes()),
+                _ => {
+                    buf.extend_from_slice(&[0; 4]);
+                    pending.push((at, value));
+                }
+            }
+        }
+
+        let table_size = buf.len() - table_pos;
+        buf[vtable_pos..vtable_pos + 2].copy_from_slice(&((4 + 2 * slots) as u16).to_le_bytes());
+        buf[vtable_pos + 2..vtable_pos + 4].copy_from_slice(&(table_size as u16).to_le_bytes());
+
+        for (at, value) in pending {
+            let target = write_object(buf, value);
+            patch_u32(buf, at, (target - at) as u32);
+        }
+        table_pos
+    }
+
+    fn write_object(buf: &mut Vec<u8>, value: &Value) -> usize {
+        match value {
+            Value::Table(table) => write_table(buf, table),
+            Value::Str(s) => {
+                align(buf, 4);
+                let pos = buf.len();
+                buf.extend_from_slice(&(s.len() as u32).to_le_bytes());
+                buf.extend_from_slice(s.as_bytes());
+                buf.push(0);
+                pos
+            }
+            Value::Tables(tables) => {
+                align(buf, 4);
+                let pos = buf.len();
+                buf.extend_from_slice(&(tables.len() as u32).to_le_bytes());
+                buf.resize(pos + 4 + 4 * tables.len(), 0);
+                for (i, table) in tables.iter().enumerate() {
+                    let at = pos + 4 + 4 * i;
+                    let target = write_table(buf, table);
+                    patch_u32(buf, at, (target - at) as u32);
+                }
+                pos
+            }
+            Value::Structs(bytes, count) => {
+                // The elements, not the length, need the 8-byte alignment
+                while (buf.len() + 4) % 8 != 0 {
+                    buf.push(0);
+                }
+                let pos = buf.len();
+                buf.extend_from_slice(&(*count as u32).to_le_bytes());
+                buf.extend_from_slice(bytes);
+                pos
+            }
+            _ => unreachable!("scalars are stored inline"),
+        }
+    }
+}
+
+use fb::{Table, Value};
+
+/// Column types used by the exports
+#[derive(Debug, Clone, Copy)]
+enum ColumnType {
+    /// Seconds since the epoch, UTC
+    Timestamp,
+    UInt32,
+    Float64,
+    /// Int32 indices into the utf8 dictionary `id`
+    Dictionary(i64),
+}
+
+struct ColumnSpec {
+    name: &'static str,
+    ty: ColumnType,
+}
+
+/// Offset and length of a message within the output, for the file footer
+#[derive(Debug, Clone, Copy)]
+struct Block {
+    offset: u64,
+    metadata_len: u32,
+    body_len: u64,
+}
+
+fn int_type(bits: i32, signed: bool) -> Table {
+    Table::new()
+        .with(0, Value::I32(bits))
+        .with(1, Value::Bool(signed))
+}
+
+fn field_table(spec: &ColumnSpec) -> Table {
+    // Type union ids from Schema.fbs
+    let (type_id, ty) = match spec.ty {
+        ColumnType::Timestamp => (
+            10,
+            Table::new()
+                .with(0, Value::I16(0))
+                .with(1, Value::Str("UTC".into())),
+        ),
+        ColumnType::UInt32 => (2, int_type(32, false)),
+        ColumnType::Float64 => (3, Table::new().with(0, Value::I16(2))),
+        ColumnType::Dictionary(_) => (5, Table::new()),
+    };
+    let mut field = Table::new()
+        .with(0, Value::Str(spec.name.into()))
+        .with(1, Value::Bool(false))
+        .with(2, Value::U8(type_id))
+        .with(3, Value::Table(ty))
+        .with(5, Value::Tables(Vec::new()));
+    if let ColumnType::Dictionary(id) = spec.ty {
+        field = field.with(
+            4,
+            Value::Table(
+                Table::new()
+                    .with(0, Value::I64(id))
+                    .with(1, Value::Table(int_type(32, true))),
+            ),
+        );
+    }
+    field
+}
+
+fn schema_table(columns: &[ColumnSpec]) -> Table {
+    let endianness = if cfg!(target_endian = "little") { 0 } else { 1 };
+    Table::new()
+        .with(0, Value::I16(endianness))
+        .with(1, Value::Tables(columns.iter().map(field_table).collect()))
+}
+
+/// Bytes of a column as laid out in memory
+fn bytes_of<T: Copy>(values: &[T]) -> &[u8] {
+    // Only used with integer and float columns, which have no padding
+    unsafe { std::slice::from_raw_parts(values.as_ptr() as *const u8, std::mem::size_of_val(values)) }
+}
+
+fn padded(len: usize) -> usize {
+    (len + 7) & !7
+}
+
+/// Record batch metadata for `rows` rows of non-null columns whose
+/// buffers (validity omitted, then data) are `buffers`
+fn record_batch_table(rows: usize, columns: usize, buffers: &[&[u8]]) -> Table {
+    let mut nodes = Vec::with_capacity(columns * 16);
+    for _ in 0..columns {
+        nodes.extend_from_slice(&(rows as i64).to_le_bytes());
+        nodes.extend_from_slice(&0i64.to_le_bytes());
+    }
+    let mut descs = Vec::with_capacity(buffers.len() * 16);
+    let mut offset = 0;
+    for buffer in buffers {
+        descs.extend_from_slice(&(offset as i64).to_le_bytes());
+        descs.extend_from_slice(&(buffer.len() as i64).to_le_bytes());
+        offset += padded(buffer.len());
+    }
+    Table::new()
+        .with(0, Value::I64(rows as i64))
+        .with(1, Value::Structs(nodes, columns))
+        .with(2, Value::Structs(descs, buffers.len()))
+}
+
+struct IpcWriter<W: Write> {
+    out: W,
+    format: ArrowFormat,
+    pos: u64,
+    schema: Table,
+    dictionaries: Vec<Block>,
+    batches: Vec<Block>,
+}
+
+impl<W: Write> IpcWriter<W> {
+    fn begin(mut out: W, format: ArrowFormat, columns: &[ColumnSpec]) -> io::Result<Self> {
+        let mut pos = 0;
+        if format == ArrowFormat::File {
+            out.write_all(FILE_MAGIC)?;
+            out.write_all(&[0, 0])?;
+            pos = 8;
+        }
+        let mut writer = IpcWriter {
+            out,
+            format,
+            pos,
+            schema: schema_table(columns),
+            dictionaries: Vec::new(),
+            batches: Vec::new(),
+        };
+        let schema = writer.schema.clone();
+        writer.message(1, schema, &[])?;
+        Ok(writer)
+    }
+
+    /// Write one encapsulated message: marker, length, metadata, body
+    fn message(&mut self, header_type: u8, header: Table, body: &[&[u8]]) -> io::Result<Block> {
+        let body_len: usize = body.iter().map(|b| padded(b.len())).sum();
+        let meta = fb::finish(
+            &Table::new()
+                .with(0, Value::I16(METADATA_V5))
+                .with(1, Value::U8(header_type))
+                .with(2, Value::Table(header))
+                .with(3, Value::I64(body_len as i64)),
+        );
+
+        let block = Block {
+            offset: self.pos,
+            metadata_len: 8 + meta.len() as u32,
+            body_len: body_len as u64,
+        };
+        self.out.write_all(&CONTINUATION.to_le_bytes())?;
+        self.out.write_all(&(meta.len() as u32).to_le_bytes())?;
+        self.out.write_all(&meta)?;
+        for buffer in body {
+            self.out.write_all(buffer)?;
+            self.out.write_all(&[0; 8][..padded(buffer.len()) - buffer.len()])?;
+        }
+        self.pos += block.metadata_len as u64 + block.body_len;
+        Ok(block)
+    }
+
+    fn dictionary(&mut self, id: i64, names: &[String]) -> io::Result<()> {
+        let mut offsets = Vec::with_capacity(names.len() + 1);
+        let mut data = Vec::new();
+        offsets.push(0i32);
+        for name in names {
+            data.extend_from_slice(name.as_bytes());
+            offsets.push(data.len() as i32);
+        }
+        let buffers: [&[u8]; 3] = [&[], bytes_of(&offsets), &data];
+        let batch = Table::new()
+            .with(0, Value::I64(id))
+            .with(1, Value::Table(record_batch_table(names.len(), 1, &buffers)));
+        let block = self.message(2, batch, &buffers)?;
+        self.dictionaries.push(block);
+        Ok(())
+    }
+
+    /// Write a record batch; each column contributes an empty validity
+    /// buffer and its data buffer
+    fn batch(&mut self, rows: usize, columns: &[&[u8]]) -> io::Result<()> {
+        let mut buffers: Vec<&[u8]> = Vec::with_capacity(columns.len() * 2);
+        for column in columns {
+            buffers.push(&[]);
+            buffers.push(column);
+        }
+        let batch = record_batch_table(rows, columns.len(), &buffers);
+        let block = self.message(3, batch, &buffers)?;
+        self.batches.push(block);
+        Ok(())
+    }
+
+    fn finish(mut self) -> io::Result<W> {
+        // End-of-stream marker
+        self.out.write_all(&CONTINUATION.to_le_bytes())?;
+        self.out.write_all(&0u32.to_le_bytes())?;
+
+        if self.format == ArrowFormat::File {
+            let blocks = |blocks: &[Block]| {
+                let mut bytes = Vec::with_capacity(blocks.len() * 24);
+                for b in blocks {
+                    bytes.extend_from_slice(&(b.offset as i64).to_le_bytes());
+                    bytes.extend_from_slice(&(b.metadata_len as i32).to_le_bytes());
+                    bytes.extend_from_slice(&[0; 4]);
+                    bytes.extend_from_slice(&(b.body_len as i64).to_le_bytes());
+                }
+                Value::Structs(bytes, blocks.len())
+            };
+            let footer = fb::finish(
+                &Table::new()
+                    .with(0, Value::I16(METADATA_V5))
+                    .with(1, Value::Table(self.schema.clone()))
+                    .with(2, blocks(&self.dictionaries))
+                    .with(3, blocks(&self.batches)),
+            );
+            self.out.write_all(&footer)?;
+            self.out.write_all(&(footer.len() as u32).to_le_bytes())?;
+            self.out.write_all(FILE_MAGIC)?;
+        }
+        self.out.flush()?;
+        Ok(self.out)
+    }
+}
+
+/// Export every ledger row
+pub fn write_ledger<W: Write>(ledger: &Ledger, out: W, format: ArrowFormat) -> io::Result<W> {
+    let name_columns = [NameColumn::Project, NameColumn::Session, NameColumn::Model];
+    let specs = [
+        ColumnSpec { name: "ts", ty: ColumnType::Timestamp },
+        ColumnSpec { name: "project", ty: ColumnType::Dictionary(0) },
+        ColumnSpec { name: "session", ty: ColumnType::Dictionary(1) },
+        ColumnSpec { name: "model", ty: ColumnType::Dictionary(2) },
+        ColumnSpec { name: "input_tokens", ty: ColumnType::UInt32 },
+        ColumnSpec { name: "output_tokens", ty: ColumnType::UInt32 },
+        ColumnSpec { name: "cache_creation_tokens", ty: ColumnType::UInt32 },
+        ColumnSpec { name: "cache_read_tokens", ty: ColumnType::UInt32 },
+    ];
+
+    let mut writer = IpcWriter::begin(out, format, &specs)?;
+    for (id, column) in name_columns.iter().enumerate() {
+        writer.dictionary(id as i64, ledger.names(*column))?;
+    }
+
+    // Interned ids are small, so the u32 id columns are valid int32 indices
+    let cols = ledger.columns();
+    let mut start = 0;
+    while start < cols.ts.len() {
+        let end = (start + LEDGER_BATCH_ROWS).min(cols.ts.len());
+        writer.batch(
+            end - start,
+            &[
+                bytes_of(&cols.ts[start..end]),
+                bytes_of(&cols.project[start..end]),
+                bytes_of(&cols.session[start..end]),
+                bytes_of(&cols.model[start..end]),
+                bytes_of(&cols.input[start..end]),
+                bytes_of(&cols.output[start..end]),
+                bytes_of(&cols.cache_creation[start..end]),
+                bytes_of(&cols.cache_read[start..end]),
+            ],
+        )?;
+        start = end;
+    }
+    writer.finish()
+}
+
+/// Export the usage history, oldest sample first
+pub fn write_history<W: Write>(history: &UsageHistory, out: W, format: ArrowFormat) -> io::Result<W> {
+    let specs = [
+        ColumnSpec { name: "ts", ty: ColumnType::Timestamp },
+        ColumnSpec { name: "five_hour_pct", ty: ColumnType::Float64 },
+        ColumnSpec { name: "seven_day_pct", ty: ColumnType::Float64 },
+    ];
+
+    let mut writer = IpcWriter::begin(out, format, &specs)?;
+    // The ring wraps around, so it is written as up to two batches
+    for (ts, five_hour, seven_day) in history.runs() {
+        writer.batch(ts.len(), &[bytes_of(ts), bytes_of(five_hour), bytes_of(seven_day)])?;
+    }
+    writer.finish()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::history::UsageSample;
+    use crate::ledger::LedgerRow;
+
+    fn u32_at(buf: &[u8], at: usize) -> usize {
+        u32::from_le_bytes(buf[at..at + 4].try_into().unwrap()) as usize
+    }
+
+    #[test]
+    fn test_flatbuffer_layout() {
+        let buf = fb::finish(
+            &Table::new()
+                .with(0, Value::I16(7))
+                .with(2, Value::Str("abc".into())),
+        );
+        let table = u32_at(&buf, 0);
+        let vtable = table - i32::from_le_bytes(buf[table..table + 4].try_into().unwrap()) as usize;
+        let slot = |i: usize| u16::from_le_bytes(buf[vtable + 4 + 2 * i..vtable + 6 + 2 * i].try_into().unwrap()) as usize;
+
+        assert_eq!(u16::from_le_bytes(buf[vtable..vtable + 2].try_into().unwrap()), 10);
+        assert_eq!(i16::from_le_bytes(buf[table + slot(0)..table + slot(0) + 2].try_into().unwrap()), 7);
+        assert_eq!(slot(1), 0);
+        let field = table + slot(2);
+        let s = field + u32_at(&buf, field);
+        assert_eq!(&buf[s + 4..s + 4 + u32_at(&buf, s)], b"abc");
+        assert_eq!(buf.len() % 8, 0);
+    }
+
+    #[test]
+    fn test_file_frames_messages() {
+        let mut ledger = Ledger::new();
+        let rows: Vec<LedgerRow> = (0..10)
+            .map(|i| LedgerRow {
+                key: None,
+                ts: 1_700_000_000 + i,
+                session: format!("s{}", i % 3),
+                model: Some("m".into()),
+                input_tokens: i as u32,
+                output_tokens: 1,
+                cache_creation_tokens: 2,
+                cache_read_tokens: 3,
+            })
+            .collect();
+        ledger.ingest_rows("p", &rows);
+
+        let file = write_ledger(&ledger, Vec::new(), ArrowFormat::File).unwrap();
+        assert_eq!(&file[..6], FILE_MAGIC);
+        assert_eq!(&file[file.len() - 6..], FILE_MAGIC);
+        let footer_len = u32_at(&file, file.len() - 10);
+        assert_eq!(footer_len % 8, 0);
+
+        // Schema, three dictionaries, one batch and the end marker
+        let mut at = 8;
+        let mut messages = 0;
+        loop {
+            assert_eq!(u32_at(&file, at), CONTINUATION as usize);
+            let meta = u32_at(&file, at + 4);
+            if meta == 0 {
+                break;
+            }
+            let msg = at + 8;
+            let table = msg + u32_at(&file, msg);
+            let vtable = table - i32::from_le_bytes(file[table..table + 4].try_into().unwrap()) as usize;
+            let body_slot = u16::from_le_bytes(file[vtable + 10..vtable + 12].try_into().unwrap()) as usize;
+            let body = i64::from_le_bytes(file[table + body_slot..table + body_slot + 8].try_into().unwrap());
+            at = msg + meta + body as usize;
+            messages += 1;
+        }
+        assert_eq!(messages, 5);
+        assert_eq!(at + 8 + footer_len + 10, file.len());
+
+        let mut history = UsageHistory::default();
+        history.push(UsageSample { ts: 1, five_hour: 2.0, seven_day: 3.0 });
+        let stream = write_history(&history, Vec::new(), ArrowFormat::Stream).unwrap();
+        assert_eq!(u32_at(&stream, 0), CONTINUATION as usize);
+        assert_eq!(&stream[stream.len() - 8..], &[0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0]);
+    }
+}
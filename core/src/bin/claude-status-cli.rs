@@ -0,0 +1,246 @@
+//! Command-line companion to the panel plugin
+//!
+//! Maintenance tools that work on the same data as the plugin.
+
+use std::path::PathBuf;
+use std::process::ExitCode;
+use std::time::Duration;
+
+use claude_status_core::ledger::{self, Ledger};
+use claude_status_core::query::{self, GroupBy, Metric, Query};
+use claude_status_core::arrow::{self, ArrowFormat};
+use claude_status_core::{agent, anonymize, daemon, roots, shm};
+
+/// Default seconds between agent scans
+const AGENT_INTERVAL_SECS: u64 = 5;
+
+const USAGE: &str = "Usage: claude-status-cli <command> [args]
+
+Commands:
+  agent [--root <projects-dir>] [--interval <secs>]
+      Stream transcript updates on stdout, e.g. over ssh to the panel
+  anonymize <projects-dir> <output-dir>
+      Write an anonymized copy of a transcript tree, suitable for fixtures
+  daemon [--socket <path>]
+      Serve panels from one shared core; uses the socket passed by systemd
+      if socket-activated, otherwise $XDG_RUNTIME_DIR/claude-status.sock;
+      without XDG_RUNTIME_DIR a --socket path is required
+  export [--root <dir>]... [--archive <dir>] [<output.arrow>]
+      Write the token ledger as an Arrow IPC file, or as an Arrow stream
+      on stdout if no output file is given
+  query [--root <dir>]... [--archive <dir>] [--days <n>] [--project <name>]
+        [--by total|project|model|session|day|hour] [--order <metric>] [--limit <n>]
+      Sum token usage from the ledger; metrics are rows, input, output,
+      cache-creation, cache-read, cache-miss and total
+  snapshot [path]
+      Print the values the panel publishes to shared memory";
+
+fn cmd_anonymize(args: &[String]) -> Result<(), String> {
+    let (src, dst) = match args {
+        [src, dst] => (PathBuf::from(src), PathBuf::from(dst)),
+        _ => return Err(USAGE.to_string()),
+    };
+    if dst.exists() && dst.read_dir().map_or(true, |mut d| d.next().is_some()) {
+        return Err(format!("Output directory {} is not empty", dst.display()));
+    }
+
+    let stats = anonymize::anonymize_tree(&src, &dst).map_err(|e| e.to_string())?;
+    println!("Anonymized {} lines in {} files", stats.lines, stats.files);
+    Ok(())
+}
+
+fn cmd_agent(args: &[String]) -> Result<(), String> {
+    let mut root = dirs::home_dir()
+        .map(|h| h.join(".claude").join("projects"))
+        .ok_or("No home directory")?;
+    let mut interval = AGENT_INTERVAL_SECS;
+
+    let mut iter = args.iter();
+    while let Some(arg) = iter.next() {
+        match (arg.as_str(), iter.next()) {
+            ("--root", Some(value)) => root = PathBuf::from(value),
+            ("--interval", Some(value)) => {
+                interval = value.parse().map_err(|_| format!("Invalid interval: {}", value))?
+            }
+            _ => return Err(USAGE.to_string()),
+        }
+    }
+
+    agent::run_agent(
+        &root,
+        std::io::stdin(),
+        std::io::stdout().lock(),
+        Duration::from_secs(interval.max(1)),
+    )
+    .or_else(|e| match e.kind() {
+        // The other end went away; that is how the agent normally stops
+        std::io::ErrorKind::BrokenPipe => Ok(()),
+        _ => Err(e.to_string()),
+    })
+}
+
+/// Build a ledger from transcript roots (the default ones if none) and
+/// an optional archive directory
+fn load_ledger(mut roots: Vec<PathBuf>, archive: Option<PathBuf>) -> Result<Ledger, String> {
+    if roots.is_empty() {
+        roots = roots::default_roots();
+    }
+    let live: Vec<PathBuf> = roots.iter().flat_map(|root| ledger::live_files(root)).collect();
+    let mut ledger = Ledger::new();
+    ledger
+        .refresh(&live, archive.as_deref())
+        .map_err(|e| e.to_string())?;
+    Ok(ledger)
+}
+
+fn cmd_export(args: &[String]) -> Result<(), String> {
+    let mut roots = Vec::new();
+    let mut archive = None;
+    let mut output = None;
+
+    let mut iter = args.iter();
+    while let Some(arg) = iter.next() {
+        match arg.as_str() {
+            "--root" => roots.push(PathBuf::from(iter.next().ok_or(USAGE)?)),
+            "--archive" => archive = Some(PathBuf::from(iter.next().ok_or(USAGE)?)),
+            path if output.is_none() && !path.starts_with("--") => output = Some(PathBuf::from(path)),
+            _ => return Err(USAGE.to_string()),
+        }
+    }
+
+    let ledger = load_ledger(roots, archive)?;
+    match output {
+        Some(path) => {
+            let file = std::fs::File::create(&path)
+                .map_err(|e| format!("Cannot create {}: {}", path.display(), e))?;
+            arrow::write_ledger(&ledger, std::io::BufWriter::new(file), ArrowFormat::File)
+                .map_err(|e| e.to_string())?;
+            eprintln!("Wrote {} rows to {}", ledger.len(), path.display());
+        }
+        None => {
+            arrow::write_ledger(&ledger, std::io::stdout().lock(), ArrowFormat::Stream)
+                .map(|_| ())
+                .map_err(|e| e.to_string())?;
+        }
+    }
+    Ok(())
+}
+
+fn cmd_query(args: &[String]) -> Result<(), String> {
+    let mut roots = Vec::new();
+    let mut archive = None;
+    let mut query = Query::default();
+
+    let mut iter = args.iter();
+    while let Some(arg) = iter.next() {
+        let value = iter.next().ok_or(USAGE)?;
+        let number = || value.parse::<i64>().ok().filter(|&n| n > 0).ok_or(format!("Invalid number: {}", value));
+        match arg.as_str() {
+            "--root" => roots.push(PathBuf::from(value)),
+            "--archive" => archive = Some(PathBuf::from(value)),
+            "--days" => (query.since, query.until) = Query::last_days(number()?, chrono::Utc::now().timestamp()),
+            "--project" => query.project = Some(value.clone()),
+            "--limit" => query.limit = Some(number()? as usize),
+            "--by" => {
+                query.group_by = match value.as_str() {
+                    "total" => GroupBy::Total,
+                    "project" => GroupBy::Project,
+                    "model" => GroupBy::Model,
+                    "session" => GroupBy::Session,
+                    "day" => GroupBy::Day,
+                    "hour" => GroupBy::HourOfWeek,
+                    _ => return Err(format!("Unknown grouping: {}", value)),
+                }
+            }
+            "--order" => {
+                query.order_by = Some(match value.as_str() {
+                    "rows" => Metric::Rows,
+                    "input" => Metric::Input,
+                    "output" => Metric::Output,
+                    "cache-creation" => Metric::CacheCreation,
+                    "cache-read" => Metric::CacheRead,
+                    "cache-miss" => Metric::CacheMiss,
+                    "total" => Metric::Total,
+                    _ => return Err(format!("Unknown metric: {}", value)),
+                })
+            }
+            _ => return Err(USAGE.to_string()),
+        }
+    }
+    let ledger = load_ledger(roots, archive)?;
+    let result = query::run(&ledger, &query);
+    println!("key\trows\tinput\toutput\tcache_creation\tcache_read");
+    for row in &result.rows {
+        println!(
+            "{}\t{}\t{}\t{}\t{}\t{}",
+            row.key,
+            row.sums.rows,
+            row.sums.input,
+            row.sums.output,
+            row.sums.cache_creation,
+            row.sums.cache_read
+        );
+    }
+    Ok(())
+}
+
+fn cmd_daemon(args: &[String]) -> Result<(), String> {
+    let path = match args {
+        [] => match daemon::activated_listener() {
+            Some(listener) => return daemon::run(listener).map_err(|e| e.to_string()),
+            None => daemon::default_socket_path()
+                .ok_or("XDG_RUNTIME_DIR is not set; pass --socket <path>")?,
+        },
+        [flag, path] if flag == "--socket" => PathBuf::from(path),
+        _ => return Err(USAGE.to_string()),
+    };
+    let listener = daemon::bind(&path).map_err(|e| format!("Cannot listen on {}: {}", path.display(), e))?;
+    daemon::run(listener).map_err(|e| e.to_string())
+}
+
+fn cmd_snapshot(args: &[String]) -> Result<(), String> {
+    let path = match args {
+        [] => shm::default_shm_path(),
+        [path] => PathBuf::from(path),
+        _ => return Err(USAGE.to_string()),
+    };
+    let reader = shm::ShmReader::open(&path)
+        .map_err(|e| format!("No snapshot at {}: {}", path.display(), e))?;
+    let snap = reader.read().ok_or("Snapshot is being rewritten continuously")?;
+
+    println!("updated_at={}", snap.updated_at);
+    if snap.usage_valid {
+        println!("five_hour_pct={:.1}", snap.five_hour_pct);
+        println!("seven_day_pct={:.1}", snap.seven_day_pct);
+        println!("five_hour_reset_ts={}", snap.five_hour_reset_ts);
+        println!("seven_day_reset_ts={}", snap.seven_day_reset_ts);
+    }
+    if snap.context_valid {
+        println!("context_pct={:.1}", snap.context_pct);
+        println!("context_tokens={}", snap.context_tokens);
+        println!("turns_to_compact={}", snap.turns_to_compact);
+        println!("sidechain_tokens={}", snap.sidechain_tokens);
+    }
+    Ok(())
+}
+
+fn main() -> ExitCode {
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    let result = match args.first().map(String::as_str) {
+        Some("agent") => cmd_agent(&args[1..]),
+        Some("anonymize") => cmd_anonymize(&args[1..]),
+        Some("daemon") => cmd_daemon(&args[1..]),
+        Some("export") => cmd_export(&args[1..]),
+        Some("query") => cmd_query(&args[1..]),
+        Some("snapshot") => cmd_snapshot(&args[1..]),
+        _ => Err(USAGE.to_string()),
+    };
+
+    match result {
+        Ok(()) => ExitCode::SUCCESS,
+        Err(e) => {
+            eprintln!("{}", e);
+            ExitCode::FAILURE
+        }
+    }
+}
@@ -6,6 +6,8 @@ const DEFAULT_YELLOW_THRESHOLD: i32 = 25;
 const DEFAULT_ORANGE_THRESHOLD: i32 = 50;
 const DEFAULT_RED_THRESHOLD: i32 = 75;
 
+use crate::governor::DEFAULT_MAX_REQUESTS_PER_HOUR;
+
 /// Plugin configuration
 #[derive(Debug, Clone)]
 pub struct Config {
@@ -13,6 +15,14 @@ pub struct Config {
     pub yellow_threshold: i32,
     pub orange_threshold: i32,
     pub red_threshold: i32,
+    /// Hard cap on usage requests per hour
+    pub max_requests_per_hour: i32,
+    /// Directory holding archived transcripts, if any
+    pub archive_dir: Option<String>,
+    /// Projects directories scanned in addition to the default ones
+    pub extra_transcript_roots: Vec<String>,
+    /// Shell command that starts a remote agent, if any
+    pub remote_command: Option<String>,
 }
 
 impl Default for Config {
@@ -22,6 +32,10 @@ impl Default for Config {
             yellow_threshold: DEFAULT_YELLOW_THRESHOLD,
             orange_threshold: DEFAULT_ORANGE_THRESHOLD,
             red_threshold: DEFAULT_RED_THRESHOLD,
+            max_requests_per_hour: DEFAULT_MAX_REQUESTS_PER_HOUR,
+            archive_dir: None,
+            extra_transcript_roots: Vec::new(),
+            remote_command: None,
         }
     }
 }
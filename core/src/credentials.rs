@@ -41,7 +41,7 @@ struct OAuthSection {
 const DEFAULT_CREDS_PATH: &str = ".claude/.credentials.json";
 
 /// Expand ~ to home directory
-fn expand_path(path: &str) -> PathBuf {
+pub fn expand_path(path: &str) -> PathBuf {
     if let Some(rest) = path.strip_prefix("~/") {
         if let Some(home) = dirs::home_dir() {
             return home.join(rest);
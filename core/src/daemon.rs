@@ -0,0 +1,794 @@
+//! User daemon hosting the core outside the panel
+//!
+//! `claude-status-cli daemon` keeps one core alive across panel restarts:
+//! credentials, pooled HTTP connections, transcript offsets, the ledger
+//! and the history ring all stay warm. It is meant to run as a systemd
+//! user service with socket activation, so the first panel to connect
+//! starts it.
+//!
+//! The panel talks to it over a Unix socket with a compact binary
+//! protocol. Every frame is a little-endian `u32` body length followed by
+//! the body, which starts with the protocol version and a message kind.
+//! Strings are length-prefixed UTF-8 and optional values carry a presence
+//! byte. A panel sends its settings with every refresh, so a restarted
+//! daemon picks them up again without any extra handshake.
+
+use chrono::{DateTime, Utc};
+use std::collections::HashMap;
+use std::io::{self, Read};
+use std::os::unix::io::FromRawFd;
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::Duration;
+use thiserror::Error;
+
+use crate::api::{UsageData, UsagePeriod};
+use crate::ffi::{CConnectStats, CDiagnostics};
+use crate::forecast::ContextForecast;
+use crate::history::UsageSample;
+use crate::ledger::LedgerTotals;
+use crate::net;
+use crate::timeline::TimelinePoint;
+use crate::tools::ToolShare;
+use crate::transcript::{ContextInfo, SidechainUsage};
+
+pub const PROTOCOL_VERSION: u8 = 1;
+
+/// Largest frame either side accepts
+const MAX_FRAME: usize = 16 << 20;
+
+/// A refresh may wait on the usage API
+const CALL_TIMEOUT: Duration = Duration::from_secs(60);
+
+/// First file descriptor passed by systemd socket activation
+const SD_LISTEN_FDS_START: i32 = 3;
+
+const KIND_REFRESH: u8 = 1;
+const KIND_EXPORT: u8 = 2;
+const KIND_STATE: u8 = 0x81;
+const KIND_DONE: u8 = 0x82;
+
+#[derive(Debug, Error)]
+pub enum DaemonError {
+    #[error("Daemon connection failed: {0}")]
+    Io(#[from] io::Error),
+    #[error("Malformed daemon message: {0}")]
+    Protocol(&'static str),
+}
+
+/// Socket the daemon listens on: `$XDG_RUNTIME_DIR/claude-status.sock`
+///
+/// None without a runtime directory; a name in a shared directory could be
+/// taken by another user first.
+pub fn default_socket_path() -> Option<PathBuf> {
+    let dir = PathBuf::from(std::env::var_os("XDG_RUNTIME_DIR")?);
+    dir.is_absolute().then(|| dir.join("claude-status.sock"))
+}
+
+/// Listening socket passed by systemd, if this process was socket-activated
+pub fn activated_listener() -> Option<UnixListener> {
+    let pid: u32 = std::env::var("LISTEN_PID").ok()?.parse().ok()?;
+    let fds: i32 = std::env::var("LISTEN_FDS").ok()?.parse().ok()?;
+    if pid != std::process::id() || fds < 1 {
+        return None;
+    }
+    std::env::remove_var("LISTEN_PID");
+    std::env::remove_var("LISTEN_FDS");
+    Some(unsafe { UnixListener::from_raw_fd(SD_LISTEN_FDS_START) })
+}
+
+/// Bind `path`, replacing a socket file left behind by a dead daemon
+pub fn bind(path: &Path) -> io::Result<UnixListener> {
+    match UnixListener::bind(path) {
+        Err(e) if e.kind() == io::ErrorKind::AddrInUse && UnixStream::connect(path).is_err() => {
+            std::fs::remove_file(path)?;
+            UnixListener::bind(path)
+        }
+        result => result,
+    }
+}
+
+/// What a panel wants the daemon to do, sent with every refresh
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct Settings {
+    pub creds_file: Option<String>,
+    pub archive_dir: Option<String>,
+    pub transcript_roots: Vec<String>,
+    pub remote_command: Option<String>,
+    pub max_requests_per_hour: i32,
+    /// Subscribed metrics as a bit per `CMetric`
+    pub metrics: u8,
+    pub publish_shm: bool,
+}
+
+#[derive(Debug, Clone, PartialEq)]
+pub enum Request {
+    Refresh {
+        settings: Settings,
+        /// History the panel already has; the ring is only sent if it differs
+        history_generation: u64,
+    },
+    Export {
+        dir: String,
+    },
+}
+
+/// Everything the panel reads after a refresh
+#[derive(Debug, Clone)]
+pub struct Snapshot {
+    /// `CResultCode` of the refresh
+    pub code: u8,
+    pub creds_valid: bool,
+    pub plan_name: Option<String>,
+    pub usage: Option<UsageData>,
+    pub usage_generation: u64,
+    pub usage_fetched_at: i64,
+    /// Generation and samples, oldest first
+    pub history: Option<(u64, Vec<UsageSample>)>,
+    pub context: Option<ContextInfo>,
+    /// Totals and ledger version
+    pub totals: Option<(LedgerTotals, u64)>,
+    pub diagnostics: CDiagnostics,
+}
+
+#[derive(Debug, Clone)]
+pub enum Response {
+    State(Box<Snapshot>),
+    /// `CResultCode` of an export
+    Done(u8),
+}
+
+#[derive(Default)]
+struct Encoder(Vec<u8>);
+
+impl Encoder {
+    fn u8(&mut self, v: u8) {
+        self.0.push(v);
+    }
+    fn bool(&mut self, v: bool) {
+        self.u8(v as u8);
+    }
+    fn u32(&mut self, v: u32) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn u64(&mut self, v: u64) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn i64(&mut self, v: i64) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn f64(&mut self, v: f64) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn str(&mut self, v: &str) {
+        self.u32(v.len() as u32);
+        self.0.extend_from_slice(v.as_bytes());
+    }
+    fn opt<T>(&mut self, v: Option<T>, put: impl FnOnce(&mut Self, T)) {
+        self.bool(v.is_some());
+        if let Some(v) = v {
+            put(self, v);
+        }
+    }
+}
+
+struct Decoder<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Decoder<'a> {
+    fn take(&mut self, n: usize) -> Result<&'a [u8], DaemonError> {
+        if self.buf.len() < n {
+            return Err(DaemonError::Protocol("truncated"));
+        }
+        let (head, rest) = self.buf.split_at(n);
+        self.buf = rest;
+        Ok(head)
+    }
+    fn u8(&mut self) -> Result<u8, DaemonError> {
+        Ok(self.take(1)?[0])
+    }
+    fn bool(&mut self) -> Result<bool, DaemonError> {
+        Ok(self.u8()? != 0)
+    }
+    fn u32(&mut self) -> Result<u32, DaemonError> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+    fn u64(&mut self) -> Result<u64, DaemonError> {
+        Ok(u64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+    fn i64(&mut self) -> Result<i64, DaemonError> {
+        Ok(i64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+    fn f64(&mut self) -> Result<f64, DaemonError> {
+        Ok(f64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+    fn str(&mut self) -> Result<String, DaemonError> {
+        let len = self.u32()? as usize;
+        String::from_utf8(self.take(len)?.to_vec()).map_err(|_| DaemonError::Protocol("invalid UTF-8"))
+    }
+    fn opt<T>(
+        &mut self,
+        get: impl FnOnce(&mut Self) -> Result<T, DaemonError>,
+    ) -> Result<Option<T>, DaemonError> {
+        if self.bool()? {
+            get(self).map(Some)
+        } else {
+            Ok(None)
+        }
+    }
+    fn count(&mut self, item_size: usize) -> Result<usize, DaemonError> {
+        let n = self.u32()? as usize;
+        // Refuse counts the remaining bytes cannot hold before allocating
+        if n.saturating_mul(item_size) > self.buf.len() {
+            return Err(DaemonError::Protocol("bad length"));
+        }
+        Ok(n)
+    }
+}
+
+fn header(kind: u8) -> Encoder {
+    let mut enc = Encoder::default();
+    enc.u8(PROTOCOL_VERSION);
+    enc.u8(kind);
+    enc
+}
+
+fn open(body: &[u8]) -> Result<(u8, Decoder<'_>), DaemonError> {
+    let mut dec = Decoder { buf: body };
+    if dec.u8()? != PROTOCOL_VERSION {
+        return Err(DaemonError::Protocol("unsupported version"));
+    }
+    Ok((dec.u8()?, dec))
+}
+
+impl Request {
+    fn encode(&self) -> Vec<u8> {
+        let mut enc;
+        match self {
+            Request::Refresh {
+                settings,
+                history_generation,
+            } => {
+                enc = header(KIND_REFRESH);
+                enc.opt(settings.creds_file.as_deref(), Encoder::str);
+                enc.opt(settings.archive_dir.as_deref(), Encoder::str);
+                enc.u32(settings.transcript_roots.len() as u32);
+                for root in &settings.transcript_roots {
+                    enc.str(root);
+                }
+                enc.opt(settings.remote_command.as_deref(), Encoder::str);
+                enc.i64(settings.max_requests_per_hour as i64);
+                enc.u8(settings.metrics);
+                enc.bool(settings.publish_shm);
+                enc.u64(*history_generation);
+            }
+            Request::Export { dir } => {
+                enc = header(KIND_EXPORT);
+                enc.str(dir);
+            }
+        }
+        enc.0
+    }
+
+    fn decode(body: &[u8]) -> Result<Request, DaemonError> {
+        let (kind, mut dec) = open(body)?;
+        match kind {
+            KIND_REFRESH => {
+                let creds_file = dec.opt(Decoder::str)?;
+                let archive_dir = dec.opt(Decoder::str)?;
+                let roots = dec.count(4)?;
+                let transcript_roots = (0..roots).map(|_| dec.str()).collect::<Result<_, _>>()?;
+                Ok(Request::Refresh {
+                    settings: Settings {
+                        creds_file,
+                        archive_dir,
+                        transcript_roots,
+                        remote_command: dec.opt(Decoder::str)?,
+                        max_requests_per_hour: dec.i64()? as i32,
+                        metrics: dec.u8()?,
+                        publish_shm: dec.bool()?,
+                    },
+                    history_generation: dec.u64()?,
+                })
+            }
+            KIND_EXPORT => Ok(Request::Export { dir: dec.str()? }),
+            _ => Err(DaemonError::Protocol("unknown request")),
+        }
+    }
+}
+
+fn put_connect_stats(enc: &mut Encoder, stats: &CConnectStats) {
+    enc.u64(stats.attempts);
+    enc.u64(stats.failures);
+    enc.u64(stats.wins);
+    enc.u32(stats.last_ms);
+    enc.u32(stats.avg_ms);
+}
+
+fn get_connect_stats(dec: &mut Decoder) -> Result<CConnectStats, DaemonError> {
+    Ok(CConnectStats {
+        attempts: dec.u64()?,
+        failures: dec.u64()?,
+        wins: dec.u64()?,
+        last_ms: dec.u32()?,
+        avg_ms: dec.u32()?,
+    })
+}
+
+fn put_context(enc: &mut Encoder, info: &ContextInfo) {
+    enc.f64(info.context_pct);
+    enc.i64(info.context_tokens);
+    enc.i64(info.context_window_size);
+    enc.opt(info.model_name.as_deref(), Encoder::str);
+    enc.opt(info.forecast, |enc, f| {
+        enc.i64(f.turns);
+        enc.opt(f.secs, Encoder::i64);
+    });
+    enc.u32(info.timeline.len() as u32);
+    for point in &info.timeline {
+        enc.i64(point.tokens);
+        enc.bool(point.compacted);
+    }
+    enc.i64(info.sidechain.messages);
+    enc.i64(info.sidechain.input_tokens);
+    enc.i64(info.sidechain.output_tokens);
+    enc.u32(info.tools.len() as u32);
+    for tool in &info.tools {
+        enc.str(&tool.name);
+        enc.i64(tool.calls);
+        enc.i64(tool.bytes);
+    }
+    enc.opt(info.host.as_deref(), Encoder::str);
+}
+
+fn get_context(dec: &mut Decoder) -> Result<ContextInfo, DaemonError> {
+    let context_pct = dec.f64()?;
+    let context_tokens = dec.i64()?;
+    let context_window_size = dec.i64()?;
+    let model_name = dec.opt(Decoder::str)?;
+    let forecast = dec.opt(|dec| {
+        Ok(ContextForecast {
+            turns: dec.i64()?,
+            secs: dec.opt(Decoder::i64)?,
+        })
+    })?;
+    let points = dec.count(9)?;
+    let timeline = (0..points)
+        .map(|_| {
+            Ok(TimelinePoint {
+                tokens: dec.i64()?,
+                compacted: dec.bool()?,
+            })
+        })
+        .collect::<Result<_, DaemonError>>()?;
+    let sidechain = SidechainUsage {
+        messages: dec.i64()?,
+        input_tokens: dec.i64()?,
+        output_tokens: dec.i64()?,
+    };
+    let tools = dec.count(20)?;
+    let tools = (0..tools)
+        .map(|_| {
+            Ok(ToolShare {
+                name: dec.str()?,
+                calls: dec.i64()?,
+                bytes: dec.i64()?,
+            })
+        })
+        .collect::<Result<_, DaemonError>>()?;
+    Ok(ContextInfo {
+        context_pct,
+        context_tokens,
+        context_window_size,
+        model_name,
+        forecast,
+        timeline,
+        sidechain,
+        tools,
+        host: dec.opt(Decoder::str)?,
+    })
+}
+
+fn period(utilization: f64, resets_at: i64) -> Result<UsagePeriod, DaemonError> {
+    Ok(UsagePeriod {
+        utilization,
+        resets_at: DateTime::<Utc>::from_timestamp(resets_at, 0).ok_or(DaemonError::Protocol("bad time"))?,
+    })
+}
+
+impl Response {
+    fn encode(&self) -> Vec<u8> {
+        let snap = match self {
+            Response::State(snap) => snap,
+            Response::Done(code) => {
+                let mut enc = header(KIND_DONE);
+                enc.u8(*code);
+                return enc.0;
+            }
+        };
+
+        let mut enc = header(KIND_STATE);
+        enc.u8(snap.code);
+        enc.bool(snap.creds_valid);
+        enc.opt(snap.plan_name.as_deref(), Encoder::str);
+        enc.opt(snap.usage.as_ref(), |enc, usage| {
+            enc.f64(usage.five_hour.utilization);
+            enc.i64(usage.five_hour.resets_at.timestamp());
+            enc.f64(usage.seven_day.utilization);
+            enc.i64(usage.seven_day.resets_at.timestamp());
+        });
+        enc.u64(snap.usage_generation);
+        enc.i64(snap.usage_fetched_at);
+        enc.opt(snap.history.as_ref(), |enc, (generation, samples)| {
+            enc.u64(*generation);
+            enc.u32(samples.len() as u32);
+            for s in samples {
+                enc.i64(s.ts);
+                enc.f64(s.five_hour);
+                enc.f64(s.seven_day);
+            }
+        });
+        enc.opt(snap.context.as_ref(), put_context);
+        enc.opt(snap.totals.as_ref(), |enc, (totals, version)| {
+            enc.u64(totals.rows);
+            enc.u64(totals.sessions);
+            enc.u64(totals.input_tokens);
+            enc.u64(totals.output_tokens);
+            enc.u64(totals.cache_creation_tokens);
+            enc.u64(totals.cache_read_tokens);
+            enc.u64(*version);
+        });
+        let diag = &snap.diagnostics;
+        enc.u64(diag.requests);
+        enc.u64(diag.published);
+        enc.u64(diag.unchanged);
+        enc.u64(diag.denied);
+        enc.u32(diag.budget_available);
+        enc.u32(diag.budget_capacity);
+        enc.bool(diag.deferred);
+        enc.u32(diag.retry_after_secs);
+        put_connect_stats(&mut enc, &diag.ipv4);
+        put_connect_stats(&mut enc, &diag.ipv6);
+        enc.0
+    }
+
+    fn decode(body: &[u8]) -> Result<Response, DaemonError> {
+        let (kind, mut dec) = open(body)?;
+        match kind {
+            KIND_DONE => return Ok(Response::Done(dec.u8()?)),
+            KIND_STATE => {}
+            _ => return Err(DaemonError::Protocol("unknown response")),
+        }
+
+        let code = dec.u8()?;
+        let creds_valid = dec.bool()?;
+        let plan_name = dec.opt(Decoder::str)?;
+        let usage = dec.opt(|dec| {
+            Ok(UsageData {
+                five_hour: period(dec.f64()?, dec.i64()?)?,
+                seven_day: period(dec.f64()?, dec.i64()?)?,
+            })
+        })?;
+        let usage_generation = dec.u64()?;
+        let usage_fetched_at = dec.i64()?;
+        let history = dec.opt(|dec| {
+            let generation = dec.u64()?;
+            let n = dec.count(24)?;
+            let samples = (0..n)
+                .map(|_| {
+                    Ok(UsageSample {
+                        ts: dec.i64()?,
+                        five_hour: dec.f64()?,
+                        seven_day: dec.f64()?,
+                    })
+                })
+                .collect::<Result<_, DaemonError>>()?;
+            Ok((generation, samples))
+        })?;
+        let context = dec.opt(get_context)?;
+        let totals = dec.opt(|dec| {
+            let totals = LedgerTotals {
+                rows: dec.u64()?,
+                sessions: dec.u64()?,
+                input_tokens: dec.u64()?,
+                output_tokens: dec.u64()?,
+                cache_creation_tokens: dec.u64()?,
+                cache_read_tokens: dec.u64()?,
+            };
+            Ok((totals, dec.u64()?))
+        })?;
+        let diagnostics = CDiagnostics {
+            requests: dec.u64()?,
+            published: dec.u64()?,
+            unchanged: dec.u64()?,
+            denied: dec.u64()?,
+            budget_available: dec.u32()?,
+            budget_capacity: dec.u32()?,
+            deferred: dec.bool()?,
+            retry_after_secs: dec.u32()?,
+            ipv4: get_connect_stats(&mut dec)?,
+            ipv6: get_connect_stats(&mut dec)?,
+        };
+
+        Ok(Response::State(Box::new(Snapshot {
+            code,
+            creds_valid,
+            plan_name,
+            usage,
+            usage_generation,
+            usage_fetched_at,
+            history,
+            context,
+            totals,
+            diagnostics,
+        })))
+    }
+}
+
+fn write_frame(stream: &UnixStream, body: &[u8]) -> io::Result<()> {
+    let mut frame = Vec::with_capacity(4 + body.len());
+    frame.extend_from_slice(&(body.len() as u32).to_le_bytes());
+    frame.extend_from_slice(body);
+    // A peer that went away must not raise SIGPIPE in the panel
+    net::send_all(stream, &frame)
+}
+
+fn read_frame(stream: &mut UnixStream) -> Result<Vec<u8>, DaemonError> {
+    let mut len = [0u8; 4];
+    stream.read_exact(&mut len)?;
+    let len = u32::from_le_bytes(len) as usize;
+    if len > MAX_FRAME {
+        return Err(DaemonError::Protocol("frame too large"));
+    }
+    let mut body = vec![0u8; len];
+    stream.read_exact(&mut body)?;
+    Ok(body)
+}
+
+/// Connection from a panel to the daemon
+///
+/// A broken connection, e.g. after the daemon was restarted, is replaced
+/// on the next call; socket activation starts a new daemon if needed.
+pub struct Client {
+    path: PathBuf,
+    stream: Mutex<Option<UnixStream>>,
+}
+
+impl Client {
+    /// Connect to the daemon at `path`; fails if nothing listens there
+    pub fn connect(path: &Path) -> io::Result<Client> {
+        let stream = Self::open(path)?;
+        Ok(Client {
+            path: path.to_path_buf(),
+            stream: Mutex::new(Some(stream)),
+        })
+    }
+
+    fn open(path: &Path) -> io::Result<UnixStream> {
+        let stream = UnixStream::connect(path)?;
+        stream.set_read_timeout(Some(CALL_TIMEOUT))?;
+        stream.set_write_timeout(Some(CALL_TIMEOUT))?;
+        Ok(stream)
+    }
+
+    pub fn call(&self, request: &Request) -> Result<Response, DaemonError> {
+        let body = request.encode();
+        let mut slot = self.stream.lock().unwrap();
+        // A connection that went stale between calls gets one retry
+        for retry in [true, false] {
+            let stream = match slot.as_mut() {
+                Some(s) => s,
+                None => slot.insert(Self::open(&self.path)?),
+            };
+            let result = write_frame(stream, &body)
+                .map_err(DaemonError::from)
+                .and_then(|_| read_frame(stream))
+                .and_then(|reply| Response::decode(&reply));
+            match result {
+                Ok(response) => return Ok(response),
+                Err(DaemonError::Io(_)) if retry => *slot = None,
+                Err(e) => {
+                    *slot = None;
+                    return Err(e);
+                }
+            }
+        }
+        unreachable!()
+    }
+}
+
+/// Daemon side of the protocol
+pub trait Host: Send {
+    fn handle(&mut self, client: u64, request: Request) -> Response;
+    /// The client's connection closed; drop anything held on its behalf
+    fn disconnected(&mut self, client: u64);
+}
+
+/// Answer panels on `listener` until it fails; each connection gets a thread
+pub fn serve<H: Host + 'static>(listener: UnixListener, host: H) -> io::Result<()> {
+    let host = Arc::new(Mutex::new(host));
+    let mut next_id = 0u64;
+    loop {
+        let (mut stream, _) = match listener.accept() {
+            Ok(conn) => conn,
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+            Err(e) => return Err(e),
+        };
+        let id = next_id;
+        next_id += 1;
+        let host = Arc::clone(&host);
+        thread::spawn(move || {
+            while let Ok(body) = read_frame(&mut stream) {
+                let response = match Request::decode(&body) {
+                    Ok(request) => host.lock().unwrap().handle(id, request),
+                    Err(_) => break,
+                };
+                if write_frame(&stream, &response.encode()).is_err() {
+                    break;
+                }
+            }
+            host.lock().unwrap().disconnected(id);
+        });
+    }
+}
+
+/// Serve panels on `listener` from a core of the daemon's own
+pub fn run(listener: UnixListener) -> io::Result<()> {
+    serve(listener, crate::ffi::DaemonHost::new())
+}
+
+/// Per-client subscription sets, so a panel that goes away releases its
+/// metrics
+#[derive(Debug, Default)]
+pub struct Subscriptions(HashMap<u64, u8>);
+
+impl Subscriptions {
+    /// Replace `client`'s set, returning the bits added and removed
+    pub fn update(&mut self, client: u64, metrics: u8) -> (u8, u8) {
+        let old = self.0.insert(client, metrics).unwrap_or(0);
+        (metrics & !old, old & !metrics)
+    }
+
+    pub fn remove(&mut self, client: u64) -> u8 {
+        self.0.remove(&client).unwrap_or(0)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Echoes the settings back through the snapshot fields
+    struct Echo;
+
+    impl Host for Echo {
+        fn handle(&mut self, _client: u64, request: Request) -> Response {
+            match request {
+                Request::Export { dir } => Response::Done(dir.len() as u8),
+                Request::Refresh {
+                    settings,
+                    history_generation,
+                } => Response::State(Box::new(Snapshot {
+                    code: settings.metrics,
+                    creds_valid: settings.publish_shm,
+                    plan_name: settings.creds_file,
+                    usage: Some(UsageData {
+                        five_hour: period(12.5, 1_700_000_000).unwrap(),
+                        seven_day: period(40.0, 1_700_500_000).unwrap(),
+                    }),
+                    usage_generation: 3,
+                    usage_fetched_at: 1_700_000_100,
+                    history: Some((
+                        history_generation + 1,
+                        vec![UsageSample {
+                            ts: 1,
+                            five_hour: 2.0,
+                            seven_day: 3.0,
+                        }],
+                    )),
+                    context: Some(ContextInfo {
+                        context_pct: 41.5,
+                        context_tokens: 83_000,
+                        context_window_size: 200_000,
+                        model_name: Some("claude-x".into()),
+                        forecast: Some(ContextForecast {
+                            turns: 7,
+                            secs: None,
+                        }),
+                        timeline: vec![TimelinePoint {
+                            tokens: 83_000,
+                            compacted: true,
+                        }],
+                        sidechain: SidechainUsage::default(),
+                        tools: vec![ToolShare {
+                            name: "Read".into(),
+                            calls: 4,
+                            bytes: 9000,
+                        }],
+                        host: Some(settings.transcript_roots.join(":")),
+                    }),
+                    totals: None,
+                    diagnostics: CDiagnostics::default(),
+                })),
+            }
+        }
+
+        fn disconnected(&mut self, _client: u64) {}
+    }
+
+    #[test]
+    fn test_round_trip_and_reconnect() {
+        let dir = std::env::temp_dir().join(format!("claude-status-daemon-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("sock");
+        let _ = std::fs::remove_file(&path);
+
+        let listener = bind(&path).unwrap();
+        thread::spawn(move || serve(listener, Echo));
+
+        let client = Client::connect(&path).unwrap();
+        let settings = Settings {
+            creds_file: Some("~/creds.json".into()),
+            transcript_roots: vec!["/a".into(), "/b".into()],
+            metrics: 0b1011,
+            publish_shm: true,
+            ..Default::default()
+        };
+        let refresh = Request::Refresh {
+            settings,
+            history_generation: 41,
+        };
+        let snap = match client.call(&refresh).unwrap() {
+            Response::State(snap) => snap,
+            other => panic!("unexpected {:?}", other),
+        };
+        assert_eq!((snap.code, snap.creds_valid), (0b1011, true));
+        assert_eq!(snap.plan_name.as_deref(), Some("~/creds.json"));
+        assert_eq!(snap.usage.unwrap().seven_day.resets_at.timestamp(), 1_700_500_000);
+        assert_eq!(snap.history.unwrap().0, 42);
+        let ctx = snap.context.unwrap();
+        assert_eq!(ctx.host.as_deref(), Some("/a:/b"));
+        assert_eq!(ctx.tools[0].bytes, 9000);
+        assert_eq!(ctx.forecast.unwrap().turns, 7);
+
+        // As after a daemon restart: the old connection is dead and the
+        // client reconnects on its own
+        *client.stream.lock().unwrap() = Some(UnixStream::pair().unwrap().0);
+        let export = Request::Export { dir: "/tmp/x".into() };
+        assert!(matches!(client.call(&export).unwrap(), Response::Done(6)));
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_core_takes_work_back_from_vanished_daemon() {
+        use crate::ffi::*;
+
+        let dir = std::env::temp_dir().join(format!("claude-status-gone-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("sock");
+        let _ = std::fs::remove_file(&path);
+        let sock = std::ffi::CString::new(path.to_str().unwrap()).unwrap();
+        let creds = std::ffi::CString::new(dir.join("none.json").to_str().unwrap()).unwrap();
+
+        // Connected while the socket exists, then the daemon disappears
+        let listener = bind(&path).unwrap();
+        let core = claude_status_core_new();
+        unsafe {
+            assert!(claude_status_core_connect_daemon(core, sock.as_ptr()));
+            drop(listener);
+            std::fs::remove_file(&path).unwrap();
+
+            for _ in 0..2 {
+                let code = claude_status_core_refresh(core, creds.as_ptr());
+                assert_ne!(code, CResultCode::NetworkError);
+            }
+            claude_status_core_free(core);
+        }
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
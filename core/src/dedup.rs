@@ -0,0 +1,94 @@
+//! Exact index of usage rows by message key
+//!
+//! Claude Code writes several lines per API message while streaming, and
+//! resumed sessions copy earlier history into new transcript files, so the
+//! same message can be seen many times. Every key maps to the row that
+//! holds its message, so a repeat can either be dropped or, for a streamed
+//! message whose later lines carry the final usage, update that row.
+//!
+//! The index is exact rather than probabilistic: the ledger keeps every
+//! row in memory anyway, and an entry here costs well under half a row.
+
+use std::collections::hash_map::{DefaultHasher, Entry};
+use std::collections::HashMap;
+use std::hash::{BuildHasherDefault, Hasher};
+
+/// Hash a message key; either part may be missing
+pub fn message_key(message_id: Option<&str>, request_id: Option<&str>) -> Option<u64> {
+    if message_id.is_none() && request_id.is_none() {
+        return None;
+    }
+    let mut hasher = DefaultHasher::new();
+    hasher.write(message_id.unwrap_or("").as_bytes());
+    hasher.write_u8(0);
+    hasher.write(request_id.unwrap_or("").as_bytes());
+    Some(hasher.finish())
+}
+
+/// Key for a line whose message has neither id: the line itself, so the
+/// same line read again (a resent or re-read file) is counted once
+pub fn line_key(line: &[u8]) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    hasher.write_u8(1);
+    hasher.write(line);
+    hasher.finish()
+}
+
+/// Keys are hashes already, so they are used as their own hash
+#[derive(Debug, Default)]
+struct KeyHasher(u64);
+
+impl Hasher for KeyHasher {
+    fn finish(&self) -> u64 {
+        self.0
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for &b in bytes {
+            self.0 = self.0.rotate_left(8) ^ b as u64;
+        }
+    }
+
+    fn write_u64(&mut self, n: u64) {
+        self.0 = n;
+    }
+}
+
+/// Row index of every message key seen
+#[derive(Debug, Default)]
+pub struct MessageIndex {
+    rows: HashMap<u64, u32, BuildHasherDefault<KeyHasher>>,
+}
+
+impl MessageIndex {
+    /// Row already holding `key`, or `None` after recording `row` for it
+    pub fn get_or_insert(&mut self, key: u64, row: u32) -> Option<u32> {
+        match self.rows.entry(key) {
+            Entry::Occupied(e) => Some(*e.get()),
+            Entry::Vacant(e) => {
+                e.insert(row);
+                None
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_repeated_keys_find_their_row() {
+        let mut index = MessageIndex::default();
+        let keys: Vec<u64> = (0..100_000)
+            .map(|i| message_key(Some(&format!("msg_{}", i)), Some("req")).unwrap())
+            .collect();
+        for (row, &key) in keys.iter().enumerate() {
+            assert_eq!(index.get_or_insert(key, row as u32), None);
+        }
+        for (row, &key) in keys.iter().enumerate() {
+            assert_eq!(index.get_or_insert(key, u32::MAX), Some(row as u32));
+        }
+        assert_eq!(index.rows.len(), keys.len());
+    }
+}
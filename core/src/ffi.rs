@@ -1,26 +1,596 @@
 //! FFI boundary definitions for C interop
 
+use std::collections::HashSet;
 use std::ffi::{CStr, CString};
 use std::os::raw::c_char;
+use std::path::Path;
 use std::ptr;
 use std::sync::{Arc, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
 
-use crate::api::UsageData;
+use crate::api::{FetchOutcome, UsageData, UsageFetcher};
+use crate::net::{ConnectStats, Family};
+use crate::arrow::{self, ArrowFormat};
 use crate::config::Config;
 use crate::credentials::Credentials;
+use crate::daemon::{self, Client, Request, Response, Settings, Snapshot, Subscriptions};
+use crate::governor::RequestGovernor;
+use crate::history::{UsageHistory, UsageSample};
+use crate::ledger::{self, Ledger, LedgerTotals};
+use crate::metrics::{Demand, Node};
 use crate::monitor::CredentialsMonitor;
+use crate::query::{GroupBy, Metric, Query, QueryCache};
+use crate::remote::RemoteSource;
+use crate::roots::{self, TranscriptRoots};
+use crate::shm::{self, ShmSnapshot, ShmWriter};
 use crate::transcript::ContextInfo;
 
+/// How long a context read waits for slow transcript roots
+const ROOT_SCAN_TIMEOUT: Duration = Duration::from_millis(500);
+
+/// Counters describing fetch activity
+#[derive(Debug, Default)]
+struct FetchStats {
+    requests: u64,
+    published: u64,
+    unchanged: u64,
+}
+
 /// Opaque handle to the Rust core state
 pub struct ClaudeStatusCore {
     credentials: Option<Credentials>,
     config: Config,
     monitor: Option<CredentialsMonitor>,
+    fetcher: UsageFetcher,
+    governor: RequestGovernor,
     last_usage: Option<UsageData>,
+    /// Bumped each time a changed usage response is published
+    usage_generation: u64,
+    /// Time of the last successful fetch, changed or not
+    usage_fetched_at: i64,
+    stats: FetchStats,
+    history: UsageHistory,
     last_context: Option<ContextInfo>,
+    transcripts: TranscriptRoots,
+    /// Shared with the thread ingesting archives
+    ledger: Arc<Mutex<Ledger>>,
+    /// Thread ingesting new archives, while one runs
+    archive_ingest: Option<JoinHandle<()>>,
+    query_cache: QueryCache,
+    /// Metrics someone displays; work for the rest is skipped
+    demand: Demand,
+    /// Shared-memory snapshot, when publishing is enabled
+    shm: Option<ShmWriter>,
+    /// Agent reporting sessions on another machine
+    remote: Option<RemoteSource>,
+    /// Daemon doing the work, when connected to one
+    daemon: Option<DaemonLink>,
     creds_changed: Arc<Mutex<bool>>,
 }
 
+/// Connection of a panel's core to the user daemon
+///
+/// The local core then only keeps settings and a mirror of what the daemon
+/// last reported.
+struct DaemonLink {
+    client: Client,
+    /// Whether the daemon should publish the shared-memory snapshot
+    publish_shm: bool,
+    /// Ledger totals and version
+    totals: Option<(LedgerTotals, u64)>,
+    diagnostics: CDiagnostics,
+}
+
+impl ClaudeStatusCore {
+    /// Copy current values into the shared-memory snapshot, if enabled
+    fn publish_snapshot(&self) {
+        let writer = match &self.shm {
+            Some(w) => w,
+            None => return,
+        };
+
+        let mut snap = ShmSnapshot {
+            updated_at: chrono::Utc::now().timestamp(),
+            turns_to_compact: -1,
+            secs_to_compact: -1,
+            ..Default::default()
+        };
+        if let Some(usage) = &self.last_usage {
+            snap.usage_valid = true;
+            snap.five_hour_pct = usage.five_hour.utilization;
+            snap.seven_day_pct = usage.seven_day.utilization;
+            snap.five_hour_reset_ts = usage.five_hour.resets_at.timestamp();
+            snap.seven_day_reset_ts = usage.seven_day.resets_at.timestamp();
+            snap.usage_generation = self.usage_generation;
+        }
+        if let Some(info) = &self.last_context {
+            snap.context_valid = true;
+            snap.context_pct = info.context_pct;
+            snap.context_tokens = info.context_tokens;
+            snap.context_window_size = info.context_window_size;
+            snap.turns_to_compact = info.forecast.map_or(-1, |f| f.turns);
+            snap.secs_to_compact = info.forecast.and_then(|f| f.secs).unwrap_or(-1);
+            snap.sidechain_tokens = info.sidechain.input_tokens + info.sidechain.output_tokens;
+        }
+        writer.publish(&snap);
+    }
+
+    fn new() -> Self {
+        let config = Config::default();
+        let governor = RequestGovernor::new(config.max_requests_per_hour, Instant::now());
+        ClaudeStatusCore {
+            credentials: None,
+            config,
+            monitor: None,
+            fetcher: UsageFetcher::new(),
+            governor,
+            last_usage: None,
+            usage_generation: 0,
+            usage_fetched_at: 0,
+            stats: FetchStats::default(),
+            history: UsageHistory::default(),
+            last_context: None,
+            transcripts: TranscriptRoots::new(roots::default_roots()),
+            ledger: Arc::new(Mutex::new(Ledger::new())),
+            archive_ingest: None,
+            query_cache: QueryCache::new(),
+            demand: Demand::default(),
+            shm: None,
+            remote: None,
+            daemon: None,
+            creds_changed: Arc::new(Mutex::new(false)),
+        }
+    }
+
+    fn load_credentials(&mut self, path: Option<&str>) -> CResultCode {
+        match crate::credentials::load_credentials(path) {
+            Ok(creds) => {
+                self.credentials = Some(creds);
+                CResultCode::Ok
+            }
+            Err(_) => {
+                self.credentials = None;
+                CResultCode::NoCredentials
+            }
+        }
+    }
+
+    fn fetch_usage(&mut self) -> CResultCode {
+        // Nobody shows limits; don't spend a request on them
+        if !self.demand.needs(Node::Http) {
+            return CResultCode::Ok;
+        }
+
+        let token = match &self.credentials {
+            Some(c) => &c.access_token,
+            None => return CResultCode::NoCredentials,
+        };
+
+        // Every trigger goes through the same budget
+        if !self.governor.try_acquire(Instant::now()) {
+            return CResultCode::Deferred;
+        }
+
+        self.stats.requests += 1;
+        let outcome = self.fetcher.fetch(token);
+        self.publish_usage(outcome)
+    }
+
+    /// Publish a fetched response; an unchanged one only moves freshness
+    fn publish_usage(&mut self, outcome: Result<FetchOutcome, crate::api::ApiError>) -> CResultCode {
+        match outcome {
+            Ok(FetchOutcome::Changed(usage)) => {
+                let now = chrono::Utc::now().timestamp();
+                if self.demand.needs(Node::History) {
+                    self.history.push(UsageSample {
+                        ts: now,
+                        five_hour: usage.five_hour.utilization,
+                        seven_day: usage.seven_day.utilization,
+                    });
+                }
+                self.last_usage = Some(usage);
+                self.usage_generation += 1;
+                self.usage_fetched_at = now;
+                self.stats.published += 1;
+                self.publish_snapshot();
+                CResultCode::Ok
+            }
+            Ok(FetchOutcome::Unchanged) => {
+                // Only freshness moves; readers keep the published snapshot
+                self.usage_fetched_at = chrono::Utc::now().timestamp();
+                self.stats.unchanged += 1;
+                self.publish_snapshot();
+                CResultCode::Ok
+            }
+            Err(crate::api::ApiError::AuthError) => CResultCode::AuthError,
+            Err(crate::api::ApiError::NetworkError(_)) => CResultCode::NetworkError,
+            Err(crate::api::ApiError::ParseError(_)) => CResultCode::ParseError,
+        }
+    }
+
+    fn read_context(&mut self) -> CResultCode {
+        // The scan also lists the files the ledger follows, so it runs when
+        // either context or totals are shown
+        if self.demand.needs(Node::Transcripts) {
+            // Roots that do not answer in time keep their previous result
+            self.transcripts.refresh(ROOT_SCAN_TIMEOUT);
+        }
+        if let Some(remote) = self.remote.as_mut().filter(|_| self.demand.needs(Node::Remote)) {
+            remote.set_rows_wanted(self.demand.needs(Node::Ledger));
+            remote.ensure_running();
+            remote.poll();
+        }
+        if !self.demand.needs(Node::Context) {
+            self.last_context = None;
+            return CResultCode::Ok;
+        }
+        let local = self.transcripts.latest();
+
+        // Whichever session, local or remote, was written to last is current
+        let remote = self.remote.as_ref().and_then(|remote| remote.context());
+        self.last_context = match (local, remote) {
+            (Some(local), Some(remote)) if remote.0 > local.0 => Some(remote.1),
+            (Some(local), _) => Some(local.1),
+            (None, remote) => remote.map(|(_, info)| info),
+        };
+
+        let result = if self.last_context.is_some() {
+            CResultCode::Ok
+        } else {
+            CResultCode::ParseError
+        };
+        self.publish_snapshot();
+        result
+    }
+
+    fn refresh_ledger(&mut self) -> CResultCode {
+        if !self.demand.needs(Node::Ledger) {
+            return CResultCode::Ok;
+        }
+
+        let live_files = self.transcripts.live_files();
+        let archive_root = self
+            .config
+            .archive_dir
+            .as_deref()
+            .map(crate::credentials::expand_path);
+
+        // The first pass over an archive folder can take minutes, so
+        // archives are read on their own thread rather than this one
+        let idle = self.archive_ingest.as_ref().map_or(true, |h| h.is_finished());
+        if let Some(root) = archive_root.filter(|_| idle) {
+            let ledger = Arc::clone(&self.ledger);
+            self.archive_ingest = Some(thread::spawn(move || {
+                ledger::ingest_archives(&ledger, &root);
+            }));
+        }
+
+        let mut ledger = match self.ledger.lock() {
+            Ok(ledger) => ledger,
+            Err(_) => return CResultCode::ParseError,
+        };
+        if let Some(remote) = &self.remote {
+            for (project, row) in remote.take_rows() {
+                ledger.ingest_rows(&project, std::slice::from_ref(&row));
+            }
+        }
+
+        match ledger.refresh(&live_files, None) {
+            Ok(_) => CResultCode::Ok,
+            Err(_) => CResultCode::ParseError,
+        }
+    }
+
+    /// Credentials, usage, context and ledger, in that order
+    fn refresh(&mut self, creds_file: Option<&str>) -> CResultCode {
+        if self.daemon.is_some() {
+            return self.refresh_from_daemon(creds_file);
+        }
+
+        // Credentials are only needed for rate limits
+        let creds = self.load_credentials(creds_file);
+        if creds != CResultCode::Ok && self.demand.needs(Node::Http) {
+            return creds;
+        }
+
+        let result = self.fetch_usage();
+        if result != CResultCode::Ok && result != CResultCode::Deferred {
+            return result;
+        }
+        self.read_context();
+        self.refresh_ledger();
+        result
+    }
+
+    /// Forward a refresh to the daemon and mirror what it reports
+    fn refresh_from_daemon(&mut self, creds_file: Option<&str>) -> CResultCode {
+        let link = match &self.daemon {
+            Some(link) => link,
+            None => return CResultCode::NetworkError,
+        };
+        let metrics = CMetric::ALL
+            .iter()
+            .filter(|m| self.demand.subscribed(m.node()))
+            .fold(0, |bits, m| bits | m.bit());
+        let request = Request::Refresh {
+            settings: Settings {
+                creds_file: creds_file.map(str::to_string),
+                archive_dir: self.config.archive_dir.clone(),
+                transcript_roots: self.config.extra_transcript_roots.clone(),
+                remote_command: self.config.remote_command.clone(),
+                max_requests_per_hour: self.config.max_requests_per_hour,
+                metrics,
+                publish_shm: link.publish_shm,
+            },
+            history_generation: self.history.generation(),
+        };
+
+        // The client already reconnected once; past that the daemon is gone
+        let snap = match link.client.call(&request) {
+            Ok(Response::State(snap)) => *snap,
+            _ => {
+                self.leave_daemon();
+                return self.refresh(creds_file);
+            }
+        };
+
+        // The token stays in the daemon; only the plan is mirrored
+        self.credentials = snap.creds_valid.then(|| Credentials {
+            access_token: String::new(),
+            plan_name: snap.plan_name,
+        });
+        self.last_usage = snap.usage;
+        self.usage_generation = snap.usage_generation;
+        self.usage_fetched_at = snap.usage_fetched_at;
+        if let Some((generation, samples)) = snap.history {
+            self.history.replace(generation, &samples);
+        }
+        self.last_context = snap.context;
+        if let Some(link) = &mut self.daemon {
+            link.totals = snap.totals;
+            link.diagnostics = snap.diagnostics;
+        }
+        CResultCode::from_code(snap.code)
+    }
+
+    /// What a panel reads after a refresh, for the daemon to send back
+    fn snapshot(&self, code: CResultCode, history_generation: u64) -> Snapshot {
+        let generation = self.history.generation();
+        Snapshot {
+            code: code as u8,
+            creds_valid: self.credentials.is_some(),
+            plan_name: self.credentials.as_ref().and_then(|c| c.plan_name.clone()),
+            usage: self.last_usage.clone(),
+            usage_generation: self.usage_generation,
+            usage_fetched_at: self.usage_fetched_at,
+            // The ring only travels when the panel's copy is stale
+            history: (generation != history_generation).then(|| {
+                let samples = (0..self.history.len()).map(|i| self.history.get(i)).collect();
+                (generation, samples)
+            }),
+            context: self.last_context.clone(),
+            totals: self.ledger_totals(),
+            diagnostics: self.diagnostics(),
+        }
+    }
+
+    fn diagnostics(&self) -> CDiagnostics {
+        if let Some(link) = &self.daemon {
+            return link.diagnostics;
+        }
+        let now = Instant::now();
+        CDiagnostics {
+            requests: self.stats.requests,
+            published: self.stats.published,
+            unchanged: self.stats.unchanged,
+            denied: self.governor.denied(),
+            budget_available: self.governor.available(now),
+            budget_capacity: self.governor.capacity(),
+            deferred: self.governor.is_deferred(),
+            retry_after_secs: self.governor.retry_after(now).as_secs_f64().ceil() as u32,
+            ipv4: CConnectStats::from_stats(self.fetcher.connect_stats(Family::V4)),
+            ipv6: CConnectStats::from_stats(self.fetcher.connect_stats(Family::V6)),
+        }
+    }
+
+    /// Totals and version of the ledger, if it has any rows
+    fn ledger_totals(&self) -> Option<(LedgerTotals, u64)> {
+        match &self.daemon {
+            Some(link) => link.totals,
+            None => {
+                let ledger = self.ledger.lock().ok()?;
+                (ledger.len() > 0).then(|| (ledger.totals(), ledger.version()))
+            }
+        }
+    }
+
+    fn export_arrow(&self, dir: &str) -> CResultCode {
+        if let Some(link) = &self.daemon {
+            return match link.client.call(&Request::Export { dir: dir.to_string() }) {
+                Ok(Response::Done(code)) => CResultCode::from_code(code),
+                _ => CResultCode::NetworkError,
+            };
+        }
+
+        let dir = crate::credentials::expand_path(dir);
+        let write = || -> std::io::Result<()> {
+            let create = |name: &str| std::fs::File::create(dir.join(name)).map(std::io::BufWriter::new);
+            arrow::write_history(&self.history, create("usage-history.arrow")?, ArrowFormat::File)?;
+            let ledger = self
+                .ledger
+                .lock()
+                .map_err(|_| std::io::Error::new(std::io::ErrorKind::Other, "ledger poisoned"))?;
+            arrow::write_ledger(&ledger, create("token-ledger.arrow")?, ArrowFormat::File)?;
+            Ok(())
+        };
+        match write() {
+            Ok(()) => CResultCode::Ok,
+            Err(_) => CResultCode::ParseError,
+        }
+    }
+
+    fn connect_daemon(&mut self, path: &Path) -> bool {
+        let client = match Client::connect(path) {
+            Ok(client) => client,
+            Err(_) => return false,
+        };
+        // The daemon scans transcripts and runs the remote agent instead
+        self.transcripts.set_roots(Vec::new());
+        self.remote = None;
+        self.daemon = Some(DaemonLink {
+            client,
+            publish_shm: false,
+            totals: None,
+            diagnostics: CDiagnostics::default(),
+        });
+        true
+    }
+
+    /// Take the work back from a daemon that stopped answering
+    fn leave_daemon(&mut self) {
+        let link = match self.daemon.take() {
+            Some(link) => link,
+            None => return,
+        };
+        // The mirrored credentials carry no token; the next refresh reloads them
+        self.credentials = None;
+        self.set_transcript_roots(self.config.extra_transcript_roots.clone());
+        self.remote = self.config.remote_command.as_deref().and_then(|c| RemoteSource::spawn(c).ok());
+        if link.publish_shm {
+            self.set_shm_enabled(true);
+        }
+    }
+
+    fn set_max_requests_per_hour(&mut self, per_hour: i32) {
+        self.config.max_requests_per_hour = per_hour;
+        self.governor.set_rate(per_hour);
+    }
+
+    fn set_transcript_roots(&mut self, extra: Vec<String>) {
+        if self.daemon.is_none() {
+            let mut all = roots::default_roots();
+            all.extend(extra.iter().map(|p| crate::credentials::expand_path(p)));
+            self.transcripts.set_roots(all);
+        }
+        self.config.extra_transcript_roots = extra;
+    }
+
+    fn set_remote_command(&mut self, command: Option<String>) {
+        if command == self.config.remote_command {
+            return;
+        }
+        if self.daemon.is_none() {
+            self.remote = command.as_deref().and_then(|c| RemoteSource::spawn(c).ok());
+        }
+        self.config.remote_command = command;
+    }
+
+    fn set_shm_enabled(&mut self, enabled: bool) -> bool {
+        // The daemon publishes on behalf of its panels
+        if let Some(link) = &mut self.daemon {
+            link.publish_shm = enabled;
+            return true;
+        }
+
+        // The snapshot carries limits and context, so it keeps them computed
+        if !enabled {
+            if self.shm.take().is_some() {
+                self.demand.unsubscribe(Node::Limits);
+                self.demand.unsubscribe(Node::Context);
+            }
+            return true;
+        }
+        if self.shm.is_none() {
+            self.shm = ShmWriter::create(&shm::default_shm_path()).ok();
+            if self.shm.is_some() {
+                self.demand.subscribe(Node::Limits);
+                self.demand.subscribe(Node::Context);
+            }
+            self.publish_snapshot();
+        }
+        self.shm.is_some()
+    }
+}
+
+/// The core as hosted by the daemon, shared by every connected panel
+///
+/// Each panel sends its settings with every refresh and the last one
+/// wins; subscriptions and the shared-memory request are tracked per panel
+/// and released when it disconnects.
+pub(crate) struct DaemonHost {
+    core: ClaudeStatusCore,
+    subscriptions: Subscriptions,
+    /// Panels asking for the shared-memory snapshot
+    publishers: HashSet<u64>,
+}
+
+impl DaemonHost {
+    pub(crate) fn new() -> Self {
+        DaemonHost {
+            core: ClaudeStatusCore::new(),
+            subscriptions: Subscriptions::default(),
+            publishers: HashSet::new(),
+        }
+    }
+
+    fn apply(&mut self, client: u64, settings: &Settings) {
+        let core = &mut self.core;
+        core.config.archive_dir = settings.archive_dir.clone();
+        // Replacing the roots restarts their workers, so only on change
+        if settings.transcript_roots != core.config.extra_transcript_roots {
+            core.set_transcript_roots(settings.transcript_roots.clone());
+        }
+        core.set_remote_command(settings.remote_command.clone());
+        if settings.max_requests_per_hour != core.config.max_requests_per_hour {
+            core.set_max_requests_per_hour(settings.max_requests_per_hour);
+        }
+
+        let (added, removed) = self.subscriptions.update(client, settings.metrics);
+        for metric in CMetric::ALL {
+            if added & metric.bit() != 0 {
+                core.demand.subscribe(metric.node());
+            }
+            if removed & metric.bit() != 0 {
+                core.demand.unsubscribe(metric.node());
+            }
+        }
+
+        if settings.publish_shm {
+            self.publishers.insert(client);
+        } else {
+            self.publishers.remove(&client);
+        }
+        core.set_shm_enabled(!self.publishers.is_empty());
+    }
+}
+
+impl daemon::Host for DaemonHost {
+    fn handle(&mut self, client: u64, request: Request) -> Response {
+        match request {
+            Request::Refresh {
+                settings,
+                history_generation,
+            } => {
+                self.apply(client, &settings);
+                let code = self.core.refresh(settings.creds_file.as_deref());
+                Response::State(Box::new(self.core.snapshot(code, history_generation)))
+            }
+            Request::Export { dir } => Response::Done(self.core.export_arrow(&dir) as u8),
+        }
+    }
+
+    fn disconnected(&mut self, client: u64) {
+        let bits = self.subscriptions.remove(client);
+        for metric in CMetric::ALL.iter().filter(|m| bits & m.bit() != 0) {
+            self.core.demand.unsubscribe(metric.node());
+        }
+        if self.publishers.remove(&client) {
+            self.core.set_shm_enabled(!self.publishers.is_empty());
+        }
+    }
+}
+
 /// Usage data returned to C
 #[repr(C)]
 pub struct CUsageData {
@@ -32,10 +602,25 @@ pub struct CUsageData {
     pub five_hour_reset_ts: i64,
     /// 7-day reset time as Unix timestamp
     pub seven_day_reset_ts: i64,
+    /// Changes only when a different response is published
+    pub generation: u64,
+    /// Time of the last successful fetch as Unix timestamp
+    pub fetched_at: i64,
     /// Whether the data is valid
     pub valid: bool,
 }
 
+/// Usage history sample returned to C
+#[repr(C)]
+pub struct CUsageSample {
+    /// Fetch time as Unix timestamp
+    pub ts: i64,
+    /// 5-hour utilization percentage (0-100)
+    pub five_hour_pct: f64,
+    /// 7-day utilization percentage (0-100)
+    pub seven_day_pct: f64,
+}
+
 /// Context window info returned to C
 #[repr(C)]
 pub struct CContextInfo {
@@ -47,10 +632,205 @@ pub struct CContextInfo {
     pub context_window_size: i64,
     /// Model name (owned by Rust, valid until next call)
     pub model_name: *const c_char,
+    /// Host of a remote session, null for local (owned by Rust, valid until next call)
+    pub host: *const c_char,
+    /// Predicted assistant turns until auto-compact, -1 if unknown
+    pub turns_to_compact: i64,
+    /// Predicted seconds until auto-compact, -1 if unknown
+    pub secs_to_compact: i64,
+    /// Subagent API messages in this session
+    pub sidechain_messages: i64,
+    /// Subagent input tokens, including cache reads and writes
+    pub sidechain_input_tokens: i64,
+    /// Subagent output tokens
+    pub sidechain_output_tokens: i64,
     /// Whether the data is valid
     pub valid: bool,
 }
 
+/// One point of the context timeline returned to C
+#[repr(C)]
+pub struct CTimelinePoint {
+    /// Peak context tokens within the point's span
+    pub context_tokens: i64,
+    /// Whether the session compacted within the point's span
+    pub compacted: bool,
+}
+
+/// Context taken by one tool, returned to C
+#[repr(C)]
+pub struct CToolShare {
+    /// Tool name (valid until the next call)
+    pub name: *const c_char,
+    /// Calls made in the current context
+    pub calls: i64,
+    /// Serialized size of the tool's inputs and results
+    pub bytes: i64,
+}
+
+/// Token ledger totals returned to C
+#[repr(C)]
+pub struct CLedgerTotals {
+    /// Number of usage rows
+    pub rows: u64,
+    /// Number of distinct sessions
+    pub sessions: u64,
+    pub input_tokens: u64,
+    pub output_tokens: u64,
+    pub cache_creation_tokens: u64,
+    pub cache_read_tokens: u64,
+    /// Changes whenever rows are added
+    pub version: u64,
+    /// Whether the data is valid
+    pub valid: bool,
+}
+
+/// Grouping of a ledger query
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub enum CQueryGroup {
+    GroupTotal = 0,
+    GroupProject = 1,
+    GroupModel = 2,
+    GroupSession = 3,
+    /// Calendar day, UTC
+    GroupDay = 4,
+    /// Weekday and hour, UTC
+    GroupHourOfWeek = 5,
+}
+
+/// Ordering of ledger query results, largest first
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub enum CQueryOrder {
+    /// Chronological for days and hours, by name otherwise
+    OrderNatural = 0,
+    OrderRows = 1,
+    OrderInput = 2,
+    OrderOutput = 3,
+    OrderCacheCreation = 4,
+    OrderCacheRead = 5,
+    /// Input plus cache creation tokens
+    OrderCacheMiss = 6,
+    OrderTotal = 7,
+}
+
+/// Metric a consumer can subscribe to
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub enum CMetric {
+    /// 5-hour and 7-day usage windows; needs the usage API
+    MetricLimits = 0,
+    /// Usage history for the sparkline
+    MetricHistory = 1,
+    /// Current session context; needs the transcript scan
+    MetricContext = 2,
+    /// Long-term ledger totals; needs the transcript scan and ledger refresh
+    MetricSessions = 3,
+}
+
+impl CMetric {
+    const ALL: [CMetric; 4] = [
+        CMetric::MetricLimits,
+        CMetric::MetricHistory,
+        CMetric::MetricContext,
+        CMetric::MetricSessions,
+    ];
+
+    /// Bit of this metric in the daemon's subscription set
+    fn bit(self) -> u8 {
+        1 << self as u8
+    }
+
+    fn node(self) -> Node {
+        match self {
+            CMetric::MetricLimits => Node::Limits,
+            CMetric::MetricHistory => Node::History,
+            CMetric::MetricContext => Node::Context,
+            CMetric::MetricSessions => Node::Sessions,
+        }
+    }
+}
+
+/// Ledger query passed from C
+#[repr(C)]
+pub struct CQuery {
+    /// Start of the range as Unix timestamp, inclusive; 0 for none
+    pub since: i64,
+    /// End of the range as Unix timestamp, exclusive; 0 for none
+    pub until: i64,
+    /// Only rows of this project, null for all
+    pub project: *const c_char,
+    pub group_by: CQueryGroup,
+    pub order_by: CQueryOrder,
+}
+
+/// One group of a ledger query result
+#[repr(C)]
+pub struct CQueryRow {
+    /// Group name, valid until the next query on this thread
+    pub key: *const c_char,
+    pub rows: u64,
+    pub input_tokens: u64,
+    pub output_tokens: u64,
+    pub cache_creation_tokens: u64,
+    pub cache_read_tokens: u64,
+}
+
+/// Connection attempts to one address family
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CConnectStats {
+    /// Connects started to addresses of this family
+    pub attempts: u64,
+    /// Connects that failed or timed out
+    pub failures: u64,
+    /// New connections that went to this family
+    pub wins: u64,
+    /// Duration of the last successful connect in milliseconds
+    pub last_ms: u32,
+    /// Moving average of successful connects in milliseconds
+    pub avg_ms: u32,
+}
+
+impl CConnectStats {
+    fn from_stats(stats: ConnectStats) -> Self {
+        CConnectStats {
+            attempts: stats.attempts,
+            failures: stats.failures,
+            wins: stats.wins,
+            last_ms: stats.last_ms.round() as u32,
+            avg_ms: stats.avg_ms.round() as u32,
+        }
+    }
+}
+
+/// Fetch diagnostics returned to C
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CDiagnostics {
+    /// Usage requests that reached the network
+    pub requests: u64,
+    /// Responses that changed the published usage
+    pub published: u64,
+    /// Responses identical to the previous one, not republished
+    pub unchanged: u64,
+    /// Fetches refused by the request budget
+    pub denied: u64,
+    /// Requests that may currently be made back to back
+    pub budget_available: u32,
+    /// Burst size of the request budget
+    pub budget_capacity: u32,
+    /// Whether a refused fetch is waiting for budget
+    pub deferred: bool,
+    /// Seconds until the budget allows the next fetch
+    pub retry_after_secs: u32,
+    /// Connects to IPv4 addresses
+    pub ipv4: CConnectStats,
+    /// Connects to IPv6 addresses
+    pub ipv6: CConnectStats,
+}
+
 /// Credentials info returned to C
 #[repr(C)]
 pub struct CCredentialsInfo {
@@ -62,6 +842,7 @@ pub struct CCredentialsInfo {
 
 /// Result codes
 #[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq)]
 pub enum CResultCode {
     Ok = 0,
     NoCredentials = 1,
@@ -69,13 +850,33 @@ pub enum CResultCode {
     NetworkError = 3,
     ParseError = 4,
     AuthError = 5,
+    /// Request budget exhausted; retry after `retry_after_secs`
+    Deferred = 6,
+}
+
+impl CResultCode {
+    /// Code received from the daemon; unknown ones read as parse errors
+    fn from_code(code: u8) -> Self {
+        match code {
+            0 => CResultCode::Ok,
+            1 => CResultCode::NoCredentials,
+            2 => CResultCode::InvalidCredentials,
+            3 => CResultCode::NetworkError,
+            5 => CResultCode::AuthError,
+            6 => CResultCode::Deferred,
+            _ => CResultCode::ParseError,
+        }
+    }
 }
 
 // Static storage for strings returned to C
 // These are overwritten on each call, so C code must copy if needed
 thread_local! {
     static MODEL_NAME: std::cell::RefCell<Option<CString>> = std::cell::RefCell::new(None);
+    static HOST_NAME: std::cell::RefCell<Option<CString>> = std::cell::RefCell::new(None);
     static PLAN_NAME: std::cell::RefCell<Option<CString>> = std::cell::RefCell::new(None);
+    static QUERY_KEYS: std::cell::RefCell<Vec<CString>> = std::cell::RefCell::new(Vec::new());
+    static TOOL_NAMES: std::cell::RefCell<Vec<CString>> = std::cell::RefCell::new(Vec::new());
 }
 
 /// Create a new core instance
@@ -84,15 +885,43 @@ thread_local! {
 /// Returns a pointer that must be freed with `claude_status_core_free`
 #[no_mangle]
 pub extern "C" fn claude_status_core_new() -> *mut ClaudeStatusCore {
-    let core = Box::new(ClaudeStatusCore {
-        credentials: None,
-        config: Config::default(),
-        monitor: None,
-        last_usage: None,
-        last_context: None,
-        creds_changed: Arc::new(Mutex::new(false)),
-    });
-    Box::into_raw(core)
+    Box::into_raw(Box::new(ClaudeStatusCore::new()))
+}
+
+/// Hand the core's work to the user daemon
+///
+/// Connects to the daemon socket at `path`, or to
+/// `$XDG_RUNTIME_DIR/claude-status.sock` if null, which fails when
+/// `XDG_RUNTIME_DIR` is unset. Afterwards
+/// `claude_status_core_refresh` and exports run in the daemon and the
+/// getters return what it last reported; settings and subscriptions are
+/// sent along with every refresh. A lost connection is reopened on the
+/// next call; if that fails too, the refresh takes the work back and the
+/// core does it itself from then on. Returns false, leaving the core to do
+/// the work itself, if nothing listens on the socket. Call right after
+/// `claude_status_core_new`.
+///
+/// # Safety
+/// `core` must be valid, `path` must be a valid C string or null
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_connect_daemon(
+    core: *mut ClaudeStatusCore,
+    path: *const c_char,
+) -> bool {
+    let core = match core.as_mut() {
+        Some(c) => c,
+        None => return false,
+    };
+
+    let path = if path.is_null() {
+        match daemon::default_socket_path() {
+            Some(path) => path,
+            None => return false,
+        }
+    } else {
+        crate::credentials::expand_path(&CStr::from_ptr(path).to_string_lossy())
+    };
+    core.connect_daemon(&path)
 }
 
 /// Free the core instance
@@ -129,16 +958,37 @@ pub unsafe extern "C" fn claude_status_core_load_credentials(
         }
     };
 
-    match crate::credentials::load_credentials(path_str.as_deref()) {
-        Ok(creds) => {
-            core.credentials = Some(creds);
-            CResultCode::Ok
-        }
-        Err(_) => {
-            core.credentials = None;
-            CResultCode::NoCredentials
+    core.load_credentials(path_str.as_deref())
+}
+
+/// Reload credentials, fetch usage, read context and refresh the ledger
+///
+/// A missing credentials file only fails the refresh while rate limits are
+/// needed. Returns the result of the usage fetch, which may be `Deferred`.
+/// Runs in the daemon when connected to one.
+///
+/// # Safety
+/// `core` must be valid, `creds_path` must be a valid C string or null for
+/// default
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_refresh(
+    core: *mut ClaudeStatusCore,
+    creds_path: *const c_char,
+) -> CResultCode {
+    let core = match core.as_mut() {
+        Some(c) => c,
+        None => return CResultCode::InvalidCredentials,
+    };
+
+    let creds_path = if creds_path.is_null() {
+        None
+    } else {
+        match CStr::from_ptr(creds_path).to_str() {
+            Ok(s) => Some(s),
+            Err(_) => return CResultCode::InvalidCredentials,
         }
-    }
+    };
+    core.refresh(creds_path)
 }
 
 /// Get credentials info
@@ -190,24 +1040,9 @@ pub unsafe extern "C" fn claude_status_core_get_credentials_info(
 pub unsafe extern "C" fn claude_status_core_fetch_usage(
     core: *mut ClaudeStatusCore,
 ) -> CResultCode {
-    let core = match core.as_mut() {
-        Some(c) => c,
-        None => return CResultCode::InvalidCredentials,
-    };
-
-    let token = match &core.credentials {
-        Some(c) => &c.access_token,
-        None => return CResultCode::NoCredentials,
-    };
-
-    match crate::api::fetch_usage(token) {
-        Ok(usage) => {
-            core.last_usage = Some(usage);
-            CResultCode::Ok
-        }
-        Err(crate::api::ApiError::AuthError) => CResultCode::AuthError,
-        Err(crate::api::ApiError::NetworkError(_)) => CResultCode::NetworkError,
-        Err(crate::api::ApiError::ParseError(_)) => CResultCode::ParseError,
+    match core.as_mut() {
+        Some(core) => core.fetch_usage(),
+        None => CResultCode::InvalidCredentials,
     }
 }
 
@@ -225,6 +1060,8 @@ pub unsafe extern "C" fn claude_status_core_get_usage(core: *const ClaudeStatusC
                 seven_day_pct: 0.0,
                 five_hour_reset_ts: 0,
                 seven_day_reset_ts: 0,
+                generation: 0,
+                fetched_at: 0,
                 valid: false,
             }
         }
@@ -236,6 +1073,8 @@ pub unsafe extern "C" fn claude_status_core_get_usage(core: *const ClaudeStatusC
             seven_day_pct: usage.seven_day.utilization,
             five_hour_reset_ts: usage.five_hour.resets_at.timestamp(),
             seven_day_reset_ts: usage.seven_day.resets_at.timestamp(),
+            generation: core.usage_generation,
+            fetched_at: core.usage_fetched_at,
             valid: true,
         },
         None => CUsageData {
@@ -243,11 +1082,71 @@ pub unsafe extern "C" fn claude_status_core_get_usage(core: *const ClaudeStatusC
             seven_day_pct: 0.0,
             five_hour_reset_ts: 0,
             seven_day_reset_ts: 0,
+            generation: 0,
+            fetched_at: 0,
             valid: false,
         },
     }
 }
 
+/// Get fetch diagnostics
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_diagnostics(
+    core: *const ClaudeStatusCore,
+) -> CDiagnostics {
+    core.as_ref().map_or_else(CDiagnostics::default, |core| core.diagnostics())
+}
+
+/// Get the usage history generation
+///
+/// Changes whenever a new sample is recorded, so callers can skip copying
+/// and redrawing while it stays the same.
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_history_generation(
+    core: *const ClaudeStatusCore,
+) -> u64 {
+    core.as_ref().map_or(0, |c| c.history.generation())
+}
+
+/// Copy the newest usage history samples, oldest first
+///
+/// Writes at most `max_samples` samples and returns the number written.
+///
+/// # Safety
+/// `core` must be valid, `samples` must have room for `max_samples` entries
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_history(
+    core: *const ClaudeStatusCore,
+    samples: *mut CUsageSample,
+    max_samples: usize,
+) -> usize {
+    let core = match core.as_ref() {
+        Some(c) => c,
+        None => return 0,
+    };
+    if samples.is_null() {
+        return 0;
+    }
+
+    let len = core.history.len();
+    let skip = len.saturating_sub(max_samples);
+    for i in skip..len {
+        let sample = core.history.get(i);
+        *samples.add(i - skip) = CUsageSample {
+            ts: sample.ts,
+            five_hour_pct: sample.five_hour,
+            seven_day_pct: sample.seven_day,
+        };
+    }
+    len - skip
+}
+
 /// Read context info from the latest transcript
 ///
 /// # Safety
@@ -256,20 +1155,9 @@ pub unsafe extern "C" fn claude_status_core_get_usage(core: *const ClaudeStatusC
 pub unsafe extern "C" fn claude_status_core_read_context(
     core: *mut ClaudeStatusCore,
 ) -> CResultCode {
-    let core = match core.as_mut() {
-        Some(c) => c,
-        None => return CResultCode::InvalidCredentials,
-    };
-
-    match crate::transcript::read_context() {
-        Ok(info) => {
-            core.last_context = Some(info);
-            CResultCode::Ok
-        }
-        Err(_) => {
-            core.last_context = None;
-            CResultCode::ParseError
-        }
+    match core.as_mut() {
+        Some(core) => core.read_context(),
+        None => CResultCode::InvalidCredentials,
     }
 }
 
@@ -289,6 +1177,12 @@ pub unsafe extern "C" fn claude_status_core_get_context(
                 context_tokens: 0,
                 context_window_size: 0,
                 model_name: ptr::null(),
+                host: ptr::null(),
+                turns_to_compact: -1,
+                secs_to_compact: -1,
+                sidechain_messages: 0,
+                sidechain_input_tokens: 0,
+                sidechain_output_tokens: 0,
                 valid: false,
             }
         }
@@ -304,12 +1198,26 @@ pub unsafe extern "C" fn claude_status_core_get_context(
                     ptr
                 })
             });
+            let host_ptr = info.host.as_ref().map(|host| {
+                HOST_NAME.with(|cell| {
+                    let cstring = CString::new(host.as_str()).unwrap_or_default();
+                    let ptr = cstring.as_ptr();
+                    *cell.borrow_mut() = Some(cstring);
+                    ptr
+                })
+            });
 
             CContextInfo {
                 context_pct: info.context_pct,
                 context_tokens: info.context_tokens,
                 context_window_size: info.context_window_size,
                 model_name: model_ptr.unwrap_or(ptr::null()),
+                host: host_ptr.unwrap_or(ptr::null()),
+                turns_to_compact: info.forecast.map_or(-1, |f| f.turns),
+                secs_to_compact: info.forecast.and_then(|f| f.secs).unwrap_or(-1),
+                sidechain_messages: info.sidechain.messages,
+                sidechain_input_tokens: info.sidechain.input_tokens,
+                sidechain_output_tokens: info.sidechain.output_tokens,
                 valid: true,
             }
         }
@@ -318,11 +1226,239 @@ pub unsafe extern "C" fn claude_status_core_get_context(
             context_tokens: 0,
             context_window_size: 0,
             model_name: ptr::null(),
+            host: ptr::null(),
+            turns_to_compact: -1,
+            secs_to_compact: -1,
+            sidechain_messages: 0,
+            sidechain_input_tokens: 0,
+            sidechain_output_tokens: 0,
+            valid: false,
+        },
+    }
+}
+
+/// Copy the context timeline of the last read session, oldest first
+///
+/// Writes at most `max_points` points and returns the number written.
+///
+/// # Safety
+/// `core` must be valid, `points` must have room for `max_points` entries
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_context_timeline(
+    core: *const ClaudeStatusCore,
+    points: *mut CTimelinePoint,
+    max_points: usize,
+) -> usize {
+    let core = match core.as_ref() {
+        Some(c) => c,
+        None => return 0,
+    };
+    if points.is_null() {
+        return 0;
+    }
+
+    let timeline = match &core.last_context {
+        Some(info) => &info.timeline,
+        None => return 0,
+    };
+
+    // Keep the newest points if the caller's buffer is smaller
+    let skip = timeline.len().saturating_sub(max_points);
+    let mut written = 0;
+    for point in &timeline[skip..] {
+        *points.add(written) = CTimelinePoint {
+            context_tokens: point.tokens,
+            compacted: point.compacted,
+        };
+        written += 1;
+    }
+    written
+}
+
+/// Copy the tools taking the most context in the last read session
+///
+/// Writes at most `max_tools` entries, largest first, and returns the
+/// number written. Names stay valid until the next call.
+///
+/// # Safety
+/// `core` must be valid, `tools` must have room for `max_tools` entries
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_context_tools(
+    core: *const ClaudeStatusCore,
+    tools: *mut CToolShare,
+    max_tools: usize,
+) -> usize {
+    let core = match core.as_ref() {
+        Some(c) => c,
+        None => return 0,
+    };
+    if tools.is_null() {
+        return 0;
+    }
+
+    let shares = match &core.last_context {
+        Some(info) => &info.tools[..info.tools.len().min(max_tools)],
+        None => return 0,
+    };
+
+    TOOL_NAMES.with(|names| {
+        let mut names = names.borrow_mut();
+        *names = shares
+            .iter()
+            .map(|t| CString::new(t.name.replace('\0', "")).unwrap_or_default())
+            .collect();
+        for (i, (share, name)) in shares.iter().zip(names.iter()).enumerate() {
+            *tools.add(i) = CToolShare {
+                name: name.as_ptr(),
+                calls: share.calls,
+                bytes: share.bytes,
+            };
+        }
+        names.len()
+    })
+}
+
+/// Ingest new usage rows from live transcripts and the archive directory
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_refresh_ledger(
+    core: *mut ClaudeStatusCore,
+) -> CResultCode {
+    match core.as_mut() {
+        Some(core) => core.refresh_ledger(),
+        None => CResultCode::InvalidCredentials,
+    }
+}
+
+/// Get token totals over the whole ledger
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_get_ledger_totals(
+    core: *const ClaudeStatusCore,
+) -> CLedgerTotals {
+    match core.as_ref().and_then(|c| c.ledger_totals()) {
+        Some((totals, version)) => CLedgerTotals {
+            rows: totals.rows,
+            sessions: totals.sessions,
+            input_tokens: totals.input_tokens,
+            output_tokens: totals.output_tokens,
+            cache_creation_tokens: totals.cache_creation_tokens,
+            cache_read_tokens: totals.cache_read_tokens,
+            version,
+            valid: true,
+        },
+        None => CLedgerTotals {
+            rows: 0,
+            sessions: 0,
+            input_tokens: 0,
+            output_tokens: 0,
+            cache_creation_tokens: 0,
+            cache_read_tokens: 0,
+            version: 0,
             valid: false,
         },
     }
 }
 
+/// Export the usage history and token ledger as Arrow IPC files
+///
+/// Writes `usage-history.arrow` and `token-ledger.arrow` into `dir`.
+///
+/// # Safety
+/// `core` must be valid, `dir` must be a valid C string
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_export_arrow(
+    core: *const ClaudeStatusCore,
+    dir: *const c_char,
+) -> CResultCode {
+    match (core.as_ref(), dir.is_null()) {
+        (Some(core), false) => core.export_arrow(&CStr::from_ptr(dir).to_string_lossy()),
+        _ => CResultCode::ParseError,
+    }
+}
+
+/// Run an aggregation query over the ledger
+///
+/// Writes at most `max_rows` groups and returns the number written.
+/// Results are cached until the ledger changes. Queries run over the local
+/// ledger only, which is empty while connected to the daemon.
+///
+/// # Safety
+/// `core` and `query` must be valid, `rows` must have room for `max_rows`
+/// entries
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_query(
+    core: *mut ClaudeStatusCore,
+    query: *const CQuery,
+    rows: *mut CQueryRow,
+    max_rows: usize,
+) -> usize {
+    let (core, query) = match (core.as_mut(), query.as_ref()) {
+        (Some(c), Some(q)) => (c, q),
+        _ => return 0,
+    };
+    if rows.is_null() || max_rows == 0 {
+        return 0;
+    }
+
+    let query = Query {
+        since: Some(query.since).filter(|&t| t != 0),
+        until: Some(query.until).filter(|&t| t != 0),
+        project: if query.project.is_null() {
+            None
+        } else {
+            CStr::from_ptr(query.project).to_str().ok().map(|s| s.to_string())
+        },
+        group_by: match query.group_by {
+            CQueryGroup::GroupTotal => GroupBy::Total,
+            CQueryGroup::GroupProject => GroupBy::Project,
+            CQueryGroup::GroupModel => GroupBy::Model,
+            CQueryGroup::GroupSession => GroupBy::Session,
+            CQueryGroup::GroupDay => GroupBy::Day,
+            CQueryGroup::GroupHourOfWeek => GroupBy::HourOfWeek,
+        },
+        order_by: match query.order_by {
+            CQueryOrder::OrderNatural => None,
+            CQueryOrder::OrderRows => Some(Metric::Rows),
+            CQueryOrder::OrderInput => Some(Metric::Input),
+            CQueryOrder::OrderOutput => Some(Metric::Output),
+            CQueryOrder::OrderCacheCreation => Some(Metric::CacheCreation),
+            CQueryOrder::OrderCacheRead => Some(Metric::CacheRead),
+            CQueryOrder::OrderCacheMiss => Some(Metric::CacheMiss),
+            CQueryOrder::OrderTotal => Some(Metric::Total),
+        },
+        limit: Some(max_rows),
+    };
+    let result = match core.ledger.lock() {
+        Ok(ledger) => core.query_cache.run(&ledger, &query),
+        Err(_) => return 0,
+    };
+
+    QUERY_KEYS.with(|keys| {
+        let mut keys = keys.borrow_mut();
+        *keys = result
+            .rows
+            .iter()
+            .map(|r| CString::new(r.key.replace('\0', "")).unwrap_or_default())
+            .collect();
+        for (i, (row, key)) in result.rows.iter().zip(keys.iter()).enumerate() {
+            *rows.add(i) = CQueryRow {
+                key: key.as_ptr(),
+                rows: row.sums.rows,
+                input_tokens: row.sums.input,
+                output_tokens: row.sums.output,
+                cache_creation_tokens: row.sums.cache_creation,
+                cache_read_tokens: row.sums.cache_read,
+            };
+        }
+        keys.len()
+    })
+}
+
 /// Start monitoring the credentials file for changes
 ///
 /// # Safety
@@ -446,6 +1582,165 @@ pub unsafe extern "C" fn claude_status_core_set_red_threshold(
     }
 }
 
+/// Set configuration value: hard cap on usage requests per hour
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_set_max_requests_per_hour(
+    core: *mut ClaudeStatusCore,
+    per_hour: i32,
+) {
+    if let Some(core) = core.as_mut() {
+        core.set_max_requests_per_hour(per_hour);
+    }
+}
+
+/// Set configuration value: directory of archived transcripts
+///
+/// Pass null or an empty string to disable archive ingestion.
+///
+/// # Safety
+/// `core` must be valid, `path` must be a valid C string or null
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_set_archive_dir(
+    core: *mut ClaudeStatusCore,
+    path: *const c_char,
+) {
+    if let Some(core) = core.as_mut() {
+        core.config.archive_dir = if path.is_null() {
+            None
+        } else {
+            CStr::from_ptr(path)
+                .to_str()
+                .ok()
+                .filter(|s| !s.is_empty())
+                .map(|s| s.to_string())
+        };
+    }
+}
+
+/// Set additional transcript roots, separated by `:`
+///
+/// Each root is a projects directory like `~/.claude/projects`, e.g. a
+/// devcontainer bind mount. The default directory and the one under
+/// `CLAUDE_CONFIG_DIR` are always scanned. Pass null or an empty string
+/// to scan only those.
+///
+/// # Safety
+/// `core` must be valid, `paths` must be a valid C string or null
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_set_transcript_roots(
+    core: *mut ClaudeStatusCore,
+    paths: *const c_char,
+) {
+    let core = match core.as_mut() {
+        Some(c) => c,
+        None => return,
+    };
+
+    let extra: Vec<String> = if paths.is_null() {
+        Vec::new()
+    } else {
+        CStr::from_ptr(paths)
+            .to_str()
+            .unwrap_or("")
+            .split(':')
+            .map(str::trim)
+            .filter(|s| !s.is_empty())
+            .map(|s| s.to_string())
+            .collect()
+    };
+
+    core.set_transcript_roots(extra);
+}
+
+/// Set the command that starts a remote agent
+///
+/// The command is run through `sh -c`, e.g.
+/// `ssh devbox claude-status-cli agent`. Its sessions are reported
+/// alongside local ones. Pass null or an empty string to disconnect.
+///
+/// # Safety
+/// `core` must be valid, `command` must be a valid C string or null
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_set_remote_command(
+    core: *mut ClaudeStatusCore,
+    command: *const c_char,
+) {
+    let core = match core.as_mut() {
+        Some(c) => c,
+        None => return,
+    };
+
+    let command = if command.is_null() {
+        None
+    } else {
+        CStr::from_ptr(command)
+            .to_str()
+            .ok()
+            .map(str::trim)
+            .filter(|s| !s.is_empty())
+            .map(|s| s.to_string())
+    };
+    core.set_remote_command(command);
+}
+
+/// Enable or disable publishing the shared-memory snapshot
+///
+/// The snapshot lives in `/dev/shm/claude-status-<uid>`; see
+/// `claude_status_shm.h` for the layout and a reader. Returns false if it
+/// could not be created, e.g. because another instance publishes already.
+/// While connected to the daemon, the daemon publishes it and this always
+/// returns true.
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_set_shm_enabled(
+    core: *mut ClaudeStatusCore,
+    enabled: bool,
+) -> bool {
+    match core.as_mut() {
+        Some(core) => core.set_shm_enabled(enabled),
+        None => false,
+    }
+}
+
+/// Subscribe to a metric
+///
+/// Work is only done for metrics with at least one subscriber: without
+/// limits no usage requests are made, and without context or totals the
+/// transcripts are not scanned. Each subscription must be matched by one
+/// call to `claude_status_core_unsubscribe`. May be called while a refresh
+/// runs on another thread.
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_subscribe(
+    core: *const ClaudeStatusCore,
+    metric: CMetric,
+) {
+    if let Some(core) = core.as_ref() {
+        core.demand.subscribe(metric.node());
+    }
+}
+
+/// Drop a subscription made with `claude_status_core_subscribe`
+///
+/// # Safety
+/// `core` must be valid
+#[no_mangle]
+pub unsafe extern "C" fn claude_status_core_unsubscribe(
+    core: *const ClaudeStatusCore,
+    metric: CMetric,
+) {
+    if let Some(core) = core.as_ref() {
+        core.demand.unsubscribe(metric.node());
+    }
+}
+
 /// Get the color code for a percentage value based on thresholds
 /// Returns a static string pointer (do not free)
 ///
@@ -478,3 +1773,38 @@ pub unsafe extern "C" fn claude_status_core_get_color(
 
     color.as_ptr() as *const c_char
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::api::UsagePeriod;
+
+    fn usage(five_hour: f64) -> UsageData {
+        let period = |utilization| UsagePeriod {
+            utilization,
+            resets_at: chrono::Utc::now(),
+        };
+        UsageData {
+            five_hour: period(five_hour),
+            seven_day: period(40.0),
+        }
+    }
+
+    #[test]
+    fn test_unchanged_response_only_moves_freshness() {
+        let mut core = ClaudeStatusCore::new();
+        assert_eq!(core.publish_usage(Ok(FetchOutcome::Changed(usage(12.5)))), CResultCode::Ok);
+        assert_eq!(core.usage_generation, 1);
+
+        core.usage_fetched_at -= 60;
+        let fetched_at = core.usage_fetched_at;
+        assert_eq!(core.publish_usage(Ok(FetchOutcome::Unchanged)), CResultCode::Ok);
+        assert_eq!(core.usage_generation, 1);
+        assert_eq!((core.stats.published, core.stats.unchanged), (1, 1));
+        assert!(core.usage_fetched_at > fetched_at);
+        assert_eq!(core.last_usage.as_ref().unwrap().five_hour.utilization, 12.5);
+
+        assert_eq!(core.publish_usage(Ok(FetchOutcome::Changed(usage(13.0)))), CResultCode::Ok);
+        assert_eq!(core.usage_generation, 2);
+    }
+}
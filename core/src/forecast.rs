@@ -0,0 +1,132 @@
+//! Context growth forecasting
+//!
+//! Fits how fast a session's context grows per assistant turn and predicts
+//! how many turns (and how much wall time) remain before it reaches the
+//! auto-compact threshold. Each observation is O(1) and the state is a
+//! handful of scalars, so it can be kept for every tracked session.
+
+/// Smoothing factor for the per-turn moving averages
+const EWMA_ALPHA: f64 = 0.3;
+
+/// Minimum number of growth samples before a forecast is offered
+const MIN_SAMPLES: u32 = 2;
+
+/// A drop to below this fraction of the previous context is treated as a
+/// compaction (or `/clear`) and restarts the fit
+const RESET_DROP_RATIO: f64 = 0.5;
+
+/// Upper bound on the gap between turns that counts toward the turn pace;
+/// longer pauses are the user stepping away, not the session slowing down
+const MAX_TURN_GAP_SECS: f64 = 600.0;
+
+/// Whether a change in context size looks like a compaction rather than growth
+pub fn is_compaction_drop(prev: i64, tokens: i64) -> bool {
+    (tokens as f64) < prev as f64 * RESET_DROP_RATIO
+}
+
+/// Exponentially weighted moving average
+#[derive(Debug, Clone, Default)]
+struct Ewma {
+    value: f64,
+    samples: u32,
+}
+
+impl Ewma {
+    fn observe(&mut self, x: f64) {
+        if self.samples == 0 {
+            self.value = x;
+        } else {
+            self.value += EWMA_ALPHA * (x - self.value);
+        }
+        self.samples = self.samples.saturating_add(1);
+    }
+}
+
+/// Predicted distance to the compaction threshold
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct ContextForecast {
+    /// Assistant turns until the threshold is reached
+    pub turns: i64,
+    /// Estimated seconds until the threshold is reached, if the turn pace is known
+    pub secs: Option<i64>,
+}
+
+/// Incremental fit of context growth for a single session
+#[derive(Debug, Clone, Default)]
+pub struct GrowthForecast {
+    last_tokens: Option<i64>,
+    last_ts: Option<i64>,
+    tokens_per_turn: Ewma,
+    secs_per_turn: Ewma,
+}
+
+impl GrowthForecast {
+    /// Record the context size of a new assistant turn
+    ///
+    /// `ts` is the turn's timestamp in Unix seconds, when known.
+    pub fn observe(&mut self, tokens: i64, ts: Option<i64>) {
+        if let Some(prev) = self.last_tokens {
+            if is_compaction_drop(prev, tokens) {
+                // Compacted or cleared: growth so far says nothing about what follows
+                *self = GrowthForecast::default();
+            } else {
+                self.tokens_per_turn.observe((tokens - prev).max(0) as f64);
+                if let (Some(prev_ts), Some(ts)) = (self.last_ts, ts) {
+                    let gap = (ts - prev_ts) as f64;
+                    if gap >= 0.0 {
+                        self.secs_per_turn.observe(gap.min(MAX_TURN_GAP_SECS));
+                    }
+                }
+            }
+        }
+
+        self.last_tokens = Some(tokens);
+        if ts.is_some() {
+            self.last_ts = ts;
+        }
+    }
+
+    /// Predict turns and time remaining until `current` reaches `limit`
+    pub fn predict(&self, current: i64, limit: i64) -> Option<ContextForecast> {
+        if self.tokens_per_turn.samples < MIN_SAMPLES || self.tokens_per_turn.value < 1.0 {
+            return None;
+        }
+
+        let remaining = (limit - current).max(0) as f64;
+        let turns = (remaining / self.tokens_per_turn.value).ceil() as i64;
+
+        let secs = if self.secs_per_turn.samples >= MIN_SAMPLES {
+            Some((turns as f64 * self.secs_per_turn.value).round() as i64)
+        } else {
+            None
+        };
+
+        Some(ContextForecast { turns, secs })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_steady_growth_forecast() {
+        let mut f = GrowthForecast::default();
+        for i in 0..5 {
+            f.observe(10_000 + i * 5_000, Some(i * 30));
+        }
+        let forecast = f.predict(30_000, 60_000).unwrap();
+        assert_eq!(forecast.turns, 6);
+        assert_eq!(forecast.secs, Some(180));
+    }
+
+    #[test]
+    fn test_compaction_resets_fit() {
+        let mut f = GrowthForecast::default();
+        for i in 0..5 {
+            f.observe(100_000 + i * 10_000, None);
+        }
+        f.observe(20_000, None);
+        assert!(f.predict(20_000, 160_000).is_none());
+    }
+}
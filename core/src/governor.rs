@@ -0,0 +1,131 @@
+//! Request budget for the usage endpoint
+//!
+//! A token bucket shared by every trigger that can cause a usage request:
+//! the timer, auth retries, credential changes and manual refreshes. The
+//! bucket holds a small burst and refills at the configured hourly rate, so
+//! sustained traffic can never exceed that rate however the triggers line up.
+//! A denied request is remembered rather than dropped; all requests denied
+//! while the bucket is empty collapse into one deferred fetch.
+
+use std::time::{Duration, Instant};
+
+/// Default hard cap on usage requests per hour
+pub const DEFAULT_MAX_REQUESTS_PER_HOUR: i32 = 120;
+
+/// Requests that may be made back to back before the hourly rate applies
+const MAX_BURST: f64 = 4.0;
+
+/// Token bucket governing usage requests
+#[derive(Debug)]
+pub struct RequestGovernor {
+    capacity: f64,
+    tokens: f64,
+    refill_per_sec: f64,
+    last_refill: Instant,
+    /// A request was denied and has not been served since
+    deferred: bool,
+    granted: u64,
+    denied: u64,
+}
+
+impl RequestGovernor {
+    pub fn new(per_hour: i32, now: Instant) -> Self {
+        let mut governor = RequestGovernor {
+            capacity: 0.0,
+            tokens: 0.0,
+            refill_per_sec: 0.0,
+            last_refill: now,
+            deferred: false,
+            granted: 0,
+            denied: 0,
+        };
+        governor.set_rate(per_hour);
+        governor.tokens = governor.capacity;
+        governor
+    }
+
+    /// Change the hourly cap, keeping the tokens already earned
+    pub fn set_rate(&mut self, per_hour: i32) {
+        let per_hour = per_hour.max(1) as f64;
+        self.capacity = per_hour.min(MAX_BURST);
+        self.refill_per_sec = per_hour / 3600.0;
+        self.tokens = self.tokens.min(self.capacity);
+    }
+
+    fn refill(&mut self, now: Instant) {
+        let elapsed = now.saturating_duration_since(self.last_refill).as_secs_f64();
+        self.tokens = (self.tokens + elapsed * self.refill_per_sec).min(self.capacity);
+        self.last_refill = now;
+    }
+
+    /// Take one request from the budget; `false` defers it
+    pub fn try_acquire(&mut self, now: Instant) -> bool {
+        self.refill(now);
+        if self.tokens >= 1.0 {
+            self.tokens -= 1.0;
+            self.deferred = false;
+            self.granted += 1;
+            true
+        } else {
+            self.deferred = true;
+            self.denied += 1;
+            false
+        }
+    }
+
+    /// Time until the next request would be granted
+    pub fn retry_after(&self, now: Instant) -> Duration {
+        let elapsed = now.saturating_duration_since(self.last_refill).as_secs_f64();
+        let tokens = self.tokens + elapsed * self.refill_per_sec;
+        if tokens >= 1.0 {
+            Duration::ZERO
+        } else {
+            Duration::from_secs_f64((1.0 - tokens) / self.refill_per_sec)
+        }
+    }
+
+    /// Whole requests available right now
+    pub fn available(&self, now: Instant) -> u32 {
+        let elapsed = now.saturating_duration_since(self.last_refill).as_secs_f64();
+        (self.tokens + elapsed * self.refill_per_sec).min(self.capacity) as u32
+    }
+
+    pub fn capacity(&self) -> u32 {
+        self.capacity as u32
+    }
+
+    pub fn is_deferred(&self) -> bool {
+        self.deferred
+    }
+
+    pub fn denied(&self) -> u64 {
+        self.denied
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_burst_then_hourly_rate() {
+        let start = Instant::now();
+        let mut g = RequestGovernor::new(120, start);
+
+        // A storm of triggers only gets the burst through
+        let granted = (0..50).filter(|_| g.try_acquire(start)).count();
+        assert_eq!(granted, 4);
+        assert!(g.is_deferred());
+        assert_eq!(g.retry_after(start), Duration::from_secs(30));
+
+        // Over an hour of constant pressure the cap holds
+        let mut total = granted;
+        for s in 1..=3600 {
+            if g.try_acquire(start + Duration::from_secs(s)) {
+                total += 1;
+            }
+        }
+        assert!(total <= 120 + 4);
+        assert_eq!(g.granted as usize, total);
+    }
+}
@@ -0,0 +1,116 @@
+//! In-memory history of fetched usage samples
+//!
+//! A fixed-capacity ring stored column by column, so consumers can walk a
+//! single metric without touching the others.
+
+/// Number of samples kept (a little over 8 hours at the default interval)
+pub const HISTORY_CAPACITY: usize = 1024;
+
+/// One fetched usage sample
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct UsageSample {
+    /// Fetch time as Unix timestamp
+    pub ts: i64,
+    pub five_hour: f64,
+    pub seven_day: f64,
+}
+
+/// Ring buffer of usage samples
+#[derive(Debug)]
+pub struct UsageHistory {
+    ts: Vec<i64>,
+    five_hour: Vec<f64>,
+    seven_day: Vec<f64>,
+    /// Index of the next write
+    head: usize,
+    /// Bumped on every push so readers can tell when to redraw
+    generation: u64,
+}
+
+impl Default for UsageHistory {
+    fn default() -> Self {
+        UsageHistory {
+            ts: Vec::with_capacity(HISTORY_CAPACITY),
+            five_hour: Vec::with_capacity(HISTORY_CAPACITY),
+            seven_day: Vec::with_capacity(HISTORY_CAPACITY),
+            head: 0,
+            generation: 0,
+        }
+    }
+}
+
+impl UsageHistory {
+    pub fn push(&mut self, sample: UsageSample) {
+        if self.ts.len() < HISTORY_CAPACITY {
+            self.ts.push(sample.ts);
+            self.five_hour.push(sample.five_hour);
+            self.seven_day.push(sample.seven_day);
+        } else {
+            self.ts[self.head] = sample.ts;
+            self.five_hour[self.head] = sample.five_hour;
+            self.seven_day[self.head] = sample.seven_day;
+        }
+        self.head = (self.head + 1) % HISTORY_CAPACITY;
+        self.generation += 1;
+    }
+
+    pub fn len(&self) -> usize {
+        self.ts.len()
+    }
+
+    pub fn generation(&self) -> u64 {
+        self.generation
+    }
+
+    /// Contiguous runs of (ts, five_hour, seven_day) columns, oldest first
+    pub fn runs(&self) -> Vec<(&[i64], &[f64], &[f64])> {
+        let split = if self.ts.len() < HISTORY_CAPACITY { 0 } else { self.head };
+        [split..self.ts.len(), 0..split]
+            .into_iter()
+            .filter(|r| !r.is_empty())
+            .map(|r| (&self.ts[r.clone()], &self.five_hour[r.clone()], &self.seven_day[r]))
+            .collect()
+    }
+
+    /// Sample `i`, counting from the oldest retained one
+    pub fn get(&self, i: usize) -> UsageSample {
+        let idx = if self.ts.len() < HISTORY_CAPACITY {
+            i
+        } else {
+            (self.head + i) % HISTORY_CAPACITY
+        };
+        UsageSample {
+            ts: self.ts[idx],
+            five_hour: self.five_hour[idx],
+            seven_day: self.seven_day[idx],
+        }
+    }
+
+    /// Replace the contents with `samples`, oldest first, e.g. to mirror
+    /// the history kept by the daemon
+    pub fn replace(&mut self, generation: u64, samples: &[UsageSample]) {
+        *self = UsageHistory::default();
+        let skip = samples.len().saturating_sub(HISTORY_CAPACITY);
+        for sample in &samples[skip..] {
+            self.push(*sample);
+        }
+        self.generation = generation;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_ring_keeps_newest_in_order() {
+        let mut h = UsageHistory::default();
+        for i in 0..(HISTORY_CAPACITY as i64 + 10) {
+            h.push(UsageSample { ts: i, five_hour: i as f64, seven_day: 0.0 });
+        }
+        assert_eq!(h.len(), HISTORY_CAPACITY);
+        assert_eq!(h.get(0).ts, 10);
+        assert_eq!(h.get(HISTORY_CAPACITY - 1).ts, HISTORY_CAPACITY as i64 + 9);
+        assert_eq!(h.generation(), HISTORY_CAPACITY as u64 + 10);
+    }
+}
@@ -0,0 +1,810 @@
+//! Token ledger built from transcript usage rows
+//!
+//! Every assistant message with usage becomes one row. Rows are stored
+//! column by column, with project, session and model names interned, so
+//! aggregations only touch the columns they need.
+//!
+//! Live transcripts are tailed incrementally. Archived transcripts
+//! (`.jsonl.zst`, `.jsonl.gz`) are stream-decompressed and remembered by a
+//! checksum of their decompressed content, so renamed, re-archived or
+//! recompressed copies are not ingested twice. `ingest_archives` reads them
+//! on the caller's thread while other threads keep using the ledger, which
+//! is locked only to add each batch.
+//!
+//! Rows are keyed by message and request id, so the same message seen in
+//! several lines or files is only counted once. The last line seen for a
+//! message wins, as streaming writes the final output count last.
+//!
+//! Rows are also summarized in fixed-size zones (time range and a project
+//! mask) so that queries can skip whole zones without reading them.
+
+use chrono::DateTime;
+use serde::Deserialize;
+use std::collections::hash_map::DefaultHasher;
+use std::collections::{HashMap, HashSet};
+use std::fs::{self, File};
+use std::hash::Hasher;
+use std::io::{self, BufRead, BufReader, Read};
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{sync_channel, SyncSender};
+use std::sync::Mutex;
+use std::thread;
+use std::time::SystemTime;
+use thiserror::Error;
+
+use crate::dedup::{line_key, message_key, MessageIndex};
+use crate::transcript::TailReader;
+
+#[derive(Debug, Error)]
+pub enum LedgerError {
+    #[error("Failed to read transcripts: {0}")]
+    IoError(#[from] io::Error),
+}
+
+/// Rows sent from a worker in one batch
+const BATCH_ROWS: usize = 4096;
+
+/// Batches in flight between workers and the collector
+const CHANNEL_BATCHES: usize = 8;
+
+/// Upper bound on ingestion worker threads
+const MAX_WORKERS: usize = 4;
+
+/// How deep to look below the archive root
+const MAX_ARCHIVE_DEPTH: usize = 4;
+
+/// Rows summarized by one zone
+pub const ZONE_ROWS: usize = 4096;
+
+/// Summary of `ZONE_ROWS` consecutive rows
+#[derive(Debug, Clone, Copy)]
+pub struct Zone {
+    pub min_ts: i64,
+    pub max_ts: i64,
+    /// Bit `project % 64` is set for every project present
+    pub projects: u64,
+}
+
+impl Zone {
+    pub fn project_bit(project: u32) -> u64 {
+        1 << (project % 64)
+    }
+}
+
+/// Read-only view of the ledger's columns
+pub struct Columns<'a> {
+    pub ts: &'a [i64],
+    pub project: &'a [u32],
+    pub session: &'a [u32],
+    pub model: &'a [u32],
+    pub input: &'a [u32],
+    pub output: &'a [u32],
+    pub cache_creation: &'a [u32],
+    pub cache_read: &'a [u32],
+    pub zones: &'a [Zone],
+}
+
+/// Columns holding interned names
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum NameColumn {
+    Project,
+    Session,
+    Model,
+}
+
+/// One usage row as parsed from a transcript line
+#[derive(Debug, Clone)]
+pub struct LedgerRow {
+    /// Hash of message id and request id, or of the whole line if it has
+    /// neither; only rows from older agents come without one
+    pub key: Option<u64>,
+    /// Message time as Unix timestamp
+    pub ts: i64,
+    pub session: String,
+    pub model: Option<String>,
+    pub input_tokens: u32,
+    pub output_tokens: u32,
+    pub cache_creation_tokens: u32,
+    pub cache_read_tokens: u32,
+}
+
+#[derive(Debug, Deserialize)]
+struct UsageLine {
+    #[serde(rename = "type")]
+    entry_type: Option<String>,
+    timestamp: Option<String>,
+    #[serde(rename = "sessionId")]
+    session_id: Option<String>,
+    #[serde(rename = "requestId")]
+    request_id: Option<String>,
+    message: Option<UsageMessage>,
+}
+
+#[derive(Debug, Deserialize)]
+struct UsageMessage {
+    id: Option<String>,
+    model: Option<String>,
+    usage: Option<UsageCounts>,
+}
+
+#[derive(Debug, Deserialize)]
+struct UsageCounts {
+    input_tokens: Option<u64>,
+    output_tokens: Option<u64>,
+    cache_creation_input_tokens: Option<u64>,
+    cache_read_input_tokens: Option<u64>,
+}
+
+fn clamp_u32(n: Option<u64>) -> u32 {
+    n.unwrap_or(0).min(u32::MAX as u64) as u32
+}
+
+/// Parse a transcript line into a usage row, if it carries one
+pub fn parse_row(line: &[u8], default_session: &str) -> Option<LedgerRow> {
+    let entry: UsageLine = serde_json::from_slice(line).ok()?;
+    if entry.entry_type.as_deref() != Some("assistant") {
+        return None;
+    }
+
+    let ts = DateTime::parse_from_rfc3339(entry.timestamp.as_deref()?)
+        .ok()?
+        .timestamp();
+    let message = entry.message?;
+    let usage = message.usage?;
+
+    Some(LedgerRow {
+        key: message_key(message.id.as_deref(), entry.request_id.as_deref())
+            .or_else(|| Some(line_key(line))),
+        ts,
+        session: entry
+            .session_id
+            .unwrap_or_else(|| default_session.to_string()),
+        model: message.model,
+        input_tokens: clamp_u32(usage.input_tokens),
+        output_tokens: clamp_u32(usage.output_tokens),
+        cache_creation_tokens: clamp_u32(usage.cache_creation_input_tokens),
+        cache_read_tokens: clamp_u32(usage.cache_read_input_tokens),
+    })
+}
+
+/// Dictionary of names referenced by id from the columns
+#[derive(Debug, Default)]
+struct Interner {
+    names: Vec<String>,
+    ids: HashMap<String, u32>,
+}
+
+impl Interner {
+    fn intern(&mut self, name: &str) -> u32 {
+        if let Some(&id) = self.ids.get(name) {
+            return id;
+        }
+        let id = self.names.len() as u32;
+        self.names.push(name.to_string());
+        self.ids.insert(name.to_string(), id);
+        id
+    }
+
+    fn len(&self) -> usize {
+        self.names.len()
+    }
+
+    fn get(&self, name: &str) -> Option<u32> {
+        self.ids.get(name).copied()
+    }
+
+    fn name(&self, id: u32) -> &str {
+        &self.names[id as usize]
+    }
+}
+
+/// Token totals over the whole ledger
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct LedgerTotals {
+    pub rows: u64,
+    pub sessions: u64,
+    pub input_tokens: u64,
+    pub output_tokens: u64,
+    pub cache_creation_tokens: u64,
+    pub cache_read_tokens: u64,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Compression {
+    None,
+    Gzip,
+    Zstd,
+}
+
+enum Job {
+    Live { path: PathBuf, tail: TailReader },
+    Archive { path: PathBuf, compression: Compression },
+}
+
+struct Batch {
+    project: String,
+    rows: Vec<LedgerRow>,
+}
+
+enum Msg {
+    Rows(Batch),
+    LiveDone { path: PathBuf, tail: Option<TailReader> },
+    ArchiveDone { path: PathBuf, stamp: Option<(u64, SystemTime)> },
+}
+
+/// Collects parsed rows from one file and ships them in batches
+struct Emitter<'a> {
+    tx: &'a SyncSender<Msg>,
+    project: String,
+    session: String,
+    rows: Vec<LedgerRow>,
+}
+
+impl<'a> Emitter<'a> {
+    fn new(tx: &'a SyncSender<Msg>, path: &Path) -> Self {
+        let project = path
+            .parent()
+            .and_then(|p| p.file_name())
+            .map(|n| n.to_string_lossy().into_owned())
+            .unwrap_or_default();
+        let name = path
+            .file_name()
+            .map(|n| n.to_string_lossy().into_owned())
+            .unwrap_or_default();
+        let session = name.split(".jsonl").next().unwrap_or_default().to_string();
+
+        Emitter {
+            tx,
+            project,
+            session,
+            rows: Vec::new(),
+        }
+    }
+
+    fn line(&mut self, line: &[u8]) {
+        if let Some(row) = parse_row(line, &self.session) {
+            self.rows.push(row);
+            if self.rows.len() >= BATCH_ROWS {
+                self.flush();
+            }
+        }
+    }
+
+    fn flush(&mut self) {
+        if !self.rows.is_empty() {
+            let _ = self.tx.send(Msg::Rows(Batch {
+                project: self.project.clone(),
+                rows: std::mem::take(&mut self.rows),
+            }));
+        }
+    }
+}
+
+fn classify(path: &Path) -> Option<Compression> {
+    let name = path.file_name()?.to_str()?;
+    if name.ends_with(".jsonl") {
+        Some(Compression::None)
+    } else if name.ends_with(".jsonl.gz") {
+        Some(Compression::Gzip)
+    } else if name.ends_with(".jsonl.zst") {
+        Some(Compression::Zstd)
+    } else {
+        None
+    }
+}
+
+fn file_stamp(path: &Path) -> io::Result<(u64, SystemTime)> {
+    let meta = fs::metadata(path)?;
+    Ok((meta.len(), meta.modified()?))
+}
+
+/// Checksum of an archive's decompressed content
+///
+/// A corrupt tail ends the content, as it ends ingestion.
+fn checksum_archive(path: &Path, compression: Compression) -> io::Result<u64> {
+    let mut reader = open_archive(path, compression)?;
+    let mut hasher = DefaultHasher::new();
+    let mut buf = vec![0u8; 64 * 1024];
+    loop {
+        match reader.read(&mut buf) {
+            Ok(0) | Err(_) => break,
+            Ok(n) => hasher.write(&buf[..n]),
+        }
+    }
+    Ok(hasher.finish())
+}
+
+fn open_archive(path: &Path, compression: Compression) -> io::Result<Box<dyn Read>> {
+    let file = File::open(path)?;
+    Ok(match compression {
+        Compression::None => Box::new(file),
+        Compression::Gzip => Box::new(flate2::read::MultiGzDecoder::new(BufReader::new(file))),
+        Compression::Zstd => Box::new(zstd::stream::read::Decoder::new(file)?),
+    })
+}
+
+/// Stream one archive through its decoder
+///
+/// A corrupt or truncated tail ends the file like a partial transcript line
+/// would; rows before it are kept.
+fn ingest_archive(emitter: &mut Emitter, path: &Path, compression: Compression) {
+    let reader = match open_archive(path, compression) {
+        Ok(r) => r,
+        Err(_) => return,
+    };
+    let mut reader = BufReader::new(reader);
+    let mut line = Vec::new();
+    loop {
+        line.clear();
+        match reader.read_until(b'\n', &mut line) {
+            Ok(0) | Err(_) => break,
+            Ok(_) => {
+                if line.last() == Some(&b'\n') {
+                    emitter.line(&line[..line.len() - 1]);
+                }
+            }
+        }
+    }
+}
+
+fn run_job(job: Job, tx: &SyncSender<Msg>, checksums: &Mutex<HashSet<u64>>) {
+    match job {
+        Job::Live { path, mut tail } => {
+            let mut emitter = Emitter::new(tx, &path);
+            let result = match tail.read_appended(&path, |line| emitter.line(line)) {
+                // Shrunk: treat what is there now as a new file
+                Ok(false) => tail.read_appended(&path, |line| emitter.line(line)),
+                other => other,
+            };
+            emitter.flush();
+            let tail = result.ok().map(|_| tail);
+            let _ = tx.send(Msg::LiveDone { path, tail });
+        }
+        Job::Archive { path, compression } => {
+            let stamp = file_stamp(&path).ok();
+            if let Ok(sum) = checksum_archive(&path, compression) {
+                let fresh = checksums.lock().map(|mut set| set.insert(sum)).unwrap_or(false);
+                if fresh {
+                    let mut emitter = Emitter::new(tx, &path);
+                    ingest_archive(&mut emitter, &path, compression);
+                    emitter.flush();
+                }
+            }
+            let _ = tx.send(Msg::ArchiveDone { path, stamp });
+        }
+    }
+}
+
+/// Live transcript files below a projects directory
+pub fn live_files(projects_dir: &Path) -> Vec<PathBuf> {
+    crate::transcript::list_transcripts(projects_dir)
+        .map(|files| files.into_iter().map(|(path, _)| path).collect())
+        .unwrap_or_default()
+}
+
+fn collect_archives(dir: &Path, depth: usize, out: &mut Vec<(PathBuf, Compression)>) {
+    let entries = match fs::read_dir(dir) {
+        Ok(e) => e,
+        Err(_) => return,
+    };
+    for entry in entries.flatten() {
+        let path = entry.path();
+        if path.is_dir() {
+            if depth < MAX_ARCHIVE_DEPTH {
+                collect_archives(&path, depth + 1, out);
+            }
+        } else if let Some(compression) = classify(&path) {
+            out.push((path, compression));
+        }
+    }
+}
+
+/// What `push_row` did with a row
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Pushed {
+    Added,
+    /// Its message was counted before, with other token counts
+    Updated,
+    Repeat,
+}
+
+/// Columnar store of usage rows
+#[derive(Debug, Default)]
+pub struct Ledger {
+    ts: Vec<i64>,
+    project: Vec<u32>,
+    session: Vec<u32>,
+    model: Vec<u32>,
+    input: Vec<u32>,
+    output: Vec<u32>,
+    cache_creation: Vec<u32>,
+    cache_read: Vec<u32>,
+    projects: Interner,
+    sessions: Interner,
+    models: Interner,
+    /// One summary per `ZONE_ROWS` rows, the last one possibly partial
+    zones: Vec<Zone>,
+    /// Bumped whenever rows are added
+    version: u64,
+    /// Tail state of live transcripts
+    live: HashMap<PathBuf, TailReader>,
+    /// Size and mtime of archives already looked at
+    archives_seen: HashMap<PathBuf, (u64, SystemTime)>,
+    /// Content checksums of ingested archives
+    archive_checksums: HashSet<u64>,
+    /// Row of each message key already counted
+    seen: MessageIndex,
+    /// Token sums, kept as rows are added
+    totals: LedgerTotals,
+}
+
+impl Ledger {
+    pub fn new() -> Self {
+        Ledger::default()
+    }
+
+    pub fn len(&self) -> usize {
+        self.ts.len()
+    }
+
+    pub fn version(&self) -> u64 {
+        self.version
+    }
+
+    /// Append a row, or update the row already counted for its message
+    fn push_row(&mut self, project: u32, row: &LedgerRow) -> Pushed {
+        if let Some(key) = row.key {
+            if let Some(idx) = self.seen.get_or_insert(key, self.ts.len() as u32) {
+                return self.update_row(idx as usize, row);
+            }
+        }
+
+        self.ts.push(row.ts);
+        self.project.push(project);
+        self.session.push(self.sessions.intern(&row.session));
+        self.model.push(self.models.intern(row.model.as_deref().unwrap_or("")));
+        self.input.push(row.input_tokens);
+        self.output.push(row.output_tokens);
+        self.cache_creation.push(row.cache_creation_tokens);
+        self.cache_read.push(row.cache_read_tokens);
+        self.totals.rows += 1;
+        self.totals.input_tokens += row.input_tokens as u64;
+        self.totals.output_tokens += row.output_tokens as u64;
+        self.totals.cache_creation_tokens += row.cache_creation_tokens as u64;
+        self.totals.cache_read_tokens += row.cache_read_tokens as u64;
+
+        if self.ts.len() % ZONE_ROWS == 1 {
+            self.zones.push(Zone {
+                min_ts: row.ts,
+                max_ts: row.ts,
+                projects: 0,
+            });
+        }
+        let zone = self.zones.last_mut().unwrap();
+        zone.min_ts = zone.min_ts.min(row.ts);
+        zone.max_ts = zone.max_ts.max(row.ts);
+        zone.projects |= Zone::project_bit(project);
+        Pushed::Added
+    }
+
+    /// Give an earlier row the token counts of a later line of its message
+    fn update_row(&mut self, idx: usize, row: &LedgerRow) -> Pushed {
+        let old = (self.input[idx], self.output[idx], self.cache_creation[idx], self.cache_read[idx]);
+        let new = (row.input_tokens, row.output_tokens, row.cache_creation_tokens, row.cache_read_tokens);
+        if old == new {
+            return Pushed::Repeat;
+        }
+
+        self.input[idx] = new.0;
+        self.output[idx] = new.1;
+        self.cache_creation[idx] = new.2;
+        self.cache_read[idx] = new.3;
+        let totals = &mut self.totals;
+        totals.input_tokens = totals.input_tokens - old.0 as u64 + new.0 as u64;
+        totals.output_tokens = totals.output_tokens - old.1 as u64 + new.1 as u64;
+        totals.cache_creation_tokens = totals.cache_creation_tokens - old.2 as u64 + new.2 as u64;
+        totals.cache_read_tokens = totals.cache_read_tokens - old.3 as u64 + new.3 as u64;
+        Pushed::Updated
+    }
+
+    /// Push rows of one project; returns the number added
+    fn push_rows(&mut self, project: u32, rows: &[LedgerRow]) -> usize {
+        let mut added = 0;
+        let mut changed = false;
+        for row in rows {
+            match self.push_row(project, row) {
+                Pushed::Added => added += 1,
+                Pushed::Updated => changed = true,
+                Pushed::Repeat => {}
+            }
+        }
+        if added > 0 || changed {
+            self.version += 1;
+        }
+        added
+    }
+
+    pub fn columns(&self) -> Columns<'_> {
+        Columns {
+            ts: &self.ts,
+            project: &self.project,
+            session: &self.session,
+            model: &self.model,
+            input: &self.input,
+            output: &self.output,
+            cache_creation: &self.cache_creation,
+            cache_read: &self.cache_read,
+            zones: &self.zones,
+        }
+    }
+
+    /// Number of distinct names in a column
+    pub fn name_count(&self, column: NameColumn) -> usize {
+        self.interner(column).len()
+    }
+
+    /// Id of a name, if any row uses it
+    pub fn name_id(&self, column: NameColumn, name: &str) -> Option<u32> {
+        self.interner(column).get(name)
+    }
+
+    pub fn name(&self, column: NameColumn, id: u32) -> &str {
+        self.interner(column).name(id)
+    }
+
+    /// All names of a column, indexed by id
+    pub fn names(&self, column: NameColumn) -> &[String] {
+        &self.interner(column).names
+    }
+
+    fn interner(&self, column: NameColumn) -> &Interner {
+        match column {
+            NameColumn::Project => &self.projects,
+            NameColumn::Session => &self.sessions,
+            NameColumn::Model => &self.models,
+        }
+    }
+
+    /// Add rows that were parsed elsewhere, e.g. by a remote agent
+    ///
+    /// Returns the number of rows added after deduplication.
+    pub fn ingest_rows(&mut self, project: &str, rows: &[LedgerRow]) -> usize {
+        let project = self.projects.intern(project);
+        self.push_rows(project, rows)
+    }
+
+    /// Ingest new rows from live transcript files and archives
+    ///
+    /// `live_files` should come from roots that answered their last scan;
+    /// a file on a mount that stopped answering would stall the refresh.
+    /// Files are processed by a small pool of workers that stream rows back
+    /// through a bounded channel, so memory stays bounded regardless of how
+    /// large the archives are. Returns the number of rows added.
+    pub fn refresh(
+        &mut self,
+        live_files: &[PathBuf],
+        archive_root: Option<&Path>,
+    ) -> Result<usize, LedgerError> {
+        let mut jobs = self.live_jobs(live_files);
+        if let Some(root) = archive_root {
+            jobs.extend(self.archive_jobs(root));
+        }
+
+        let checksums = Mutex::new(std::mem::take(&mut self.archive_checksums));
+        let mut added = 0;
+        run_jobs(jobs, &checksums, |msg| added += self.apply(msg));
+        self.archive_checksums = checksums.into_inner().unwrap_or_default();
+        Ok(added)
+    }
+
+    fn live_jobs(&mut self, live_files: &[PathBuf]) -> Vec<Job> {
+        live_files
+            .iter()
+            .map(|path| Job::Live {
+                path: path.clone(),
+                tail: self.live.remove(path).unwrap_or_default(),
+            })
+            .collect()
+    }
+
+    /// Archives below `root` that changed since they were last looked at
+    fn archive_jobs(&self, root: &Path) -> Vec<Job> {
+        let mut archives = Vec::new();
+        collect_archives(root, 0, &mut archives);
+        archives
+            .into_iter()
+            // Unchanged since last look: no need to even checksum it
+            .filter(|(path, _)| {
+                file_stamp(path).map_or(true, |stamp| self.archives_seen.get(path) != Some(&stamp))
+            })
+            .map(|(path, compression)| Job::Archive { path, compression })
+            .collect()
+    }
+
+    /// Take one message from the workers; returns the rows added
+    fn apply(&mut self, msg: Msg) -> usize {
+        match msg {
+            Msg::Rows(batch) => {
+                let project = self.projects.intern(&batch.project);
+                self.push_rows(project, &batch.rows)
+            }
+            Msg::LiveDone { path, tail } => {
+                if let Some(tail) = tail {
+                    self.live.insert(path, tail);
+                }
+                0
+            }
+            Msg::ArchiveDone { path, stamp } => {
+                if let Some(stamp) = stamp {
+                    self.archives_seen.insert(path, stamp);
+                }
+                0
+            }
+        }
+    }
+
+    /// Token sums over the whole ledger
+    pub fn totals(&self) -> LedgerTotals {
+        LedgerTotals {
+            sessions: self.sessions.len() as u64,
+            ..self.totals
+        }
+    }
+}
+
+/// Run `jobs` on a small pool of workers, handing each message they send
+/// to `collect` on the calling thread
+fn run_jobs(jobs: Vec<Job>, checksums: &Mutex<HashSet<u64>>, mut collect: impl FnMut(Msg)) {
+    if jobs.is_empty() {
+        return;
+    }
+    let workers = thread::available_parallelism()
+        .map_or(1, |n| n.get())
+        .min(MAX_WORKERS)
+        .min(jobs.len());
+    let queue = Mutex::new(jobs.into_iter());
+    let (tx, rx) = sync_channel::<Msg>(CHANNEL_BATCHES);
+
+    thread::scope(|scope| {
+        for _ in 0..workers {
+            let tx = tx.clone();
+            let queue = &queue;
+            scope.spawn(move || loop {
+                let job = match queue.lock() {
+                    Ok(mut q) => q.next(),
+                    Err(_) => None,
+                };
+                match job {
+                    Some(job) => run_job(job, &tx, checksums),
+                    None => break,
+                }
+            });
+        }
+        drop(tx);
+
+        for msg in rx {
+            collect(msg);
+        }
+    });
+}
+
+/// Ingest new archives below `root` into a ledger that other threads keep
+/// using meanwhile
+///
+/// Archives are decoded without holding the lock, which is only taken to
+/// add each batch, so the first pass over a large archive folder can run
+/// in the background while refreshes and readers go on. Only one call
+/// should run at a time. Returns the number of rows added.
+pub fn ingest_archives(ledger: &Mutex<Ledger>, root: &Path) -> usize {
+    let (jobs, checksums) = match ledger.lock() {
+        Ok(mut ledger) => (ledger.archive_jobs(root), std::mem::take(&mut ledger.archive_checksums)),
+        Err(_) => return 0,
+    };
+    let checksums = Mutex::new(checksums);
+    let mut added = 0;
+    run_jobs(jobs, &checksums, |msg| {
+        if let Ok(mut ledger) = ledger.lock() {
+            added += ledger.apply(msg);
+        }
+    });
+    if let Ok(mut ledger) = ledger.lock() {
+        ledger.archive_checksums.extend(checksums.into_inner().unwrap_or_default());
+    }
+    added
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    fn transcript(first_id: usize, rows: usize) -> Vec<u8> {
+        let mut out = Vec::new();
+        for i in first_id..first_id + rows {
+            writeln!(
+                out,
+                r#"{{"type":"assistant","timestamp":"2026-01-01T00:00:{:02}Z","sessionId":"s1","requestId":"req_{}","message":{{"id":"msg_{}","model":"claude-test","usage":{{"input_tokens":10,"output_tokens":5}}}}}}"#,
+                i % 60,
+                i,
+                i
+            )
+            .unwrap();
+            writeln!(out, r#"{{"type":"user","message":{{"content":"hi"}}}}"#).unwrap();
+        }
+        out
+    }
+
+    #[test]
+    fn test_archives_ingested_once() {
+        let dir = std::env::temp_dir().join(format!("cs-ledger-{}", std::process::id()));
+        let archive_dir = dir.join("archive").join("proj");
+        fs::create_dir_all(&archive_dir).unwrap();
+
+        let raw = transcript(0, 100);
+        let mut gz = flate2::write::GzEncoder::new(Vec::new(), flate2::Compression::fast());
+        gz.write_all(&raw).unwrap();
+        fs::write(archive_dir.join("a.jsonl.gz"), gz.finish().unwrap()).unwrap();
+        let more = transcript(100, 100);
+        fs::write(archive_dir.join("b.jsonl.zst"), zstd::encode_all(&more[..], 1).unwrap()).unwrap();
+
+        let ledger = Mutex::new(Ledger::new());
+        assert_eq!(ingest_archives(&ledger, &dir), 200);
+        let mut ledger = ledger.into_inner().unwrap();
+        assert_eq!(ledger.totals().output_tokens, 1000);
+        assert_eq!(ledger.archive_checksums.len(), 2);
+
+        // A renamed or recompressed copy has the same content checksum
+        fs::copy(archive_dir.join("a.jsonl.gz"), archive_dir.join("c.jsonl.gz")).unwrap();
+        let mut gz = flate2::write::GzEncoder::new(Vec::new(), flate2::Compression::best());
+        gz.write_all(&raw).unwrap();
+        fs::write(archive_dir.join("e.jsonl.gz"), gz.finish().unwrap()).unwrap();
+        assert_eq!(ledger.refresh(&[], Some(&dir)).unwrap(), 0);
+        assert_eq!(ledger.len(), 200);
+        assert_eq!(ledger.archive_checksums.len(), 2);
+
+        // A resumed session repeats earlier messages in a new file
+        let resumed = transcript(50, 100);
+        fs::write(archive_dir.join("d.jsonl"), &resumed).unwrap();
+        assert_eq!(ledger.refresh(&[], Some(&dir)).unwrap(), 0);
+        assert_eq!(ledger.len(), 200);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_streamed_message_keeps_last_usage() {
+        let line = |output: u32| {
+            format!(
+                r#"{{"type":"assistant","timestamp":"2026-01-01T00:00:00Z","requestId":"req_1","message":{{"id":"msg_1","usage":{{"input_tokens":10,"output_tokens":{}}}}}}}"#,
+                output
+            )
+        };
+        let rows: Vec<LedgerRow> = [1, 1, 240]
+            .iter()
+            .map(|&n| parse_row(line(n).as_bytes(), "s1").unwrap())
+            .collect();
+
+        let mut ledger = Ledger::new();
+        assert_eq!(ledger.ingest_rows("p", &rows[..2]), 1);
+        let version = ledger.version();
+        assert_eq!(ledger.ingest_rows("p", &rows[2..]), 0);
+        assert!(ledger.version() > version);
+        assert_eq!(ledger.len(), 1);
+        assert_eq!(ledger.totals().input_tokens, 10);
+        assert_eq!(ledger.totals().output_tokens, 240);
+        assert_eq!(ledger.columns().output, &[240]);
+    }
+
+    #[test]
+    fn test_resent_keyless_lines_counted_once() {
+        let line = br#"{"type":"assistant","timestamp":"2026-01-01T00:00:00Z","message":{"usage":{"output_tokens":7}}}"#;
+        let row = parse_row(line, "s1").unwrap();
+        assert!(row.key.is_some());
+
+        // An agent that restarts sends its rows again
+        let mut ledger = Ledger::new();
+        assert_eq!(ledger.ingest_rows("host:p", &[row.clone()]), 1);
+        assert_eq!(ledger.ingest_rows("host:p", &[row]), 0);
+        assert_eq!(ledger.totals().output_tokens, 7);
+    }
+}
@@ -1,13 +1,36 @@
 //! Core library for xfce4-claude-status-plugin
 //!
 //! This library provides the business logic for the Claude status panel plugin,
-//! exposed via a C FFI for integration with the XFCE panel.
+//! exposed via a C FFI for integration with the XFCE panel. Tools that
+//! share it, such as `claude-status-cli`, use the public modules directly.
 
 mod credentials;
 mod api;
-mod transcript;
+mod net;
+mod governor;
+mod forecast;
+mod timeline;
+mod tools;
+mod tape;
+mod history;
+mod dedup;
 mod config;
+mod metrics;
 mod monitor;
+mod remote;
 mod ffi;
 
+#[cfg(test)]
+mod oracle;
+
+pub mod agent;
+pub mod arrow;
+pub mod anonymize;
+pub mod daemon;
+pub mod ledger;
+pub mod query;
+pub mod roots;
+pub mod shm;
+pub mod transcript;
+
 pub use ffi::*;
@@ -0,0 +1,129 @@
+//! Demand-driven metric graph
+//!
+//! Everything the core produces is a node whose inputs are either other
+//! metrics or sources that cost I/O: the usage API, the transcript scan,
+//! the remote agent and the ledger refresh. Consumers (the panel, the
+//! shared-memory snapshot) subscribe to the metrics they show, and a
+//! source is only worked on while some subscribed metric depends on it.
+//! A panel that shows only rate limits never touches transcripts, and one
+//! that shows only context never makes a request.
+
+use std::sync::atomic::{AtomicU32, Ordering};
+
+/// Node of the metric graph
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Node {
+    /// Usage API request
+    Http,
+    /// Scan of the local transcript roots
+    Transcripts,
+    /// Agent reporting sessions on another machine
+    Remote,
+    /// Ingest of new rows into the token ledger
+    Ledger,
+    /// 5-hour and 7-day usage windows
+    Limits,
+    /// Usage history behind the sparkline
+    History,
+    /// Context of the current session, with its forecast, timeline and tools
+    Context,
+    /// Long-term totals and queries over the ledger
+    Sessions,
+}
+
+const NODES: usize = 8;
+
+const ALL: [Node; NODES] = [
+    Node::Http,
+    Node::Transcripts,
+    Node::Remote,
+    Node::Ledger,
+    Node::Limits,
+    Node::History,
+    Node::Context,
+    Node::Sessions,
+];
+
+impl Node {
+    /// Nodes this one is computed from
+    fn inputs(self) -> &'static [Node] {
+        match self {
+            Node::Limits => &[Node::Http],
+            Node::History => &[Node::Limits],
+            Node::Context => &[Node::Transcripts, Node::Remote],
+            // The ledger follows the files the transcript scan finds
+            Node::Ledger => &[Node::Transcripts, Node::Remote],
+            Node::Sessions => &[Node::Ledger],
+            Node::Http | Node::Transcripts | Node::Remote => &[],
+        }
+    }
+
+    /// Bit set of this node and everything upstream of it
+    fn closure(self) -> u32 {
+        self.inputs()
+            .iter()
+            .fold(1 << self as u32, |bits, input| bits | input.closure())
+    }
+}
+
+/// Subscriber counts per node
+///
+/// Counts are atomic so the panel can subscribe from its main thread while
+/// a refresh runs on a worker.
+#[derive(Debug, Default)]
+pub struct Demand {
+    subscribers: [AtomicU32; NODES],
+}
+
+impl Demand {
+    pub fn subscribe(&self, node: Node) {
+        self.subscribers[node as usize].fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub fn unsubscribe(&self, node: Node) {
+        let _ = self.subscribers[node as usize].fetch_update(Ordering::Relaxed, Ordering::Relaxed, |n| {
+            n.checked_sub(1)
+        });
+    }
+
+    /// Whether `node` itself has subscribers
+    pub fn subscribed(&self, node: Node) -> bool {
+        self.subscribers[node as usize].load(Ordering::Relaxed) > 0
+    }
+
+    /// Whether any subscribed metric depends on `node`
+    pub fn needs(&self, node: Node) -> bool {
+        ALL.iter()
+            .filter(|n| self.subscribed(**n))
+            .any(|n| n.closure() & (1 << node as u32) != 0)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_only_subscribed_paths_are_needed() {
+        let demand = Demand::default();
+        assert!(ALL.iter().all(|n| !demand.needs(*n)));
+
+        demand.subscribe(Node::History);
+        assert!(demand.needs(Node::Http) && demand.needs(Node::Limits));
+        assert!(!demand.needs(Node::Transcripts) && !demand.needs(Node::Ledger));
+
+        // Totals need the scan and the ledger, but context stays off
+        demand.subscribe(Node::Sessions);
+        assert!(demand.needs(Node::Transcripts) && demand.needs(Node::Ledger));
+        assert!(!demand.needs(Node::Context));
+
+        // Shared by two subscribers; the first to leave keeps it alive
+        demand.subscribe(Node::Sessions);
+        demand.unsubscribe(Node::Sessions);
+        assert!(demand.needs(Node::Ledger));
+        demand.unsubscribe(Node::Sessions);
+        demand.unsubscribe(Node::Sessions);
+        demand.unsubscribe(Node::History);
+        assert!(ALL.iter().all(|n| !demand.needs(*n)));
+    }
+}
@@ -0,0 +1,451 @@
+//! Connection setup for the usage API
+//!
+//! On networks where one address family is broken (typically IPv6 that is
+//! advertised but not routed), trying the resolved addresses one after the
+//! other stalls every new connection for a full connect timeout. This
+//! module caches lookups and races connection attempts as described in
+//! RFC 8305 ("Happy Eyeballs"): families are interleaved, a new attempt
+//! starts every 250 ms or as soon as the previous one fails, and the first
+//! connection to complete wins.
+//!
+//! ureq 2 has no hook for the TCP connect itself, so the race runs inside
+//! its `Resolver` and can only report an address: the winning connection
+//! is closed and ureq connects to that address a second time, without any
+//! racing of its own. To pay that double handshake only once, the winner
+//! is remembered per host and later lookups just put it first, until it
+//! drops out of the resolved addresses or the caller reports a failed
+//! connection. The agent's connection pool keeps connections, so lookups
+//! only happen when a new one is needed.
+//!
+//! `send_all` writes to local sockets without raising SIGPIPE, which the
+//! panel process leaves at its default action of terminating.
+
+use std::collections::HashMap;
+use std::io;
+use std::net::{IpAddr, SocketAddr, TcpStream, ToSocketAddrs};
+use std::os::unix::io::AsRawFd;
+use std::os::unix::net::UnixStream;
+use std::sync::mpsc::{self, RecvTimeoutError};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// How long resolved addresses are reused
+///
+/// getaddrinfo does not report record TTLs, so this is an upper bound
+/// rather than the record's own lifetime.
+pub const DNS_TTL: Duration = Duration::from_secs(300);
+
+/// Delay before starting the next connection attempt (RFC 8305, 5.)
+pub const ATTEMPT_DELAY: Duration = Duration::from_millis(250);
+
+/// Give up on connecting after this long
+pub const CONNECT_TIMEOUT: Duration = Duration::from_secs(10);
+
+/// Weight of the newest sample in the average connect time
+const CONNECT_MS_WEIGHT: f64 = 0.25;
+
+/// Name lookup, replaceable for tests
+pub trait Lookup: Send + Sync {
+    fn lookup(&self, host: &str, port: u16) -> io::Result<Vec<SocketAddr>>;
+}
+
+/// Lookup through the system resolver
+pub struct SystemLookup;
+
+impl Lookup for SystemLookup {
+    fn lookup(&self, host: &str, port: u16) -> io::Result<Vec<SocketAddr>> {
+        Ok((host, port).to_socket_addrs()?.collect())
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Family {
+    V4,
+    V6,
+}
+
+impl Family {
+    fn of(addr: &SocketAddr) -> Family {
+        match addr {
+            SocketAddr::V4(_) => Family::V4,
+            SocketAddr::V6(_) => Family::V6,
+        }
+    }
+
+    fn index(self) -> usize {
+        self as usize
+    }
+}
+
+/// Connection attempts to addresses of one family
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ConnectStats {
+    pub attempts: u64,
+    pub failures: u64,
+    /// Races won by this family
+    pub wins: u64,
+    /// Duration of the last successful connect
+    pub last_ms: f64,
+    /// Moving average of successful connect durations
+    pub avg_ms: f64,
+}
+
+impl ConnectStats {
+    fn record(&mut self, elapsed: Option<Duration>) {
+        self.attempts += 1;
+        let ms = match elapsed {
+            Some(d) => d.as_secs_f64() * 1000.0,
+            None => {
+                self.failures += 1;
+                return;
+            }
+        };
+        self.avg_ms = if self.attempts - self.failures == 1 {
+            ms
+        } else {
+            self.avg_ms + CONNECT_MS_WEIGHT * (ms - self.avg_ms)
+        };
+        self.last_ms = ms;
+    }
+}
+
+struct Cached {
+    addrs: Vec<SocketAddr>,
+    expires: Instant,
+}
+
+/// Caching resolver that races connection attempts
+pub struct HappyEyeballs {
+    lookup: Box<dyn Lookup>,
+    ttl: Duration,
+    attempt_delay: Duration,
+    timeout: Duration,
+    cache: Mutex<HashMap<(String, u16), Cached>>,
+    stats: Arc<Mutex<[ConnectStats; 2]>>,
+    /// Family of the last winning connection, tried first next time
+    preferred: Mutex<Family>,
+    /// Address that won the last race, per host
+    winners: Mutex<HashMap<(String, u16), SocketAddr>>,
+}
+
+impl Default for HappyEyeballs {
+    fn default() -> Self {
+        HappyEyeballs::new(Box::new(SystemLookup), DNS_TTL)
+    }
+}
+
+impl HappyEyeballs {
+    pub fn new(lookup: Box<dyn Lookup>, ttl: Duration) -> Self {
+        HappyEyeballs {
+            lookup,
+            ttl,
+            attempt_delay: ATTEMPT_DELAY,
+            timeout: CONNECT_TIMEOUT,
+            cache: Mutex::new(HashMap::new()),
+            stats: Arc::new(Mutex::new([ConnectStats::default(); 2])),
+            preferred: Mutex::new(Family::V6),
+            winners: Mutex::new(HashMap::new()),
+        }
+    }
+
+    #[cfg(test)]
+    pub fn with_timeouts(mut self, attempt_delay: Duration, timeout: Duration) -> Self {
+        self.attempt_delay = attempt_delay;
+        self.timeout = timeout;
+        self
+    }
+
+    pub fn stats(&self, family: Family) -> ConnectStats {
+        self.stats.lock().unwrap()[family.index()]
+    }
+
+    /// Race again for the next new connection, e.g. after one failed
+    pub fn forget_winners(&self) {
+        self.winners.lock().unwrap().clear();
+    }
+
+    /// Addresses for `host`, from the cache while fresh
+    fn addresses(&self, host: &str, port: u16) -> io::Result<Vec<SocketAddr>> {
+        if let Ok(ip) = host.parse::<IpAddr>() {
+            return Ok(vec![SocketAddr::new(ip, port)]);
+        }
+
+        let key = (host.to_string(), port);
+        let now = Instant::now();
+        if let Some(entry) = self.cache.lock().unwrap().get(&key) {
+            if entry.expires > now {
+                return Ok(entry.addrs.clone());
+            }
+        }
+
+        match self.lookup.lookup(host, port) {
+            Ok(addrs) if !addrs.is_empty() => {
+                let entry = Cached {
+                    addrs: addrs.clone(),
+                    expires: now + self.ttl,
+                };
+                self.cache.lock().unwrap().insert(key, entry);
+                Ok(addrs)
+            }
+            result => {
+                // A resolver hiccup shouldn't take down a known-good host
+                if let Some(entry) = self.cache.lock().unwrap().get(&key) {
+                    return Ok(entry.addrs.clone());
+                }
+                match result {
+                    Err(e) => Err(e),
+                    Ok(_) => Err(io::Error::new(
+                        io::ErrorKind::NotFound,
+                        format!("No addresses for {}", host),
+                    )),
+                }
+            }
+        }
+    }
+
+    /// Interleave families, starting with the preferred one (RFC 8305, 4.)
+    fn order(&self, addrs: &[SocketAddr]) -> Vec<SocketAddr> {
+        let first = *self.preferred.lock().unwrap();
+        let (a, b): (Vec<_>, Vec<_>) =
+            addrs.iter().copied().partition(|addr| Family::of(addr) == first);
+        let mut ordered = Vec::with_capacity(addrs.len());
+        let (mut a, mut b) = (a.into_iter(), b.into_iter());
+        loop {
+            match (a.next(), b.next()) {
+                (None, None) => return ordered,
+                (x, y) => ordered.extend(x.into_iter().chain(y)),
+            }
+        }
+    }
+
+    /// Connect to the first address that answers
+    pub fn connect(&self, host: &str, port: u16) -> io::Result<(TcpStream, SocketAddr)> {
+        let addrs = self.order(&self.addresses(host, port)?);
+        let key = (host.to_string(), port);
+        match self.race(&addrs) {
+            Ok((stream, addr)) => {
+                let family = Family::of(&addr);
+                self.stats.lock().unwrap()[family.index()].wins += 1;
+                *self.preferred.lock().unwrap() = family;
+                self.winners.lock().unwrap().insert(key, addr);
+                Ok((stream, addr))
+            }
+            Err(e) => {
+                // The addresses may have moved; look them up again next time
+                self.winners.lock().unwrap().remove(&key);
+                self.cache.lock().unwrap().remove(&key);
+                Err(e)
+            }
+        }
+    }
+
+    fn race(&self, addrs: &[SocketAddr]) -> io::Result<(TcpStream, SocketAddr)> {
+        let (tx, rx) = mpsc::channel();
+        let deadline = Instant::now() + self.timeout;
+        let mut started = 0;
+        let mut running = 0;
+        let mut last_err = None;
+
+        loop {
+            if started < addrs.len() {
+                let addr = addrs[started];
+                let tx = tx.clone();
+                let stats = Arc::clone(&self.stats);
+                let timeout = deadline.saturating_duration_since(Instant::now());
+                thread::spawn(move || {
+                    let begin = Instant::now();
+                    let result = TcpStream::connect_timeout(&addr, timeout.max(Duration::from_millis(1)));
+                    let elapsed = result.as_ref().ok().map(|_| begin.elapsed());
+                    stats.lock().unwrap()[Family::of(&addr).index()].record(elapsed);
+                    // The race may be over already; losers just close
+                    let _ = tx.send((addr, result));
+                });
+                started += 1;
+                running += 1;
+            }
+
+            let next_start = if started < addrs.len() {
+                (Instant::now() + self.attempt_delay).min(deadline)
+            } else {
+                deadline
+            };
+            loop {
+                match rx.recv_timeout(next_start.saturating_duration_since(Instant::now())) {
+                    Ok((addr, Ok(stream))) => return Ok((stream, addr)),
+                    Ok((_, Err(e))) => {
+                        running -= 1;
+                        last_err = Some(e);
+                        if started < addrs.len() {
+                            break;
+                        }
+                        if running == 0 {
+                            return Err(last_err.unwrap());
+                        }
+                    }
+                    Err(RecvTimeoutError::Timeout) if Instant::now() < deadline => break,
+                    Err(_) => {
+                        return Err(last_err.unwrap_or_else(|| {
+                            io::Error::new(io::ErrorKind::TimedOut, "Connection timed out")
+                        }))
+                    }
+                }
+            }
+        }
+    }
+
+    /// Resolve `host:port` for ureq, putting the address that connected first
+    ///
+    /// Only races when no winner is remembered for the host; otherwise no
+    /// socket is opened here.
+    pub fn resolve(&self, netloc: &str) -> io::Result<Vec<SocketAddr>> {
+        let (host, port) = netloc
+            .rsplit_once(':')
+            .and_then(|(h, p)| Some((h.trim_start_matches('[').trim_end_matches(']'), p.parse().ok()?)))
+            .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidInput, format!("Invalid address: {}", netloc)))?;
+
+        let mut addrs = self.order(&self.addresses(host, port)?);
+        let known = self.winners.lock().unwrap().get(&(host.to_string(), port)).copied();
+        let winner = match known.filter(|w| addrs.contains(w)) {
+            Some(winner) => winner,
+            None => self.connect(host, port)?.1,
+        };
+        addrs.retain(|a| *a != winner);
+        addrs.insert(0, winner);
+        Ok(addrs)
+    }
+}
+
+/// Write all of `buf` to a socket, failing with `EPIPE` rather than
+/// raising SIGPIPE once the peer has gone
+pub fn send_all(sock: &UnixStream, mut buf: &[u8]) -> io::Result<()> {
+    while !buf.is_empty() {
+        let sent = unsafe {
+            libc::send(
+                sock.as_raw_fd(),
+                buf.as_ptr() as *const libc::c_void,
+                buf.len(),
+                libc::MSG_NOSIGNAL,
+            )
+        };
+        if sent < 0 {
+            let err = io::Error::last_os_error();
+            if err.kind() == io::ErrorKind::Interrupted {
+                continue;
+            }
+            return Err(err);
+        }
+        buf = &buf[sent as usize..];
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::net::{Ipv6Addr, TcpListener};
+    use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    struct Stub {
+        addrs: Vec<SocketAddr>,
+        calls: Arc<AtomicUsize>,
+    }
+
+    impl Lookup for Stub {
+        fn lookup(&self, _host: &str, _port: u16) -> io::Result<Vec<SocketAddr>> {
+            self.calls.fetch_add(1, Ordering::SeqCst);
+            Ok(self.addrs.clone())
+        }
+    }
+
+    /// IPv6 loopback listener whose accept queue is full, so further SYNs
+    /// are dropped and connects hang like on a broken route
+    fn stalled_v6() -> (OwnedFd, SocketAddr, Vec<TcpStream>) {
+        unsafe {
+            let fd = libc::socket(libc::AF_INET6, libc::SOCK_STREAM, 0);
+            assert!(fd >= 0);
+            let fd = OwnedFd::from_raw_fd(fd);
+            let mut sa: libc::sockaddr_in6 = std::mem::zeroed();
+            sa.sin6_family = libc::AF_INET6 as libc::sa_family_t;
+            sa.sin6_addr.s6_addr = Ipv6Addr::LOCALHOST.octets();
+            let len = std::mem::size_of::<libc::sockaddr_in6>() as libc::socklen_t;
+            let raw = fd.as_raw_fd();
+            assert_eq!(libc::bind(raw, &sa as *const _ as *const libc::sockaddr, len), 0);
+            assert_eq!(libc::listen(raw, 0), 0);
+            let mut len = len;
+            libc::getsockname(raw, &mut sa as *mut _ as *mut libc::sockaddr, &mut len);
+            let addr = SocketAddr::new(Ipv6Addr::LOCALHOST.into(), u16::from_be(sa.sin6_port));
+
+            // Fill the queue; connects that no longer complete are the stall
+            let mut held = Vec::new();
+            while let Ok(s) = TcpStream::connect_timeout(&addr, Duration::from_millis(200)) {
+                held.push(s);
+            }
+            (fd, addr, held)
+        }
+    }
+
+    #[test]
+    fn test_falls_back_from_stalled_family_and_caches() {
+        let v4 = TcpListener::bind("127.0.0.1:0").unwrap();
+        let (_v6, v6_addr, _held) = stalled_v6();
+        let calls = Arc::new(AtomicUsize::new(0));
+        let stub = Stub {
+            addrs: vec![v6_addr, v4.local_addr().unwrap()],
+            calls: calls.clone(),
+        };
+        let eyeballs = HappyEyeballs::new(Box::new(stub), Duration::from_secs(60))
+            .with_timeouts(Duration::from_millis(50), Duration::from_secs(5));
+
+        let start = Instant::now();
+        let addrs = eyeballs.resolve("api.example:443").unwrap();
+        assert!(start.elapsed() < Duration::from_secs(2));
+        assert_eq!(addrs[0], v4.local_addr().unwrap());
+        assert_eq!(addrs.len(), 2);
+        assert_eq!(eyeballs.stats(Family::V4).wins, 1);
+        assert_eq!(eyeballs.stats(Family::V4).attempts, 1);
+
+        // The remembered winner is returned without connecting again
+        assert_eq!(eyeballs.resolve("api.example:443").unwrap(), addrs);
+        assert_eq!(eyeballs.stats(Family::V4).attempts, 1);
+
+        // Within the TTL the lookup is not repeated, and IPv4 now goes first
+        let (_, addr) = eyeballs.connect("api.example", 443).unwrap();
+        assert_eq!(addr, v4.local_addr().unwrap());
+        assert_eq!(calls.load(Ordering::SeqCst), 1);
+        assert_eq!(eyeballs.stats(Family::V4).wins, 2);
+
+        // After a failed connection the next lookup races again
+        eyeballs.forget_winners();
+        eyeballs.resolve("api.example:443").unwrap();
+        assert_eq!(eyeballs.stats(Family::V4).wins, 3);
+    }
+
+    #[test]
+    fn test_refused_address_fails_fast_and_expires() {
+        let v4 = TcpListener::bind("127.0.0.1:0").unwrap();
+        let refused = TcpListener::bind("[::1]:0").unwrap().local_addr().unwrap();
+        let calls = Arc::new(AtomicUsize::new(0));
+        let stub = Stub {
+            addrs: vec![v4.local_addr().unwrap(), refused],
+            calls: calls.clone(),
+        };
+        let eyeballs = HappyEyeballs::new(Box::new(stub), Duration::ZERO)
+            .with_timeouts(Duration::from_secs(5), Duration::from_secs(10));
+
+        // The refusal starts the next attempt without waiting for the delay
+        let start = Instant::now();
+        let (_, addr) = eyeballs.connect("api.example", 443).unwrap();
+        assert_eq!(addr, v4.local_addr().unwrap());
+        assert!(start.elapsed() < Duration::from_secs(2));
+
+        // A zero TTL looks the name up again
+        eyeballs.connect("api.example", 443).unwrap();
+        assert_eq!(calls.load(Ordering::SeqCst), 2);
+        let v6 = eyeballs.stats(Family::V6);
+        assert_eq!((v6.attempts, v6.failures, v6.wins), (1, 1, 0));
+        assert_eq!(eyeballs.stats(Family::V4).wins, 2);
+        assert!(eyeballs.stats(Family::V4).avg_ms > 0.0);
+    }
+}
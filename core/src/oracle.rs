@@ -0,0 +1,502 @@
+//! Differential tests for the transcript readers
+//!
+//! `reference_context` reads a whole transcript the way the original
+//! reader did, a buffered line at a time through serde, and is taken as
+//! the definition of the right answer. It shares no parsing code with the
+//! tracker; only the accumulators for forecast, timeline and tools are
+//! reused. Every way the tracker arrives at a `ContextInfo` (incremental
+//! tailing, chunked and partial writes, rewrites, many sessions in one
+//! tracker, the tape JSON backend) is run over generated and mutated
+//! transcripts and must agree with it exactly.
+//!
+//! The generator is seeded, so a failure names the seed that reproduces it.
+//! `CLAUDE_STATUS_ORACLE_CASES` raises the number of cases for longer runs.
+
+use chrono::DateTime;
+use serde::Deserialize;
+use std::collections::HashMap;
+use std::fs::{self, File, OpenOptions};
+use std::io::{BufRead, BufReader, Write};
+use std::path::{Path, PathBuf};
+
+use crate::forecast::{self, GrowthForecast};
+use crate::timeline::ContextTimeline;
+use crate::tools::{ToolUsage, TOP_TOOLS};
+use crate::transcript::{ContextInfo, JsonBackend, SidechainUsage, TranscriptTracker};
+
+/// Cases per property when not overridden
+const DEFAULT_CASES: u64 = 48;
+
+fn cases() -> u64 {
+    std::env::var("CLAUDE_STATUS_ORACLE_CASES")
+        .ok()
+        .and_then(|v| v.parse().ok())
+        .unwrap_or(DEFAULT_CASES)
+}
+
+#[derive(Debug, Deserialize)]
+struct RefEntry {
+    #[serde(rename = "type")]
+    entry_type: Option<String>,
+    subtype: Option<String>,
+    timestamp: Option<String>,
+    #[serde(rename = "isSidechain")]
+    is_sidechain: Option<bool>,
+    message: Option<RefMessage>,
+}
+
+#[derive(Debug, Deserialize)]
+struct RefMessage {
+    id: Option<String>,
+    model: Option<String>,
+    usage: Option<RefUsage>,
+}
+
+#[derive(Debug, Deserialize)]
+struct RefUsage {
+    input_tokens: Option<i64>,
+    output_tokens: Option<i64>,
+    cache_creation_input_tokens: Option<i64>,
+    cache_read_input_tokens: Option<i64>,
+}
+
+/// Context of a whole transcript, read as the original reader did
+///
+/// Lines are split like `BufRead::lines`, so a last line without a newline
+/// is still a line. Unlike the original, a line that is not UTF-8 is
+/// skipped rather than failing the whole read.
+fn reference_context(content: &[u8]) -> ContextInfo {
+    let mut last_input: i64 = 0;
+    let mut last_cache_creation: i64 = 0;
+    let mut last_cache_read: i64 = 0;
+    let mut last_model: Option<String> = None;
+    let mut last_id: Option<String> = None;
+    let mut forecast = GrowthForecast::default();
+    let mut timeline = ContextTimeline::default();
+    let mut tools = ToolUsage::default();
+    let mut sidechain = SidechainUsage::default();
+    let mut sidechain_ids: HashMap<String, SidechainUsage> = HashMap::new();
+
+    let mut reader = BufReader::new(content);
+    let mut buf = Vec::new();
+    loop {
+        buf.clear();
+        if reader.read_until(b'\n', &mut buf).unwrap() == 0 {
+            break;
+        }
+        let mut line = &buf[..];
+        if let Some(rest) = line.strip_suffix(b"\n") {
+            line = rest.strip_suffix(b"\r").unwrap_or(rest);
+        }
+        if line.is_empty() {
+            continue;
+        }
+
+        tools.scan_line(line);
+        let entry: RefEntry = match serde_json::from_slice(line) {
+            Ok(entry) => entry,
+            Err(_) => continue,
+        };
+
+        if entry.entry_type.as_deref() == Some("system")
+            && entry.subtype.as_deref() == Some("compact_boundary")
+        {
+            timeline.mark_compaction();
+            tools.reset();
+            continue;
+        }
+        if entry.entry_type.as_deref() != Some("assistant") {
+            continue;
+        }
+        let message = match entry.message {
+            Some(message) => message,
+            None => continue,
+        };
+
+        if entry.is_sidechain == Some(true) {
+            if let Some(usage) = message.usage {
+                let counted = SidechainUsage {
+                    messages: 1,
+                    input_tokens: usage.input_tokens.unwrap_or(0)
+                        + usage.cache_creation_input_tokens.unwrap_or(0)
+                        + usage.cache_read_input_tokens.unwrap_or(0),
+                    output_tokens: usage.output_tokens.unwrap_or(0),
+                };
+                let earlier = match message.id {
+                    Some(id) => sidechain_ids.insert(id, counted),
+                    None => None,
+                };
+                let earlier = earlier.unwrap_or_default();
+                sidechain.messages += counted.messages - earlier.messages;
+                sidechain.input_tokens += counted.input_tokens - earlier.input_tokens;
+                sidechain.output_tokens += counted.output_tokens - earlier.output_tokens;
+            }
+            continue;
+        }
+
+        if let Some(model) = message.model {
+            last_model = Some(model);
+        }
+        if let Some(usage) = message.usage {
+            let prev_total = last_input + last_cache_creation + last_cache_read;
+            last_input = usage.input_tokens.unwrap_or(0);
+            last_cache_creation = usage.cache_creation_input_tokens.unwrap_or(0);
+            last_cache_read = usage.cache_read_input_tokens.unwrap_or(0);
+            let total = last_input + last_cache_creation + last_cache_read;
+
+            if message.id.is_none() || message.id != last_id {
+                if forecast::is_compaction_drop(prev_total, total) {
+                    timeline.mark_compaction();
+                    tools.reset();
+                }
+                let ts = entry
+                    .timestamp
+                    .as_deref()
+                    .and_then(|t| DateTime::parse_from_rfc3339(t).ok())
+                    .map(|t| t.timestamp());
+                forecast.observe(total, ts);
+                timeline.push(total);
+            }
+            last_id = message.id;
+        }
+    }
+
+    let total_context = last_input + last_cache_creation + last_cache_read;
+    let context_window: i64 = 200_000;
+    ContextInfo {
+        context_pct: (total_context as f64 / context_window as f64 * 100.0).min(100.0),
+        context_tokens: total_context,
+        context_window_size: context_window,
+        model_name: last_model,
+        forecast: forecast.predict(total_context, (context_window as f64 * 0.92) as i64),
+        timeline: timeline.points().to_vec(),
+        sidechain,
+        tools: tools.top(TOP_TOOLS),
+        host: None,
+    }
+}
+
+/// Small deterministic generator (xorshift64*)
+struct Rng(u64);
+
+impl Rng {
+    fn new(seed: u64) -> Self {
+        Rng(seed.wrapping_mul(0x9e37_79b9_7f4a_7c15) | 1)
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545_f491_4f6c_dd1d)
+    }
+
+    fn below(&mut self, n: u64) -> u64 {
+        self.next() % n.max(1)
+    }
+
+    fn chance(&mut self, percent: u64) -> bool {
+        self.below(100) < percent
+    }
+}
+
+/// Generates a plausible session, with damage mixed in
+struct TranscriptGen {
+    rng: Rng,
+    context: i64,
+    ts: i64,
+    msg: u64,
+    model: &'static str,
+}
+
+const MODELS: &[&str] = &["claude-opus-4", "claude-sonnet-4", "claude-haiku-4"];
+
+impl TranscriptGen {
+    fn new(seed: u64) -> Self {
+        TranscriptGen {
+            rng: Rng::new(seed),
+            context: 0,
+            ts: 1_767_225_600,
+            msg: 0,
+            model: MODELS[0],
+        }
+    }
+
+    fn timestamp(&mut self) -> String {
+        self.ts += self.rng.below(120) as i64;
+        chrono::DateTime::from_timestamp(self.ts, 0)
+            .unwrap()
+            .to_rfc3339_opts(chrono::SecondsFormat::Millis, true)
+    }
+
+    fn text(&mut self, len: usize) -> String {
+        const WORDS: &[&str] = &["fn", "main", "é", "\\n", "\\\"", "日本", "{", "}", " ", "\\u00e9"];
+        let mut out = String::with_capacity(len);
+        while out.len() < len {
+            out.push_str(WORDS[self.rng.below(WORDS.len() as u64) as usize]);
+        }
+        out
+    }
+
+    fn assistant(&mut self, sidechain: bool, id: Option<String>) -> String {
+        if !sidechain {
+            self.context += self.rng.below(8_000) as i64;
+        }
+        let input = self.rng.below(50) as i64;
+        let creation = self.rng.below(2_000) as i64;
+        let read = (self.context - input - creation).max(0);
+        let output = self.rng.below(4_000);
+        let ts = self.timestamp();
+        let len = self.rng.below(200) as usize;
+        let text = self.text(len);
+        let id = match id {
+            Some(id) => format!(r#""id":"{}","#, id),
+            None => String::new(),
+        };
+        format!(
+            r#"{{"type":"assistant","isSidechain":{},"timestamp":"{}","message":{{{}"model":"{}","content":[{{"type":"text","text":"{}"}}],"usage":{{"input_tokens":{},"output_tokens":{},"cache_creation_input_tokens":{},"cache_read_input_tokens":{}}}}}}}"#,
+            sidechain,
+            ts,
+            id,
+            self.model,
+            text,
+            input,
+            output,
+            creation,
+            read
+        )
+    }
+
+    /// One or more lines for the next event, newline-terminated
+    fn event(&mut self) -> Vec<u8> {
+        let mut out = Vec::new();
+        match self.rng.below(100) {
+            0..=29 => {
+                // A streamed message is written as several lines with one id
+                self.msg += 1;
+                let id = format!("msg_{}", self.msg);
+                for _ in 0..=self.rng.below(3) {
+                    out.extend(self.assistant(false, Some(id.clone())).into_bytes());
+                    out.push(b'\n');
+                }
+            }
+            30..=34 => out.extend(self.assistant(false, None).into_bytes()),
+            35..=44 => {
+                self.msg += 1;
+                let id = format!("msg_{}", self.msg);
+                out.extend(self.assistant(true, Some(id)).into_bytes());
+            }
+            45..=64 => {
+                let len = if self.rng.chance(3) { 300_000 } else { self.rng.below(400) as usize };
+                let ts = self.timestamp();
+                out.extend(
+                    format!(
+                        r#"{{"type":"user","timestamp":"{}","message":{{"role":"user","content":"{}"}}}}"#,
+                        ts,
+                        self.text(len)
+                    )
+                    .into_bytes(),
+                );
+            }
+            65..=67 => {
+                self.context = self.rng.below(20_000) as i64;
+                out.extend(br#"{"type":"system","subtype":"compact_boundary","content":"Conversation compacted"}"#);
+            }
+            68..=70 => self.model = MODELS[self.rng.below(MODELS.len() as u64) as usize],
+            71..=75 => {
+                // Torn write: a prefix of a line, then the next line
+                let line = self.assistant(false, None);
+                let cut = self.rng.below(line.len() as u64) as usize;
+                out.extend(&line.as_bytes()[..cut]);
+            }
+            76..=79 => {
+                // Invalid UTF-8 inside a string
+                let line = self.assistant(false, None);
+                let at = line.find(r#""text":""#).unwrap() + 8;
+                out.extend(&line.as_bytes()[..at]);
+                out.extend([0xff, 0xfe, 0xc3]);
+                out.extend(&line.as_bytes()[at..]);
+            }
+            80..=82 => out.extend(br#"{"type":"assistant","message":{"usage":{"input_tokens":"12"}}}"#),
+            83..=85 => out.extend(br#"{"type":"assistant","message":null}"#),
+            86..=88 => out.extend(b"   "),
+            89..=91 => out.extend(b"\r"),
+            92..=94 => out.extend(br#"{"type":"assistant","extra":{"a":[[[[{"b":[1,2,{"c":null}]}]]]]},"message":{"model":"claude-deep"}}"#),
+            _ => out.extend(b"not json at all"),
+        }
+        if out.last() != Some(&b'\n') {
+            out.push(b'\n');
+        }
+        out
+    }
+
+    fn transcript(&mut self, events: usize) -> Vec<u8> {
+        let mut out = Vec::new();
+        for _ in 0..events {
+            out.extend(self.event());
+        }
+        // Sometimes the writer is caught mid-line
+        if self.rng.chance(30) {
+            let line = self.assistant(false, Some("msg_partial".to_string()));
+            let cut = self.rng.below(line.len() as u64) as usize;
+            out.extend(&line.as_bytes()[..cut]);
+        }
+        out
+    }
+}
+
+struct Scratch(PathBuf);
+
+impl Scratch {
+    fn new(name: &str, seed: u64) -> Self {
+        let dir = std::env::temp_dir().join(format!(
+            "cs-oracle-{}-{}-{}",
+            name,
+            std::process::id(),
+            seed
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+        Scratch(dir)
+    }
+
+    fn file(&self, name: &str) -> PathBuf {
+        self.0.join(name)
+    }
+}
+
+impl Drop for Scratch {
+    fn drop(&mut self) {
+        let _ = fs::remove_dir_all(&self.0);
+    }
+}
+
+fn append(path: &Path, bytes: &[u8]) {
+    OpenOptions::new()
+        .create(true)
+        .append(true)
+        .open(path)
+        .unwrap()
+        .write_all(bytes)
+        .unwrap();
+}
+
+fn assert_agrees(path: &str, seed: u64, got: &ContextInfo, content: &[u8]) {
+    let want = reference_context(content);
+    assert_eq!(
+        got, &want,
+        "{} diverged from the reference (seed {}, {} bytes)",
+        path,
+        seed,
+        content.len()
+    );
+}
+
+#[test]
+fn test_full_read_matches_reference() {
+    for seed in 0..cases() {
+        let scratch = Scratch::new("full", seed);
+        let content = TranscriptGen::new(seed).transcript(60);
+        let path = scratch.file("s.jsonl");
+        fs::write(&path, &content).unwrap();
+
+        let got = TranscriptTracker::new().read_context_from(&path).unwrap();
+        assert_agrees("full read", seed, &got, &content);
+    }
+}
+
+#[test]
+fn test_json_backends_match_reference() {
+    for seed in 0..cases() {
+        let scratch = Scratch::new("backend", seed);
+        let content = TranscriptGen::new(seed).transcript(60);
+        let path = scratch.file("s.jsonl");
+        fs::write(&path, &content).unwrap();
+
+        for backend in [JsonBackend::Serde, JsonBackend::Tape] {
+            let mut tracker = TranscriptTracker::new();
+            tracker.set_json_backend(backend);
+            let got = tracker.read_context_from(&path).unwrap();
+            assert_agrees(&format!("{:?} backend", backend), seed, &got, &content);
+        }
+    }
+}
+
+#[test]
+fn test_chunked_tail_matches_reference() {
+    for seed in 0..cases() {
+        let scratch = Scratch::new("tail", seed);
+        let content = TranscriptGen::new(seed).transcript(60);
+        let path = scratch.file("s.jsonl");
+        File::create(&path).unwrap();
+
+        // Writes land at arbitrary byte boundaries, including inside
+        // UTF-8 sequences and escapes
+        let mut rng = Rng::new(seed ^ 0xdead_beef);
+        let mut tracker = TranscriptTracker::new();
+        let mut written = 0;
+        while written < content.len() {
+            let max = if rng.chance(20) { 4 } else { 4096 };
+            let chunk = 1 + rng.below(max) as usize;
+            let end = (written + chunk).min(content.len());
+            append(&path, &content[written..end]);
+            written = end;
+
+            let got = tracker.read_context_from(&path).unwrap();
+            // The reference re-parses everything, so only spot-check it
+            if written == content.len() || rng.chance(5) {
+                assert_agrees("chunked tail", seed, &got, &content[..written]);
+            }
+        }
+    }
+}
+
+#[test]
+fn test_shrinking_rewrite_matches_reference() {
+    for seed in 0..cases() {
+        let scratch = Scratch::new("rewrite", seed);
+        let path = scratch.file("s.jsonl");
+        let mut tracker = TranscriptTracker::new();
+
+        let first = TranscriptGen::new(seed).transcript(60);
+        fs::write(&path, &first).unwrap();
+        tracker.read_context_from(&path).unwrap();
+
+        // Tailing detects replacement by the file shrinking; a same-size
+        // or larger replacement is indistinguishable from an append
+        let mut second = TranscriptGen::new(seed + 1_000_000).transcript(20);
+        second.truncate(first.len().saturating_sub(1));
+        fs::write(&path, &second).unwrap();
+
+        let got = tracker.read_context_from(&path).unwrap();
+        assert_agrees("rewrite", seed, &got, &second);
+    }
+}
+
+#[test]
+fn test_interleaved_sessions_match_reference() {
+    for seed in 0..cases() / 4 {
+        let scratch = Scratch::new("interleaved", seed);
+        let mut rng = Rng::new(seed);
+        // More sessions than the tracker keeps, so some are evicted and
+        // re-read from the start
+        let mut sessions: Vec<(PathBuf, TranscriptGen, Vec<u8>)> = (0..12)
+            .map(|i| {
+                let path = scratch.file(&format!("s{}.jsonl", i));
+                (path, TranscriptGen::new(seed * 100 + i), Vec::new())
+            })
+            .collect();
+        let mut tracker = TranscriptTracker::new();
+
+        for _ in 0..200 {
+            let i = rng.below(sessions.len() as u64) as usize;
+            let (path, gen, content) = &mut sessions[i];
+            let bytes = gen.event();
+            append(path, &bytes);
+            content.extend(bytes);
+
+            let got = tracker.read_context_from(path).unwrap();
+            assert_agrees("interleaved sessions", seed, &got, content);
+        }
+    }
+}
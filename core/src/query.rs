@@ -0,0 +1,460 @@
+//! Aggregation queries over the token ledger
+//!
+//! A query filters rows by time range and project, groups them by a
+//! name column or a calendar bucket, and sums the token columns. The
+//! ledger's zone summaries let the time and project filters skip whole
+//! zones; zones entirely inside the filter are summed column by column
+//! without per-row checks. Everything else goes through a per-zone key
+//! vector, in which filtered-out rows point at a scratch group, so the
+//! accumulation loop itself has no branches.
+//!
+//! Results are cached by query and invalidated when the ledger version
+//! changes.
+
+use std::sync::Arc;
+
+use chrono::{TimeZone, Utc};
+
+use crate::ledger::{Columns, Ledger, NameColumn, Zone, ZONE_ROWS};
+
+/// Results kept by `QueryCache`
+const CACHE_ENTRIES: usize = 32;
+
+const SECS_PER_DAY: i64 = 86_400;
+const SECS_PER_HOUR: i64 = 3_600;
+
+/// Hour-of-week buckets, Monday 00:00 UTC first
+const HOURS_PER_WEEK: usize = 168;
+
+const WEEKDAYS: [&str; 7] = ["Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"];
+
+/// How rows are grouped
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Hash)]
+pub enum GroupBy {
+    /// A single group over all matching rows
+    #[default]
+    Total,
+    Project,
+    Model,
+    Session,
+    /// Calendar day, UTC
+    Day,
+    /// Weekday and hour, UTC; 168 groups for heatmaps
+    HourOfWeek,
+}
+
+/// Value a result can be ordered by
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum Metric {
+    Rows,
+    Input,
+    Output,
+    CacheCreation,
+    CacheRead,
+    /// Input not served from cache: plain input plus cache writes
+    CacheMiss,
+    /// All tokens
+    Total,
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Eq, Hash)]
+pub struct Query {
+    /// Start of the time range as Unix timestamp, inclusive
+    pub since: Option<i64>,
+    /// End of the time range as Unix timestamp, exclusive
+    pub until: Option<i64>,
+    pub project: Option<String>,
+    pub group_by: GroupBy,
+    /// Largest first; natural group order (time, or name) if unset
+    pub order_by: Option<Metric>,
+    pub limit: Option<usize>,
+}
+
+impl Query {
+    /// Range covering today and the `days - 1` days before it, in UTC
+    ///
+    /// Aligned to midnight so repeated queries during a day share a
+    /// cache entry.
+    pub fn last_days(days: i64, now: i64) -> (Option<i64>, Option<i64>) {
+        let today = now.div_euclid(SECS_PER_DAY) * SECS_PER_DAY;
+        (Some(today - (days - 1) * SECS_PER_DAY), None)
+    }
+}
+
+/// Token sums of one group
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Sums {
+    pub rows: u64,
+    pub input: u64,
+    pub output: u64,
+    pub cache_creation: u64,
+    pub cache_read: u64,
+}
+
+impl Sums {
+    pub fn metric(&self, metric: Metric) -> u64 {
+        match metric {
+            Metric::Rows => self.rows,
+            Metric::Input => self.input,
+            Metric::Output => self.output,
+            Metric::CacheCreation => self.cache_creation,
+            Metric::CacheRead => self.cache_read,
+            Metric::CacheMiss => self.input + self.cache_creation,
+            Metric::Total => self.input + self.output + self.cache_creation + self.cache_read,
+        }
+    }
+}
+
+#[derive(Debug, Clone, PartialEq)]
+pub struct ResultRow {
+    /// Group name: project, model, session, `YYYY-MM-DD` or `Mon 14:00`
+    pub key: String,
+    pub sums: Sums,
+}
+
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct QueryResult {
+    pub rows: Vec<ResultRow>,
+    /// Zones read, and zones skipped by their summaries
+    pub zones_scanned: usize,
+    pub zones_skipped: usize,
+}
+
+/// Per-group sums, one vector per column; the last group collects
+/// filtered-out rows and is discarded
+struct Accumulator {
+    rows: Vec<u64>,
+    input: Vec<u64>,
+    output: Vec<u64>,
+    cache_creation: Vec<u64>,
+    cache_read: Vec<u64>,
+}
+
+impl Accumulator {
+    fn new(groups: usize) -> Self {
+        let zeros = vec![0; groups + 1];
+        Accumulator {
+            rows: zeros.clone(),
+            input: zeros.clone(),
+            output: zeros.clone(),
+            cache_creation: zeros.clone(),
+            cache_read: zeros,
+        }
+    }
+
+    fn groups(&self) -> usize {
+        self.rows.len() - 1
+    }
+
+    fn sums(&self, group: usize) -> Sums {
+        Sums {
+            rows: self.rows[group],
+            input: self.input[group],
+            output: self.output[group],
+            cache_creation: self.cache_creation[group],
+            cache_read: self.cache_read[group],
+        }
+    }
+
+    /// Add a whole range of rows to one group
+    fn add_range(&mut self, cols: &Columns, start: usize, end: usize, group: usize) {
+        let sum = |col: &[u32]| col[start..end].iter().map(|&n| n as u64).sum::<u64>();
+        self.rows[group] += (end - start) as u64;
+        self.input[group] += sum(cols.input);
+        self.output[group] += sum(cols.output);
+        self.cache_creation[group] += sum(cols.cache_creation);
+        self.cache_read[group] += sum(cols.cache_read);
+    }
+
+    /// Add each row in `start..` to the group in `keys`
+    fn add_keyed(&mut self, cols: &Columns, start: usize, keys: &[u32]) {
+        let end = start + keys.len();
+        let rows = cols.input[start..end]
+            .iter()
+            .zip(&cols.output[start..end])
+            .zip(&cols.cache_creation[start..end])
+            .zip(&cols.cache_read[start..end]);
+        for (&key, (((&input, &output), &cache_creation), &cache_read)) in keys.iter().zip(rows) {
+            let g = key as usize;
+            self.rows[g] += 1;
+            self.input[g] += input as u64;
+            self.output[g] += output as u64;
+            self.cache_creation[g] += cache_creation as u64;
+            self.cache_read[g] += cache_read as u64;
+        }
+    }
+}
+
+/// Run a query against the ledger
+pub fn run(ledger: &Ledger, query: &Query) -> QueryResult {
+    let cols = ledger.columns();
+    let since = query.since.unwrap_or(i64::MIN);
+    let until = query.until.unwrap_or(i64::MAX);
+
+    let project = match &query.project {
+        Some(name) => match ledger.name_id(NameColumn::Project, name) {
+            Some(id) => Some(id),
+            None => return QueryResult::default(),
+        },
+        None => None,
+    };
+
+    // Pushdown: only zones that can hold matching rows are read
+    let mut result = QueryResult::default();
+    let mut zones = Vec::new();
+    for (idx, zone) in cols.zones.iter().enumerate() {
+        let in_time = zone.max_ts >= since && zone.min_ts < until;
+        let has_project = project.map_or(true, |p| zone.projects & Zone::project_bit(p) != 0);
+        if in_time && has_project {
+            zones.push(idx);
+        } else {
+            result.zones_skipped += 1;
+        }
+    }
+    result.zones_scanned = zones.len();
+
+    // Day groups are numbered from the first day any selected zone covers
+    let first_day = zones
+        .iter()
+        .map(|&z| cols.zones[z].min_ts.max(since).div_euclid(SECS_PER_DAY))
+        .min()
+        .unwrap_or(0);
+    let last_day = zones
+        .iter()
+        .map(|&z| cols.zones[z].max_ts.min(until.saturating_sub(1)).div_euclid(SECS_PER_DAY))
+        .max()
+        .unwrap_or(0);
+
+    let groups = match query.group_by {
+        GroupBy::Total => 1,
+        GroupBy::Project => ledger.name_count(NameColumn::Project),
+        GroupBy::Model => ledger.name_count(NameColumn::Model),
+        GroupBy::Session => ledger.name_count(NameColumn::Session),
+        GroupBy::Day => (last_day - first_day + 1).max(0) as usize,
+        GroupBy::HourOfWeek => HOURS_PER_WEEK,
+    };
+    let mut acc = Accumulator::new(groups);
+    let scratch = groups as u32;
+    let mut keys = Vec::with_capacity(ZONE_ROWS);
+
+    for idx in zones {
+        let zone = &cols.zones[idx];
+        let start = idx * ZONE_ROWS;
+        let end = (start + ZONE_ROWS).min(cols.ts.len());
+        let whole = zone.min_ts >= since && zone.max_ts < until && project.is_none();
+
+        if whole && query.group_by == GroupBy::Total {
+            acc.add_range(&cols, start, end, 0);
+            continue;
+        }
+
+        keys.clear();
+        keys.extend((start..end).map(|i| group_key(&cols, i, query.group_by, first_day)));
+        if !whole {
+            for (key, i) in keys.iter_mut().zip(start..end) {
+                let ts = cols.ts[i];
+                let keep = ts >= since && ts < until && project.map_or(true, |p| cols.project[i] == p);
+                if !keep {
+                    *key = scratch;
+                }
+            }
+        }
+        acc.add_keyed(&cols, start, &keys);
+    }
+
+    let mut rows: Vec<(usize, Sums)> = (0..acc.groups())
+        .map(|g| (g, acc.sums(g)))
+        .filter(|(_, sums)| sums.rows > 0 || query.group_by == GroupBy::Total)
+        .collect();
+    match query.order_by {
+        Some(metric) => rows.sort_by(|a, b| b.1.metric(metric).cmp(&a.1.metric(metric)).then(a.0.cmp(&b.0))),
+        None => match query.group_by {
+            GroupBy::Project | GroupBy::Model | GroupBy::Session => {
+                rows.sort_by(|a, b| group_name(ledger, query.group_by, a.0, first_day)
+                    .cmp(&group_name(ledger, query.group_by, b.0, first_day)))
+            }
+            _ => {}
+        },
+    }
+    if let Some(limit) = query.limit {
+        rows.truncate(limit);
+    }
+
+    result.rows = rows
+        .into_iter()
+        .map(|(g, sums)| ResultRow {
+            key: group_name(ledger, query.group_by, g, first_day),
+            sums,
+        })
+        .collect();
+    result
+}
+
+fn group_key(cols: &Columns, i: usize, group_by: GroupBy, first_day: i64) -> u32 {
+    match group_by {
+        GroupBy::Total => 0,
+        GroupBy::Project => cols.project[i],
+        GroupBy::Model => cols.model[i],
+        GroupBy::Session => cols.session[i],
+        // Rows outside the range are dropped by the filter, whatever their key
+        GroupBy::Day => (cols.ts[i].div_euclid(SECS_PER_DAY) - first_day).clamp(0, u32::MAX as i64 - 1) as u32,
+        GroupBy::HourOfWeek => hour_of_week(cols.ts[i]) as u32,
+    }
+}
+
+/// Monday 00:00 UTC is 0; the Unix epoch fell on a Thursday
+fn hour_of_week(ts: i64) -> usize {
+    let days = ts.div_euclid(SECS_PER_DAY);
+    let hour = ts.rem_euclid(SECS_PER_DAY) / SECS_PER_HOUR;
+    ((days + 3).rem_euclid(7) * 24 + hour) as usize
+}
+
+fn group_name(ledger: &Ledger, group_by: GroupBy, group: usize, first_day: i64) -> String {
+    match group_by {
+        GroupBy::Total => "total".to_string(),
+        GroupBy::Project => ledger.name(NameColumn::Project, group as u32).to_string(),
+        GroupBy::Model => ledger.name(NameColumn::Model, group as u32).to_string(),
+        GroupBy::Session => ledger.name(NameColumn::Session, group as u32).to_string(),
+        GroupBy::Day => Utc
+            .timestamp_opt((first_day + group as i64) * SECS_PER_DAY, 0)
+            .single()
+            .map(|d| d.format("%Y-%m-%d").to_string())
+            .unwrap_or_default(),
+        GroupBy::HourOfWeek => format!("{} {:02}:00", WEEKDAYS[group / 24], group % 24),
+    }
+}
+
+/// Recent query results, valid for one ledger version
+#[derive(Debug, Default)]
+pub struct QueryCache {
+    version: u64,
+    /// Least recently used first
+    entries: Vec<(Query, Arc<QueryResult>)>,
+}
+
+impl QueryCache {
+    pub fn new() -> Self {
+        QueryCache::default()
+    }
+
+    pub fn run(&mut self, ledger: &Ledger, query: &Query) -> Arc<QueryResult> {
+        if ledger.version() != self.version {
+            self.entries.clear();
+            self.version = ledger.version();
+        }
+
+        if let Some(idx) = self.entries.iter().position(|(q, _)| q == query) {
+            let entry = self.entries.remove(idx);
+            let result = Arc::clone(&entry.1);
+            self.entries.push(entry);
+            return result;
+        }
+
+        let result = Arc::new(run(ledger, query));
+        if self.entries.len() >= CACHE_ENTRIES {
+            self.entries.remove(0);
+        }
+        self.entries.push((query.clone(), Arc::clone(&result)));
+        result
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ledger::LedgerRow;
+
+    fn row(ts: i64, session: &str, model: &str, input: u32) -> LedgerRow {
+        LedgerRow {
+            key: None,
+            ts,
+            session: session.to_string(),
+            model: Some(model.to_string()),
+            input_tokens: input,
+            output_tokens: 1,
+            cache_creation_tokens: 2,
+            cache_read_tokens: 3,
+        }
+    }
+
+    /// Straightforward row-at-a-time evaluation to check the engine against
+    fn naive(ledger: &Ledger, since: i64, until: i64, project: Option<u32>) -> Sums {
+        let cols = ledger.columns();
+        let mut sums = Sums::default();
+        for i in 0..cols.ts.len() {
+            if cols.ts[i] >= since && cols.ts[i] < until && project.map_or(true, |p| cols.project[i] == p) {
+                sums.rows += 1;
+                sums.input += cols.input[i] as u64;
+                sums.output += cols.output[i] as u64;
+                sums.cache_creation += cols.cache_creation[i] as u64;
+                sums.cache_read += cols.cache_read[i] as u64;
+            }
+        }
+        sums
+    }
+
+    #[test]
+    fn test_pushdown_matches_naive_scan() {
+        let mut ledger = Ledger::new();
+        // Three projects, time mostly increasing but with stragglers
+        for i in 0..(3 * ZONE_ROWS as i64 + 100) {
+            let ts = 1_700_000_000 + i * 60 - if i % 97 == 0 { 86_400 } else { 0 };
+            let project = ["a", "b", "c"][(i / 1000 % 3) as usize];
+            ledger.ingest_rows(project, &[row(ts, &format!("s{}", i % 7), "m", (i % 13) as u32)]);
+        }
+        let b = ledger.name_id(NameColumn::Project, "b");
+
+        let since = 1_700_000_000 + 3000 * 60;
+        let until = 1_700_000_000 + 9000 * 60;
+        let query = Query {
+            since: Some(since),
+            until: Some(until),
+            project: Some("b".into()),
+            ..Default::default()
+        };
+        let result = run(&ledger, &query);
+        assert_eq!(result.rows[0].sums, naive(&ledger, since, until, b));
+        assert!(result.zones_skipped > 0);
+
+        let by_day = run(
+            &ledger,
+            &Query {
+                group_by: GroupBy::Day,
+                ..Default::default()
+            },
+        );
+        let rows: u64 = by_day.rows.iter().map(|r| r.sums.rows).sum();
+        assert_eq!(rows, ledger.len() as u64);
+        assert!(by_day.rows.windows(2).all(|w| w[0].key < w[1].key));
+
+        let top = run(
+            &ledger,
+            &Query {
+                group_by: GroupBy::Session,
+                order_by: Some(Metric::CacheMiss),
+                limit: Some(2),
+                ..Default::default()
+            },
+        );
+        assert_eq!(top.rows.len(), 2);
+        assert!(top.rows[0].sums.metric(Metric::CacheMiss) >= top.rows[1].sums.metric(Metric::CacheMiss));
+    }
+
+    #[test]
+    fn test_cache_follows_ledger_version() {
+        let mut ledger = Ledger::new();
+        ledger.ingest_rows("p", &[row(0, "s", "m", 10)]);
+        let mut cache = QueryCache::new();
+        let query = Query {
+            group_by: GroupBy::HourOfWeek,
+            ..Default::default()
+        };
+
+        let first = cache.run(&ledger, &query);
+        assert_eq!(first.rows[0].key, "Thu 00:00");
+        assert!(Arc::ptr_eq(&first, &cache.run(&ledger, &query)));
+
+        ledger.ingest_rows("p", &[row(3600, "s", "m", 10)]);
+        assert_eq!(cache.run(&ledger, &query).rows.len(), 2);
+    }
+}
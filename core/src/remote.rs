@@ -0,0 +1,362 @@
+//! Local end of a remote agent connection
+//!
+//! Runs a command such as `ssh devbox claude-status-cli agent` and folds
+//! the agent's updates (see `agent`) into state the core can pick up: the
+//! remote session's context and the ledger rows it has not seen yet.
+//!
+//! Rows are never dropped to save memory. Once enough are waiting, the
+//! reader stops reading until the ledger takes them, which holds up the
+//! agent's writes in turn. Every row carries a key, so the ledger drops
+//! whatever a restarted agent sends again.
+
+use std::io::{BufRead, BufReader, Read};
+use std::os::unix::net::UnixStream;
+use std::process::{Child, Command, Stdio};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use crate::agent::{self, AgentMsg, PROTOCOL_VERSION};
+use crate::ledger::LedgerRow;
+use crate::net;
+use crate::transcript::ContextInfo;
+
+/// Minimum time between attempts to restart a command that exited
+const RESPAWN_INTERVAL: Duration = Duration::from_secs(60);
+
+/// Rows held for the ledger before the agent is made to wait
+const MAX_PENDING_ROWS: usize = 1 << 20;
+
+#[derive(Debug, Default)]
+struct RemoteState {
+    host: Option<String>,
+    /// Latest context and when its transcript was written to
+    context: Option<(i64, ContextInfo)>,
+    /// Rows not yet taken by the ledger, with their project
+    rows: Vec<(String, LedgerRow)>,
+    /// Whether anyone takes rows; if not they are skipped, not held
+    rows_wanted: bool,
+    /// Rows were skipped, so the agent must resend when they are wanted
+    rows_skipped: bool,
+    connected: bool,
+    /// The local side is gone; a reader waiting for room gives up
+    closed: bool,
+}
+
+#[derive(Debug, Default)]
+struct RemoteShared {
+    state: Mutex<RemoteState>,
+    /// Signalled when rows are taken or waiting stops making sense
+    room: Condvar,
+}
+
+/// Connection to one remote agent
+pub struct RemoteSource {
+    command: Option<String>,
+    child: Option<Child>,
+    /// Socket the agent reads polls from; written with `net::send_all`
+    /// so a dead agent cannot take the panel down with SIGPIPE
+    input: Option<UnixStream>,
+    shared: Arc<RemoteShared>,
+    started_at: Instant,
+}
+
+impl RemoteSource {
+    /// Start `command` through the shell and listen to its output
+    pub fn spawn(command: &str) -> std::io::Result<Self> {
+        let (input, child_stdin) = UnixStream::pair()?;
+        let mut child = Command::new("sh")
+            .arg("-c")
+            .arg(command)
+            .stdin(Stdio::from(std::os::fd::OwnedFd::from(child_stdin)))
+            .stdout(Stdio::piped())
+            .stderr(Stdio::null())
+            .spawn()?;
+        let stdout = child.stdout.take().expect("piped stdout");
+
+        let mut source = RemoteSource::from_streams(stdout, input);
+        source.command = Some(command.to_string());
+        source.child = Some(child);
+        Ok(source)
+    }
+
+    /// Listen to an agent speaking on `output`, sending polls to `input`
+    pub fn from_streams(output: impl Read + Send + 'static, input: UnixStream) -> Self {
+        let shared = Arc::new(RemoteShared {
+            state: Mutex::new(RemoteState {
+                rows_wanted: true,
+                connected: true,
+                ..Default::default()
+            }),
+            room: Condvar::new(),
+        });
+
+        let reader_shared = Arc::clone(&shared);
+        thread::spawn(move || {
+            for line in BufReader::new(output).split(b'\n') {
+                let line = match line {
+                    Ok(line) => line,
+                    Err(_) => break,
+                };
+                if let Ok(msg) = serde_json::from_slice::<AgentMsg>(&line) {
+                    if !apply(&reader_shared, msg) {
+                        break;
+                    }
+                }
+            }
+            if let Ok(mut state) = reader_shared.state.lock() {
+                state.connected = false;
+            }
+        });
+
+        RemoteSource {
+            command: None,
+            child: None,
+            input: Some(input),
+            shared,
+            started_at: Instant::now(),
+        }
+    }
+
+    /// Ask the agent for an immediate scan
+    pub fn poll(&mut self) {
+        if !self.is_alive() {
+            return;
+        }
+        if let Some(input) = &self.input {
+            if net::send_all(input, b"poll\n").is_err() {
+                self.input = None;
+            }
+        }
+    }
+
+    /// Whether the agent is still talking and its command still running
+    fn is_alive(&mut self) -> bool {
+        let connected = self.shared.state.lock().map_or(false, |s| s.connected);
+        connected
+            && self
+                .child
+                .as_mut()
+                .map_or(true, |child| matches!(child.try_wait(), Ok(None)))
+    }
+
+    /// Restart the command if it exited, at most once a minute
+    pub fn ensure_running(&mut self) {
+        let connected = self.shared.state.lock().map_or(false, |s| s.connected);
+        if connected || self.started_at.elapsed() < RESPAWN_INTERVAL {
+            return;
+        }
+        self.restart();
+    }
+
+    fn restart(&mut self) {
+        if let Some(command) = self.command.clone() {
+            match RemoteSource::spawn(&command) {
+                Ok(fresh) => *self = fresh,
+                Err(_) => self.started_at = Instant::now(),
+            }
+        }
+    }
+
+    /// Say whether rows will be taken
+    ///
+    /// Rows nobody takes would stall the agent, so they are skipped while
+    /// not wanted. Wanting them again restarts the agent so it sends
+    /// everything anew.
+    pub fn set_rows_wanted(&mut self, wanted: bool) {
+        let resend = match self.shared.state.lock() {
+            Ok(mut state) => {
+                state.rows_wanted = wanted;
+                self.shared.room.notify_all();
+                wanted && std::mem::take(&mut state.rows_skipped)
+            }
+            Err(_) => false,
+        };
+        if resend {
+            self.restart();
+        }
+    }
+
+    /// Context of the remote session and when it was last active
+    pub fn context(&self) -> Option<(i64, ContextInfo)> {
+        self.shared.state.lock().ok()?.context.clone()
+    }
+
+    /// Rows received since the last call, with the project to file them under
+    pub fn take_rows(&self) -> Vec<(String, LedgerRow)> {
+        let rows = self
+            .shared
+            .state
+            .lock()
+            .map(|mut s| std::mem::take(&mut s.rows))
+            .unwrap_or_default();
+        self.shared.room.notify_all();
+        rows
+    }
+}
+
+/// Fold one message into the shared state; false once the reader should stop
+fn apply(shared: &RemoteShared, msg: AgentMsg) -> bool {
+    let mut state = match shared.state.lock() {
+        Ok(s) => s,
+        Err(_) => return false,
+    };
+    match msg {
+        AgentMsg::Hello { v, host } => {
+            if v != PROTOCOL_VERSION {
+                state.connected = false;
+            }
+            state.host = Some(host);
+        }
+        AgentMsg::Ctx(ctx) => {
+            let host = state.host.clone();
+            state.context = Some((ctx.active_at, ctx.into_info(host)));
+        }
+        AgentMsg::Rows { project, rows } => {
+            // Project names are local paths on the remote; keep them apart
+            let project = format!("{}:{}", state.host.as_deref().unwrap_or("remote"), project);
+            while state.rows_wanted && state.rows.len() >= MAX_PENDING_ROWS && !state.closed {
+                state = match shared.room.wait(state) {
+                    Ok(s) => s,
+                    Err(_) => return false,
+                };
+            }
+            if state.closed {
+                return false;
+            }
+            if !state.rows_wanted {
+                state.rows_skipped = true;
+                return true;
+            }
+            state
+                .rows
+                .extend(rows.into_iter().map(|r| (project.clone(), agent::row_from_wire(r))));
+        }
+    }
+    true
+}
+
+impl Drop for RemoteSource {
+    fn drop(&mut self) {
+        // Closing stdin makes the agent exit; the kill covers a stuck ssh
+        self.input = None;
+        if let Ok(mut state) = self.shared.state.lock() {
+            state.closed = true;
+            self.shared.room.notify_all();
+        }
+        if let Some(child) = &mut self.child {
+            let _ = child.kill();
+            let _ = child.wait();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::fs;
+    use std::ptr;
+
+    #[test]
+    fn test_agent_updates_reach_local_side() {
+        let root = std::env::temp_dir().join(format!("cs-remote-{}", std::process::id()));
+        let project = root.join("-srv-app");
+        fs::create_dir_all(&project).unwrap();
+        fs::write(
+            project.join("s1.jsonl"),
+            concat!(
+                r#"{"type":"assistant","timestamp":"2026-01-01T00:00:00Z","requestId":"r1","message":{"id":"m1","model":"claude-test","usage":{"input_tokens":1000,"output_tokens":50,"cache_read_input_tokens":41000}}}"#,
+                "\n"
+            ),
+        )
+        .unwrap();
+
+        // The agent speaks over a socket pair here instead of ssh
+        let (agent_out, local_in) = UnixStream::pair().unwrap();
+        let (local_out, agent_in) = UnixStream::pair().unwrap();
+        let agent_root = root.clone();
+        let agent = thread::spawn(move || {
+            agent::run_agent(&agent_root, agent_in, agent_out, Duration::from_secs(60))
+        });
+        let mut remote = RemoteSource::from_streams(local_in, local_out.try_clone().unwrap());
+        remote.poll();
+
+        let deadline = Instant::now() + Duration::from_secs(10);
+        let mut rows = Vec::new();
+        while (remote.context().is_none() || rows.is_empty()) && Instant::now() < deadline {
+            rows.extend(remote.take_rows());
+            thread::sleep(Duration::from_millis(10));
+        }
+
+        let (_, info) = remote.context().unwrap();
+        assert_eq!(info.context_tokens, 42_000);
+        assert_eq!(info.model_name.as_deref(), Some("claude-test"));
+        assert!(info.host.is_some());
+        assert_eq!(rows.len(), 1);
+        assert!(rows[0].0.ends_with(":-srv-app"));
+        assert_eq!(rows[0].1.output_tokens, 50);
+
+        // Closing the local end stops the agent
+        drop(remote);
+        local_out.shutdown(std::net::Shutdown::Both).unwrap();
+        agent.join().unwrap().ok();
+        fs::remove_dir_all(&root).unwrap();
+    }
+
+    /// Whether a SIGPIPE is pending for this thread, consuming it
+    fn take_sigpipe() -> bool {
+        unsafe {
+            let mut pending: libc::sigset_t = std::mem::zeroed();
+            libc::sigpending(&mut pending);
+            if libc::sigismember(&pending, libc::SIGPIPE) != 1 {
+                return false;
+            }
+            let mut set: libc::sigset_t = std::mem::zeroed();
+            libc::sigemptyset(&mut set);
+            libc::sigaddset(&mut set, libc::SIGPIPE);
+            let zero = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+            libc::sigtimedwait(&set, ptr::null_mut(), &zero);
+            true
+        }
+    }
+
+    #[test]
+    fn test_polling_killed_agent_raises_no_sigpipe() {
+        let hello = serde_json::to_string(&AgentMsg::Hello {
+            v: PROTOCOL_VERSION,
+            host: "devbox".to_string(),
+        })
+        .unwrap();
+        let mut remote = RemoteSource::spawn(&format!("echo '{}'; exec sleep 60", hello)).unwrap();
+
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while remote.shared.state.lock().unwrap().host.is_none() && Instant::now() < deadline {
+            thread::sleep(Duration::from_millis(10));
+        }
+        assert_eq!(remote.shared.state.lock().unwrap().host.as_deref(), Some("devbox"));
+        remote.poll();
+
+        let child = remote.child.as_mut().unwrap();
+        child.kill().unwrap();
+        child.wait().unwrap();
+
+        // The test harness ignores SIGPIPE, the panel does not. Blocked, a
+        // SIGPIPE stays pending for this thread where it can be seen.
+        let mut set: libc::sigset_t = unsafe { std::mem::zeroed() };
+        let mut old: libc::sigset_t = unsafe { std::mem::zeroed() };
+        unsafe {
+            libc::sigemptyset(&mut set);
+            libc::sigaddset(&mut set, libc::SIGPIPE);
+            libc::pthread_sigmask(libc::SIG_BLOCK, &set, &mut old);
+        }
+
+        remote.poll();
+        assert!(!take_sigpipe());
+        // Even a write that races the agent's exit only fails
+        let input = remote.input.as_ref().unwrap();
+        assert!(net::send_all(input, b"poll\n").is_err());
+        assert!(!take_sigpipe());
+
+        unsafe { libc::pthread_sigmask(libc::SIG_SETMASK, &old, ptr::null_mut()) };
+    }
+}
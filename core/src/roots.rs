@@ -0,0 +1,309 @@
+//! Concurrent tracking of several transcript roots
+//!
+//! Sessions may write to more than one projects directory: the default
+//! `~/.claude/projects`, a `CLAUDE_CONFIG_DIR` override, devcontainer bind
+//! mounts. Each root gets a worker thread with its own watcher, file list
+//! and tail state, so a slow or unreachable root (a stale network mount,
+//! say) only holds up its own results. Callers ask every root to scan and
+//! wait a bounded time; a root that does not answer keeps its last result.
+
+use notify::{Config, RecommendedWatcher, RecursiveMode, Watcher};
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread;
+use std::time::{Duration, Instant, SystemTime};
+
+use crate::transcript::{self, ContextInfo, TranscriptTracker};
+
+/// Longest a root is trusted to its watcher before its directories are
+/// listed again; network mounts do not report changes made elsewhere
+const FULL_SCAN_INTERVAL: Duration = Duration::from_secs(60);
+
+/// Roots scanned when nothing else is configured
+pub fn default_roots() -> Vec<PathBuf> {
+    let mut roots: Vec<PathBuf> = transcript::default_projects_dir().into_iter().collect();
+    if let Some(dir) = std::env::var_os("CLAUDE_CONFIG_DIR").filter(|d| !d.is_empty()) {
+        let projects = PathBuf::from(dir).join("projects");
+        if !roots.contains(&projects) {
+            roots.push(projects);
+        }
+    }
+    roots
+}
+
+#[derive(Debug, Default)]
+struct RootState {
+    /// Scans asked for, and the last one finished
+    requested: u64,
+    completed: u64,
+    /// Set by the watcher when files were added or removed
+    dirty: bool,
+    stopped: bool,
+    /// Latest session's context and its mtime as Unix timestamp
+    context: Option<(i64, ContextInfo)>,
+    /// Transcript files found by the last listing
+    files: Vec<PathBuf>,
+}
+
+#[derive(Debug, Default)]
+struct RootShared {
+    state: Mutex<RootState>,
+    changed: Condvar,
+}
+
+/// One root and the thread scanning it
+struct RootWorker {
+    root: PathBuf,
+    shared: Arc<RootShared>,
+}
+
+impl RootWorker {
+    fn spawn(root: PathBuf) -> Self {
+        let shared = Arc::new(RootShared::default());
+        let worker_shared = Arc::clone(&shared);
+        let worker_root = root.clone();
+        thread::spawn(move || run_worker(worker_root, worker_shared));
+        RootWorker { root, shared }
+    }
+
+    /// Ask for a scan; returns the request to wait for
+    fn request(&self) -> u64 {
+        let mut state = match self.shared.state.lock() {
+            Ok(s) => s,
+            Err(_) => return 0,
+        };
+        state.requested += 1;
+        self.shared.changed.notify_all();
+        state.requested
+    }
+
+    /// Wait until scan `target` finished or `deadline` passed
+    fn wait(&self, target: u64, deadline: Instant) {
+        let mut state = match self.shared.state.lock() {
+            Ok(s) => s,
+            Err(_) => return,
+        };
+        while state.completed < target {
+            let left = deadline.saturating_duration_since(Instant::now());
+            if left.is_zero() {
+                return;
+            }
+            state = match self.shared.changed.wait_timeout(state, left) {
+                Ok((s, _)) => s,
+                Err(_) => return,
+            };
+        }
+    }
+}
+
+impl Drop for RootWorker {
+    fn drop(&mut self) {
+        // A worker stuck on a dead mount exits once the call returns
+        if let Ok(mut state) = self.shared.state.lock() {
+            state.stopped = true;
+            self.shared.changed.notify_all();
+        }
+    }
+}
+
+fn watch(root: &Path, shared: &Arc<RootShared>) -> Option<RecommendedWatcher> {
+    let shared = Arc::clone(shared);
+    let mut watcher = RecommendedWatcher::new(
+        move |res: notify::Result<notify::Event>| {
+            use notify::EventKind::*;
+            if let Ok(event) = res {
+                if matches!(event.kind, Create(_) | Remove(_)) {
+                    if let Ok(mut state) = shared.state.lock() {
+                        state.dirty = true;
+                    }
+                }
+            }
+        },
+        Config::default(),
+    )
+    .ok()?;
+    watcher.watch(root, RecursiveMode::Recursive).ok()?;
+    Some(watcher)
+}
+
+fn run_worker(root: PathBuf, shared: Arc<RootShared>) {
+    let mut tracker = TranscriptTracker::new();
+    let mut watcher: Option<RecommendedWatcher> = None;
+    let mut listing: Vec<(PathBuf, SystemTime)> = Vec::new();
+    let mut listed_at: Option<Instant> = None;
+
+    loop {
+        let (target, dirty) = {
+            let mut state = match shared.state.lock() {
+                Ok(s) => s,
+                Err(_) => return,
+            };
+            while state.completed == state.requested && !state.stopped {
+                state = match shared.changed.wait(state) {
+                    Ok(s) => s,
+                    Err(_) => return,
+                };
+            }
+            if state.stopped {
+                return;
+            }
+            (state.requested, std::mem::take(&mut state.dirty))
+        };
+
+        // Created here rather than by the caller: watching a dead mount can hang
+        if watcher.is_none() && root.is_dir() {
+            watcher = watch(&root, &shared);
+        }
+        let stale = dirty
+            || watcher.is_none()
+            || listed_at.map_or(true, |at| at.elapsed() >= FULL_SCAN_INTERVAL);
+        if stale {
+            listing = transcript::list_transcripts(&root).unwrap_or_default();
+            listed_at = Some(Instant::now());
+        } else {
+            // Appends do not change the file set, but they do change mtimes
+            for (path, modified) in &mut listing {
+                if let Ok(time) = path.metadata().and_then(|m| m.modified()) {
+                    *modified = time;
+                }
+            }
+        }
+
+        let context = listing
+            .iter()
+            .max_by_key(|(_, modified)| *modified)
+            .and_then(|(path, modified)| {
+                let info = tracker.read_context_from(path).ok()?;
+                Some((transcript::unix_secs(*modified).unwrap_or(0), info))
+            });
+
+        let mut state = match shared.state.lock() {
+            Ok(s) => s,
+            Err(_) => return,
+        };
+        state.context = context;
+        state.files = listing.iter().map(|(path, _)| path.clone()).collect();
+        state.completed = target;
+        shared.changed.notify_all();
+    }
+}
+
+/// The set of transcript roots, each scanned by its own worker
+#[derive(Default)]
+pub struct TranscriptRoots {
+    workers: Vec<RootWorker>,
+}
+
+impl TranscriptRoots {
+    pub fn new(roots: Vec<PathBuf>) -> Self {
+        let mut set = TranscriptRoots::default();
+        set.set_roots(roots);
+        set
+    }
+
+    /// Replace the roots, keeping the workers and caches of unchanged ones
+    pub fn set_roots(&mut self, roots: Vec<PathBuf>) {
+        let mut old = std::mem::take(&mut self.workers);
+        for root in roots {
+            if self.workers.iter().any(|w| w.root == root) {
+                continue;
+            }
+            let worker = match old.iter().position(|w| w.root == root) {
+                Some(idx) => old.swap_remove(idx),
+                None => RootWorker::spawn(root),
+            };
+            self.workers.push(worker);
+        }
+    }
+
+    /// Have every root rescan, waiting at most `timeout` for all of them
+    pub fn refresh(&self, timeout: Duration) {
+        let deadline = Instant::now() + timeout;
+        let targets: Vec<u64> = self.workers.iter().map(|w| w.request()).collect();
+        for (worker, target) in self.workers.iter().zip(targets) {
+            worker.wait(target, deadline);
+        }
+    }
+
+    /// Context of the most recently active session across all roots,
+    /// with its transcript's mtime
+    pub fn latest(&self) -> Option<(i64, ContextInfo)> {
+        self.workers
+            .iter()
+            .filter_map(|w| w.shared.state.lock().ok()?.context.clone())
+            .max_by_key(|(active_at, _)| *active_at)
+    }
+
+    /// Transcript files of the roots that finished their last scan
+    ///
+    /// A root still busy with a scan may be hung on a dead mount; reading
+    /// its files would hang the caller too, so they are left out until it
+    /// answers again.
+    pub fn live_files(&self) -> Vec<PathBuf> {
+        self.workers
+            .iter()
+            .filter_map(|w| {
+                let state = w.shared.state.lock().ok()?;
+                (state.completed == state.requested).then(|| state.files.clone())
+            })
+            .flatten()
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CString;
+    use std::fs::{self, File};
+    use std::os::unix::ffi::OsStrExt;
+
+    #[test]
+    fn test_stuck_root_does_not_block_others() {
+        let base = std::env::temp_dir().join(format!("cs-roots-{}", std::process::id()));
+        let good = base.join("good");
+        let stuck = base.join("stuck");
+        fs::create_dir_all(good.join("-p")).unwrap();
+        fs::create_dir_all(stuck.join("-p")).unwrap();
+        fs::write(
+            good.join("-p").join("s.jsonl"),
+            concat!(
+                r#"{"type":"assistant","message":{"id":"m1","usage":{"input_tokens":10,"cache_read_input_tokens":20000}}}"#,
+                "\n"
+            ),
+        )
+        .unwrap();
+
+        // The stuck root answers once, with a file older than the good one
+        let fifo = stuck.join("-p").join("s.jsonl");
+        let old = SystemTime::now() - Duration::from_secs(3600);
+        File::create(&fifo).unwrap().set_modified(old).unwrap();
+
+        let roots = TranscriptRoots::new(vec![stuck.clone(), good.clone(), good.clone()]);
+        assert_eq!(roots.workers.len(), 2);
+        roots.refresh(Duration::from_secs(5));
+        assert!(roots.live_files().contains(&fifo));
+
+        // Then opening its file blocks, much like a dead mount
+        fs::remove_file(&fifo).unwrap();
+        let c_fifo = CString::new(fifo.as_os_str().as_bytes()).unwrap();
+        assert_eq!(unsafe { libc::mkfifo(c_fifo.as_ptr(), 0o600) }, 0);
+
+        let started = Instant::now();
+        roots.refresh(Duration::from_millis(500));
+        assert!(started.elapsed() < Duration::from_secs(5));
+        let (_, info) = roots.latest().unwrap();
+        assert_eq!(info.context_tokens, 20_010);
+        let live = roots.live_files();
+        assert!(live.contains(&good.join("-p").join("s.jsonl")));
+        assert!(!live.contains(&fifo));
+
+        // Unblock the stuck worker so it can exit
+        drop(roots);
+        let writer = unsafe { libc::open(c_fifo.as_ptr(), libc::O_WRONLY | libc::O_NONBLOCK) };
+        if writer >= 0 {
+            unsafe { libc::close(writer) };
+        }
+        fs::remove_dir_all(&base).unwrap();
+    }
+}
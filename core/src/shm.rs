@@ -0,0 +1,374 @@
+//! Shared-memory snapshot for frequent local readers
+//!
+//! The core can publish its current values into a small file under
+//! `/dev/shm`, guarded by a sequence lock. Readers map the file once and
+//! then read consistent values with plain loads: no syscalls and no
+//! coordination with the poller. `claude_status_shm.h` has the matching C
+//! reader.
+//!
+//! Layout (native endian, all fields 8-byte aligned):
+//!
+//! | offset | type  | field                                         |
+//! |--------|-------|-----------------------------------------------|
+//! | 0      | u32   | magic, `SHM_MAGIC`                            |
+//! | 4      | u32   | layout version, `SHM_VERSION`                 |
+//! | 8      | u64   | sequence; odd while a write is in progress    |
+//! | 16     | u64[] | payload words, see `ShmSnapshot::to_words`    |
+//!
+//! A reader loads the sequence, skips odd values, copies the payload, and
+//! accepts the copy if the sequence is unchanged afterwards.
+
+use std::fs::{File, OpenOptions};
+use std::io;
+use std::os::unix::fs::{MetadataExt, OpenOptionsExt};
+use std::os::unix::io::AsRawFd;
+use std::path::{Path, PathBuf};
+use std::ptr;
+use std::sync::atomic::{fence, AtomicU32, AtomicU64, Ordering};
+
+/// "CSS1" in little-endian byte order
+pub const SHM_MAGIC: u32 = 0x3153_5343;
+
+/// Bumped whenever the payload layout changes
+pub const SHM_VERSION: u32 = 1;
+
+/// Number of payload words
+pub const SHM_PAYLOAD_WORDS: usize = 13;
+
+/// Size of the mapped file
+const SHM_FILE_SIZE: usize = 4096;
+
+/// Reads attempted before giving up on a writer that keeps writing
+const MAX_READ_ATTEMPTS: u32 = 1000;
+
+const FLAG_USAGE_VALID: u64 = 1 << 0;
+const FLAG_CONTEXT_VALID: u64 = 1 << 1;
+
+/// Default snapshot path for the current user
+pub fn default_shm_path() -> PathBuf {
+    let uid = unsafe { libc::getuid() };
+    PathBuf::from(format!("/dev/shm/claude-status-{}", uid))
+}
+
+/// Refuse a snapshot file that another user created or can write to
+///
+/// The default path is predictable, so anyone could create it first.
+fn check_private(file: &File) -> io::Result<()> {
+    let meta = file.metadata()?;
+    let euid = unsafe { libc::geteuid() };
+    if !meta.file_type().is_file() || meta.uid() != euid || meta.mode() & 0o7777 != 0o600 {
+        return Err(io::Error::new(
+            io::ErrorKind::PermissionDenied,
+            "snapshot file is not a private file of this user",
+        ));
+    }
+    Ok(())
+}
+
+#[repr(C)]
+struct ShmRegion {
+    magic: AtomicU32,
+    version: AtomicU32,
+    seq: AtomicU64,
+    words: [AtomicU64; SHM_PAYLOAD_WORDS],
+}
+
+/// Values published in the snapshot
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ShmSnapshot {
+    /// Time of publication as Unix timestamp
+    pub updated_at: i64,
+    pub usage_valid: bool,
+    pub context_valid: bool,
+    pub five_hour_pct: f64,
+    pub seven_day_pct: f64,
+    pub five_hour_reset_ts: i64,
+    pub seven_day_reset_ts: i64,
+    pub usage_generation: u64,
+    pub context_pct: f64,
+    pub context_tokens: i64,
+    pub context_window_size: i64,
+    /// -1 if unknown
+    pub turns_to_compact: i64,
+    /// -1 if unknown
+    pub secs_to_compact: i64,
+    pub sidechain_tokens: i64,
+}
+
+impl ShmSnapshot {
+    /// Payload words in layout order
+    ///
+    /// 0 `updated_at`, 1 flags (bit 0 usage valid, bit 1 context valid),
+    /// 2 `five_hour_pct` (f64 bits), 3 `seven_day_pct` (f64 bits),
+    /// 4 `five_hour_reset_ts`, 5 `seven_day_reset_ts`, 6 `usage_generation`,
+    /// 7 `context_pct` (f64 bits), 8 `context_tokens`,
+    /// 9 `context_window_size`, 10 `turns_to_compact`, 11 `secs_to_compact`,
+    /// 12 `sidechain_tokens`
+    pub fn to_words(&self) -> [u64; SHM_PAYLOAD_WORDS] {
+        let mut flags = 0;
+        if self.usage_valid {
+            flags |= FLAG_USAGE_VALID;
+        }
+        if self.context_valid {
+            flags |= FLAG_CONTEXT_VALID;
+        }
+        [
+            self.updated_at as u64,
+            flags,
+            self.five_hour_pct.to_bits(),
+            self.seven_day_pct.to_bits(),
+            self.five_hour_reset_ts as u64,
+            self.seven_day_reset_ts as u64,
+            self.usage_generation,
+            self.context_pct.to_bits(),
+            self.context_tokens as u64,
+            self.context_window_size as u64,
+            self.turns_to_compact as u64,
+            self.secs_to_compact as u64,
+            self.sidechain_tokens as u64,
+        ]
+    }
+
+    pub fn from_words(w: &[u64; SHM_PAYLOAD_WORDS]) -> Self {
+        ShmSnapshot {
+            updated_at: w[0] as i64,
+            usage_valid: w[1] & FLAG_USAGE_VALID != 0,
+            context_valid: w[1] & FLAG_CONTEXT_VALID != 0,
+            five_hour_pct: f64::from_bits(w[2]),
+            seven_day_pct: f64::from_bits(w[3]),
+            five_hour_reset_ts: w[4] as i64,
+            seven_day_reset_ts: w[5] as i64,
+            usage_generation: w[6],
+            context_pct: f64::from_bits(w[7]),
+            context_tokens: w[8] as i64,
+            context_window_size: w[9] as i64,
+            turns_to_compact: w[10] as i64,
+            secs_to_compact: w[11] as i64,
+            sidechain_tokens: w[12] as i64,
+        }
+    }
+}
+
+/// A mapping of the snapshot file, unmapped on drop
+struct Mapping {
+    region: *mut ShmRegion,
+    _file: File,
+}
+
+impl Mapping {
+    fn new(file: File, writable: bool) -> io::Result<Self> {
+        let prot = if writable {
+            libc::PROT_READ | libc::PROT_WRITE
+        } else {
+            libc::PROT_READ
+        };
+        let addr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                SHM_FILE_SIZE,
+                prot,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if addr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Mapping {
+            region: addr as *mut ShmRegion,
+            _file: file,
+        })
+    }
+
+    fn region(&self) -> &ShmRegion {
+        unsafe { &*self.region }
+    }
+}
+
+// The mapping is only accessed through atomics
+unsafe impl Send for Mapping {}
+unsafe impl Sync for Mapping {}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.region as *mut libc::c_void, SHM_FILE_SIZE);
+        }
+    }
+}
+
+/// Publisher side of the snapshot; there is at most one per file
+pub struct ShmWriter {
+    map: Mapping,
+    path: PathBuf,
+}
+
+impl ShmWriter {
+    /// Create (or take over) the snapshot file at `path`
+    ///
+    /// Fails if another process is already publishing to it.
+    pub fn create(path: &Path) -> io::Result<Self> {
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .mode(0o600)
+            .custom_flags(libc::O_NOFOLLOW | libc::O_CLOEXEC)
+            .open(path)?;
+        check_private(&file)?;
+
+        // A second writer would break the sequence lock
+        if unsafe { libc::flock(file.as_raw_fd(), libc::LOCK_EX | libc::LOCK_NB) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        file.set_len(SHM_FILE_SIZE as u64)?;
+
+        let map = Mapping::new(file, true)?;
+        let region = map.region();
+        // Leave the sequence where it is so live readers never see it go back
+        let seq = region.seq.load(Ordering::Relaxed);
+        if seq % 2 == 1 {
+            region.seq.store(seq + 1, Ordering::Release);
+        }
+        region.version.store(SHM_VERSION, Ordering::Relaxed);
+        region.magic.store(SHM_MAGIC, Ordering::Release);
+
+        Ok(ShmWriter {
+            map,
+            path: path.to_path_buf(),
+        })
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    pub fn publish(&self, snapshot: &ShmSnapshot) {
+        let region = self.map.region();
+        let seq = region.seq.load(Ordering::Relaxed);
+        region.seq.store(seq.wrapping_add(1), Ordering::Relaxed);
+        fence(Ordering::Release);
+        for (slot, word) in region.words.iter().zip(snapshot.to_words()) {
+            slot.store(word, Ordering::Relaxed);
+        }
+        region.seq.store(seq.wrapping_add(2), Ordering::Release);
+    }
+}
+
+impl Drop for ShmWriter {
+    fn drop(&mut self) {
+        // Readers holding a mapping keep working; new readers find nothing
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// Reader side of the snapshot
+pub struct ShmReader {
+    map: Mapping,
+}
+
+impl ShmReader {
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let file = OpenOptions::new()
+            .read(true)
+            .custom_flags(libc::O_NOFOLLOW | libc::O_CLOEXEC)
+            .open(path)?;
+        check_private(&file)?;
+        if file.metadata()?.len() < SHM_FILE_SIZE as u64 {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "snapshot file too small"));
+        }
+        let map = Mapping::new(file, false)?;
+        let region = map.region();
+        if region.magic.load(Ordering::Acquire) != SHM_MAGIC
+            || region.version.load(Ordering::Relaxed) != SHM_VERSION
+        {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "unknown snapshot layout"));
+        }
+        Ok(ShmReader { map })
+    }
+
+    /// Read a consistent snapshot; `None` only if the writer never pauses
+    pub fn read(&self) -> Option<ShmSnapshot> {
+        let region = self.map.region();
+        let mut words = [0u64; SHM_PAYLOAD_WORDS];
+        for _ in 0..MAX_READ_ATTEMPTS {
+            let before = region.seq.load(Ordering::Acquire);
+            if before % 2 == 1 {
+                std::hint::spin_loop();
+                continue;
+            }
+            for (word, slot) in words.iter_mut().zip(&region.words) {
+                *word = slot.load(Ordering::Relaxed);
+            }
+            fence(Ordering::Acquire);
+            if region.seq.load(Ordering::Relaxed) == before {
+                return Some(ShmSnapshot::from_words(&words));
+            }
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_reader_never_sees_torn_snapshot() {
+        let path = std::env::temp_dir().join(format!("cs-shm-{}", std::process::id()));
+        let writer = ShmWriter::create(&path).unwrap();
+        assert!(ShmWriter::create(&path).is_err());
+        let reader = ShmReader::open(&path).unwrap();
+
+        std::thread::scope(|s| {
+            s.spawn(|| {
+                for i in 0..20_000i64 {
+                    // Every field carries the same value, so a mix is visible
+                    writer.publish(&ShmSnapshot {
+                        updated_at: i,
+                        context_tokens: i,
+                        turns_to_compact: i,
+                        sidechain_tokens: i,
+                        ..Default::default()
+                    });
+                }
+            });
+            for _ in 0..20_000 {
+                if let Some(snap) = reader.read() {
+                    assert_eq!(snap.updated_at, snap.context_tokens);
+                    assert_eq!(snap.updated_at, snap.sidechain_tokens);
+                }
+            }
+        });
+
+        assert_eq!(reader.read().unwrap().updated_at, 19_999);
+        drop(writer);
+        assert!(!path.exists());
+    }
+
+    #[test]
+    fn test_planted_file_refused() {
+        use std::os::unix::fs::PermissionsExt;
+
+        let dir = std::env::temp_dir().join(format!("cs-shm-planted-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let target = dir.join("target");
+        std::fs::write(&target, b"keep").unwrap();
+
+        // A symlink to some other file of the user's
+        let link = dir.join("link");
+        std::os::unix::fs::symlink(&target, &link).unwrap();
+        assert!(ShmWriter::create(&link).is_err());
+        assert_eq!(std::fs::read(&target).unwrap(), b"keep");
+
+        // A file others can write to
+        let open = dir.join("open");
+        std::fs::write(&open, vec![0u8; SHM_FILE_SIZE]).unwrap();
+        std::fs::set_permissions(&open, std::fs::Permissions::from_mode(0o666)).unwrap();
+        assert!(ShmWriter::create(&open).is_err());
+        assert!(ShmReader::open(&open).is_err());
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+}
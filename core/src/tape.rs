@@ -0,0 +1,727 @@
+//! Structural-index JSON parser for transcript lines
+//!
+//! Assistant lines are mostly a long `content` array that the context
+//! numbers never look at, yet serde walks it byte by byte. This parser
+//! follows simdjson and works in two passes:
+//!
+//! 1. Classify the line 64 bytes at a time into bitmasks of quotes,
+//!    backslashes, structural characters, whitespace and control bytes,
+//!    with AVX2 or SSE2 where the CPU has them and a byte loop otherwise.
+//!    Escapes and string spans are resolved with carries across blocks,
+//!    leaving an index of the structural characters, the quotes and the
+//!    first byte of every number or literal.
+//! 2. Walk the index into a tape with one node per value. Containers
+//!    record the node past their last member, so looking up a field steps
+//!    over a whole nested array at once.
+//!
+//! A line is accepted exactly when serde_json accepts it as a value it
+//! ignores: strings may not hold raw control characters or unknown
+//! escapes, but their UTF-8 is only checked once they are read with
+//! `Tape::str`, as serde does for the strings it keeps.
+
+use std::borrow::Cow;
+use std::sync::OnceLock;
+
+/// Longest line the tape can address
+pub const MAX_LEN: usize = u32::MAX as usize;
+
+/// Odd bit positions of a block
+const ODD_BITS: u64 = 0xaaaa_aaaa_aaaa_aaaa;
+
+/// Kind of a value on the tape
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Kind {
+    Object,
+    Array,
+    String,
+    Number,
+    True,
+    False,
+    Null,
+}
+
+/// One value of the tape
+#[derive(Debug, Clone, Copy)]
+struct Node {
+    kind: Kind,
+    /// Offset of the value; for strings, of the byte after the quote
+    start: u32,
+    /// Containers: the node past the last member. Others: the offset past
+    /// the value, for strings that of the closing quote.
+    end: u32,
+}
+
+/// Bit per byte of a 64-byte block
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+struct Block {
+    quote: u64,
+    backslash: u64,
+    /// `{}[]:,`
+    op: u64,
+    space: u64,
+    /// Bytes below 0x20
+    control: u64,
+}
+
+/// Implementation of the classification pass
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Kernel {
+    Scalar,
+    #[cfg(target_arch = "x86_64")]
+    Sse2,
+    #[cfg(target_arch = "x86_64")]
+    Avx2,
+}
+
+/// Best kernel the CPU supports, detected once
+fn kernel() -> Kernel {
+    static KERNEL: OnceLock<Kernel> = OnceLock::new();
+    *KERNEL.get_or_init(|| {
+        #[cfg(target_arch = "x86_64")]
+        {
+            if is_x86_feature_detected!("avx2") {
+                return Kernel::Avx2;
+            }
+            // Part of the x86_64 baseline
+            return Kernel::Sse2;
+        }
+        #[allow(unreachable_code)]
+        Kernel::Scalar
+    })
+}
+
+fn classify(block: &[u8; 64], kernel: Kernel) -> Block {
+    match kernel {
+        Kernel::Scalar => classify_scalar(block),
+        #[cfg(target_arch = "x86_64")]
+        Kernel::Sse2 => unsafe { classify_sse2(block) },
+        #[cfg(target_arch = "x86_64")]
+        Kernel::Avx2 => unsafe { classify_avx2(block) },
+    }
+}
+
+fn classify_scalar(block: &[u8; 64]) -> Block {
+    let mut out = Block::default();
+    for (i, &b) in block.iter().enumerate() {
+        let bit = 1u64 << i;
+        match b {
+            b'"' => out.quote |= bit,
+            b'\\' => out.backslash |= bit,
+            b'{' | b'}' | b'[' | b']' | b':' | b',' => out.op |= bit,
+            b' ' | b'\t' | b'\n' | b'\r' => out.space |= bit,
+            _ => {}
+        }
+        if b < 0x20 {
+            out.control |= bit;
+        }
+    }
+    out
+}
+
+/// Classify `$lanes` vectors of `$width` bytes with the given intrinsics
+#[cfg(target_arch = "x86_64")]
+macro_rules! classify_simd {
+    ($block:expr, $width:expr, $load:ident, $set1:ident, $eq:ident, $or:ident, $max:ident,
+     $movemask:ident) => {{
+        let mut out = Block::default();
+        for lane in 0..64 / $width {
+            let v = $load($block.as_ptr().add(lane * $width).cast());
+            let shift = lane * $width;
+            macro_rules! eq {
+                ($c:expr) => {
+                    $eq(v, $set1($c as i8))
+                };
+            }
+            macro_rules! bits {
+                ($m:expr) => {
+                    ($movemask($m) as u32 as u64) << shift
+                };
+            }
+            out.quote |= bits!(eq!(b'"'));
+            out.backslash |= bits!(eq!(b'\\'));
+            let braces = $or($or(eq!(b'{'), eq!(b'}')), $or(eq!(b'['), eq!(b']')));
+            out.op |= bits!($or(braces, $or(eq!(b':'), eq!(b','))));
+            out.space |= bits!($or($or(eq!(b' '), eq!(b'\t')), $or(eq!(b'\n'), eq!(b'\r'))));
+            // Unsigned v <= 0x1f
+            out.control |= bits!($eq($max(v, $set1(0x1f)), $set1(0x1f)));
+        }
+        out
+    }};
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn classify_sse2(block: &[u8; 64]) -> Block {
+    use std::arch::x86_64::*;
+    classify_simd!(
+        block,
+        16,
+        _mm_loadu_si128,
+        _mm_set1_epi8,
+        _mm_cmpeq_epi8,
+        _mm_or_si128,
+        _mm_max_epu8,
+        _mm_movemask_epi8
+    )
+}
+
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2")]
+unsafe fn classify_avx2(block: &[u8; 64]) -> Block {
+    use std::arch::x86_64::*;
+    classify_simd!(
+        block,
+        32,
+        _mm256_loadu_si256,
+        _mm256_set1_epi8,
+        _mm256_cmpeq_epi8,
+        _mm256_or_si256,
+        _mm256_max_epu8,
+        _mm256_movemask_epi8
+    )
+}
+
+/// Bytes that follow an odd run of backslashes
+///
+/// `carry` says whether the first byte of the block is escaped and is
+/// updated for the next block (simdjson's branchless escape scanner).
+fn escaped_bits(backslash: u64, carry: &mut u64) -> u64 {
+    if backslash == 0 {
+        return std::mem::take(carry);
+    }
+    let potential = backslash & !*carry;
+    // Odd bits are set except in runs starting on an odd byte; subtracting
+    // the run start flips them so only the byte after an odd run stays set
+    let codes = ((potential << 1) | ODD_BITS).wrapping_sub(potential) ^ ODD_BITS;
+    let escaped = codes ^ (backslash | *carry);
+    *carry = (codes & backslash) >> 63;
+    escaped
+}
+
+/// Bits from each set bit up to, not including, the next one
+fn prefix_xor(mut x: u64) -> u64 {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    x
+}
+
+fn valid_escape(json: &[u8], at: usize) -> bool {
+    match json.get(at) {
+        Some(b'"' | b'\\' | b'/' | b'b' | b'f' | b'n' | b'r' | b't') => true,
+        Some(b'u') => json
+            .get(at + 1..at + 5)
+            .map_or(false, |hex| hex.iter().all(u8::is_ascii_hexdigit)),
+        _ => false,
+    }
+}
+
+/// First pass: fill `out` with the offsets the tape is built from
+///
+/// Returns false if a string is unterminated or holds a control character
+/// or an invalid escape.
+fn index(json: &[u8], kernel: Kernel, out: &mut Vec<u32>) -> bool {
+    out.clear();
+    let mut escape_carry = 0u64;
+    let mut string_carry = 0u64;
+    let mut scalar_carry = 0u64;
+    let mut tail = [b' '; 64];
+
+    for (n, chunk) in json.chunks(64).enumerate() {
+        let block: &[u8; 64] = match chunk.try_into() {
+            Ok(block) => block,
+            Err(_) => {
+                // Whitespace padding ends any number or literal
+                tail[..chunk.len()].copy_from_slice(chunk);
+                &tail
+            }
+        };
+        let base = n * 64;
+        let b = classify(block, kernel);
+
+        let escaped = escaped_bits(b.backslash, &mut escape_carry);
+        let quote = b.quote & !escaped;
+        // From an opening quote up to its closing one
+        let in_string = prefix_xor(quote) ^ string_carry;
+        string_carry = ((in_string as i64) >> 63) as u64;
+
+        if b.control & in_string != 0 {
+            return false;
+        }
+        let mut escapes = escaped & in_string;
+        while escapes != 0 {
+            if !valid_escape(json, base + escapes.trailing_zeros() as usize) {
+                return false;
+            }
+            escapes &= escapes - 1;
+        }
+
+        let strings = in_string | quote;
+        let scalar = !(strings | b.op | b.space);
+        let scalar_start = scalar & !((scalar << 1) | scalar_carry);
+        scalar_carry = scalar >> 63;
+
+        let mut structural = (b.op & !strings) | quote | scalar_start;
+        while structural != 0 {
+            out.push((base + structural.trailing_zeros() as usize) as u32);
+            structural &= structural - 1;
+        }
+    }
+    string_carry == 0
+}
+
+/// Kind of the number or literal `token`, if it is one
+fn scalar_kind(token: &[u8]) -> Option<Kind> {
+    match token {
+        b"true" => Some(Kind::True),
+        b"false" => Some(Kind::False),
+        b"null" => Some(Kind::Null),
+        _ if is_number(token) => Some(Kind::Number),
+        _ => None,
+    }
+}
+
+/// JSON number grammar, which serde enforces even for ignored values
+fn is_number(t: &[u8]) -> bool {
+    let digits = |i: &mut usize| {
+        let start = *i;
+        while t.get(*i).map_or(false, u8::is_ascii_digit) {
+            *i += 1;
+        }
+        *i > start
+    };
+
+    let mut i = usize::from(t.first() == Some(&b'-'));
+    match t.get(i) {
+        Some(b'0') => i += 1,
+        Some(b'1'..=b'9') => {
+            digits(&mut i);
+        }
+        _ => return false,
+    }
+    if t.get(i) == Some(&b'.') {
+        i += 1;
+        if !digits(&mut i) {
+            return false;
+        }
+    }
+    if matches!(t.get(i), Some(b'e' | b'E')) {
+        i += 1;
+        if matches!(t.get(i), Some(b'+' | b'-')) {
+            i += 1;
+        }
+        if !digits(&mut i) {
+            return false;
+        }
+    }
+    i == t.len()
+}
+
+#[derive(Clone, Copy)]
+enum Expect {
+    Value,
+    /// Value or `]` right after `[`
+    FirstElement,
+    /// Key or `}` right after `{`
+    FirstKey,
+    Key,
+    Colon,
+    CommaOrClose,
+}
+
+/// Second pass: check the grammar and lay out the tape
+fn build(json: &[u8], index: &[u32], nodes: &mut Vec<Node>, stack: &mut Vec<usize>) -> Option<()> {
+    nodes.clear();
+    stack.clear();
+    let mut at = 0;
+    let mut expect = Expect::Value;
+
+    while let Some(&pos) = index.get(at) {
+        at += 1;
+        let c = json[pos as usize];
+        expect = match (expect, c) {
+            (Expect::Value | Expect::FirstElement, b'{' | b'[') => {
+                stack.push(nodes.len());
+                nodes.push(Node {
+                    kind: if c == b'{' { Kind::Object } else { Kind::Array },
+                    start: pos,
+                    end: 0,
+                });
+                if c == b'{' {
+                    Expect::FirstKey
+                } else {
+                    Expect::FirstElement
+                }
+            }
+            (Expect::Value | Expect::FirstElement | Expect::FirstKey | Expect::Key, b'"') => {
+                // Nothing inside a string is indexed, so the next entry closes it
+                let close = *index.get(at)?;
+                at += 1;
+                nodes.push(Node {
+                    kind: Kind::String,
+                    start: pos + 1,
+                    end: close,
+                });
+                if matches!(expect, Expect::FirstKey | Expect::Key) {
+                    Expect::Colon
+                } else {
+                    Expect::CommaOrClose
+                }
+            }
+            (Expect::Colon, b':') => Expect::Value,
+            (Expect::CommaOrClose, b',') => match nodes[*stack.last()?].kind {
+                Kind::Object => Expect::Key,
+                _ => Expect::Value,
+            },
+            (Expect::FirstKey | Expect::CommaOrClose, b'}')
+            | (Expect::FirstElement | Expect::CommaOrClose, b']') => {
+                let open = stack.pop()?;
+                let kind = if c == b'}' { Kind::Object } else { Kind::Array };
+                if nodes[open].kind != kind {
+                    return None;
+                }
+                nodes[open].end = nodes.len() as u32;
+                Expect::CommaOrClose
+            }
+            (Expect::Value | Expect::FirstElement, _)
+                if !matches!(c, b'{' | b'}' | b'[' | b']' | b':' | b',') =>
+            {
+                let start = pos as usize;
+                let len = json[start..]
+                    .iter()
+                    .position(|b| {
+                        matches!(
+                            b,
+                            b' ' | b'\t'
+                                | b'\n'
+                                | b'\r'
+                                | b'"'
+                                | b'{'
+                                | b'}'
+                                | b'['
+                                | b']'
+                                | b':'
+                                | b','
+                        )
+                    })
+                    .unwrap_or(json.len() - start);
+                nodes.push(Node {
+                    kind: scalar_kind(&json[start..start + len])?,
+                    start: pos,
+                    end: (start + len) as u32,
+                });
+                Expect::CommaOrClose
+            }
+            _ => return None,
+        };
+
+        // Nothing may follow the root value
+        if stack.is_empty() && matches!(expect, Expect::CommaOrClose) {
+            return (at == index.len()).then_some(());
+        }
+    }
+    None
+}
+
+/// Reusable buffers for parsing one line after another
+#[derive(Debug, Default)]
+pub struct Parser {
+    index: Vec<u32>,
+    nodes: Vec<Node>,
+    stack: Vec<usize>,
+}
+
+/// The buffers only hold scratch state, so a copy starts out empty
+impl Clone for Parser {
+    fn clone(&self) -> Self {
+        Parser::default()
+    }
+}
+
+impl Parser {
+    /// Tape of `json`, or None if serde_json rejects it
+    ///
+    /// Lines longer than `MAX_LEN` are not parsed and give None as well.
+    pub fn parse<'a>(&'a mut self, json: &'a [u8]) -> Option<Tape<'a>> {
+        self.parse_with(json, kernel())
+    }
+
+    fn parse_with<'a>(&'a mut self, json: &'a [u8], kernel: Kernel) -> Option<Tape<'a>> {
+        if json.len() > MAX_LEN || !index(json, kernel, &mut self.index) {
+            return None;
+        }
+        build(json, &self.index, &mut self.nodes, &mut self.stack)?;
+        Some(Tape {
+            json,
+            nodes: &self.nodes,
+        })
+    }
+}
+
+/// Parsed line; node 0 is the root value
+pub struct Tape<'a> {
+    json: &'a [u8],
+    nodes: &'a [Node],
+}
+
+impl<'a> Tape<'a> {
+    pub fn kind(&self, node: usize) -> Kind {
+        self.nodes[node].kind
+    }
+
+    /// Node after `node` and everything nested in it
+    fn skip(&self, node: usize) -> usize {
+        match self.nodes[node].kind {
+            Kind::Object | Kind::Array => self.nodes[node].end as usize,
+            _ => node + 1,
+        }
+    }
+
+    /// Key and value nodes of the object at `node`
+    pub fn members(&self, node: usize) -> Members<'_, 'a> {
+        debug_assert_eq!(self.kind(node), Kind::Object);
+        Members {
+            tape: self,
+            at: node + 1,
+            end: self.nodes[node].end as usize,
+        }
+    }
+
+    /// Text of a number, or of a string between its quotes with escapes
+    /// left as they are
+    pub fn raw(&self, node: usize) -> &'a [u8] {
+        let n = self.nodes[node];
+        &self.json[n.start as usize..n.end as usize]
+    }
+
+    /// Decoded string, or None where serde refuses to read it into a
+    /// `String`: invalid UTF-8 or unpaired surrogate escapes
+    pub fn str(&self, node: usize) -> Option<Cow<'a, str>> {
+        let raw = self.raw(node);
+        if !raw.contains(&b'\\') {
+            return std::str::from_utf8(raw).ok().map(Cow::Borrowed);
+        }
+
+        let hex4 = |at: usize| {
+            raw.get(at..at + 4)?
+                .iter()
+                .try_fold(0u32, |n, &d| Some(n << 4 | (d as char).to_digit(16)?))
+        };
+        let mut out = Vec::with_capacity(raw.len());
+        let mut i = 0;
+        while i < raw.len() {
+            if raw[i] != b'\\' {
+                out.push(raw[i]);
+                i += 1;
+                continue;
+            }
+            let decoded = match raw[i + 1] {
+                b'b' => '\x08',
+                b'f' => '\x0c',
+                b'n' => '\n',
+                b'r' => '\r',
+                b't' => '\t',
+                b'u' => {
+                    let high = hex4(i + 2)?;
+                    i += 4;
+                    match high {
+                        0xd800..=0xdbff => {
+                            if raw.get(i + 2..i + 4) != Some(b"\\u") {
+                                return None;
+                            }
+                            let low = hex4(i + 4).filter(|n| (0xdc00..=0xdfff).contains(n))?;
+                            i += 6;
+                            char::from_u32(0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00))?
+                        }
+                        _ => char::from_u32(high)?,
+                    }
+                }
+                c => c as char,
+            };
+            out.extend_from_slice(decoded.encode_utf8(&mut [0; 4]).as_bytes());
+            i += 2;
+        }
+        String::from_utf8(out).ok().map(Cow::Owned)
+    }
+
+    /// Integer as serde reads it into an `i64`
+    ///
+    /// None for fractions, exponents and values out of range; like serde,
+    /// `-0` counts as a float.
+    pub fn i64(&self, node: usize) -> Option<i64> {
+        if self.kind(node) != Kind::Number {
+            return None;
+        }
+        let raw = self.raw(node);
+        let (negative, digits) = match raw.strip_prefix(b"-") {
+            Some(digits) => (true, digits),
+            None => (false, raw),
+        };
+        if !digits.iter().all(u8::is_ascii_digit) {
+            return None;
+        }
+        let magnitude = digits.iter().try_fold(0u64, |n, d| {
+            n.checked_mul(10)?.checked_add(u64::from(d - b'0'))
+        })?;
+        match (negative, magnitude) {
+            (false, m) => i64::try_from(m).ok(),
+            (true, m) if m != 0 && m <= 1 << 63 => Some((m as i64).wrapping_neg()),
+            (true, _) => None,
+        }
+    }
+}
+
+/// Iterator over the (key, value) nodes of an object
+pub struct Members<'t, 'a> {
+    tape: &'t Tape<'a>,
+    at: usize,
+    end: usize,
+}
+
+impl Iterator for Members<'_, '_> {
+    type Item = (usize, usize);
+
+    fn next(&mut self) -> Option<(usize, usize)> {
+        if self.at >= self.end {
+            return None;
+        }
+        let key = self.at;
+        self.at = self.tape.skip(key + 1);
+        Some((key, key + 1))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn kernels() -> Vec<Kernel> {
+        let mut all = vec![Kernel::Scalar];
+        #[cfg(target_arch = "x86_64")]
+        {
+            all.push(Kernel::Sse2);
+            if is_x86_feature_detected!("avx2") {
+                all.push(Kernel::Avx2);
+            }
+        }
+        all
+    }
+
+    /// JSON-ish text with the byte sequences the scanner has to get right:
+    /// backslash runs, escaped quotes, multi-byte text and block boundaries
+    fn sample(state: &mut u64) -> Vec<u8> {
+        const PIECES: &[&str] = &[
+            "{",
+            "}",
+            "[",
+            "]",
+            ":",
+            ",",
+            "\"",
+            "\\",
+            "\\\\",
+            "\\\"",
+            "\\u00e9",
+            "\\ud83d\\ude00",
+            "\\ud83d",
+            " ",
+            "\n",
+            "\t",
+            "0",
+            "-1",
+            "12.5e-3",
+            "01",
+            "1.",
+            "true",
+            "nul",
+            "null",
+            "\"k\":",
+            "é",
+            "\x01",
+            "x",
+            "\"text with spaces and {braces} [brackets], commas\"",
+        ];
+        let mut next = || {
+            *state ^= *state << 13;
+            *state ^= *state >> 7;
+            *state ^= *state << 17;
+            *state
+        };
+        let mut out = b"{\"type\":\"assistant\",\"message\":{\"content\":[".to_vec();
+        for _ in 0..next() % 120 {
+            out.extend(PIECES[next() as usize % PIECES.len()].as_bytes());
+        }
+        if next() % 2 == 0 {
+            out.extend(b"]}}");
+        }
+        out
+    }
+
+    #[test]
+    fn test_accepts_exactly_what_serde_accepts() {
+        let mut state = 0x2545_f491_4f6c_dd1d;
+        let mut parsers: Vec<Parser> = kernels().iter().map(|_| Parser::default()).collect();
+        let mut accepted = 0;
+
+        for case in 0..20_000 {
+            let mut json = sample(&mut state);
+            // Well-formed lines, to exercise more than the rejection paths
+            if case % 3 == 0 {
+                let text = String::from_utf8_lossy(&json).replace(['"', '\\', '\x01'], "_");
+                json = serde_json::to_vec(
+                    &serde_json::json!({"type": "assistant", "message": {"content": [text]}}),
+                )
+                .unwrap();
+            }
+            let serde_ok = serde_json::from_slice::<serde::de::IgnoredAny>(&json).is_ok();
+
+            let mut tapes = Vec::new();
+            for (parser, &kernel) in parsers.iter_mut().zip(&kernels()) {
+                let tape = parser.parse_with(&json, kernel);
+                assert_eq!(
+                    tape.is_some(),
+                    serde_ok,
+                    "{:?} on {:?}",
+                    kernel,
+                    String::from_utf8_lossy(&json)
+                );
+                tapes.push(tape.map(|t| {
+                    t.nodes
+                        .iter()
+                        .map(|n| (n.kind, n.start, n.end))
+                        .collect::<Vec<_>>()
+                }));
+            }
+            assert!(tapes.windows(2).all(|w| w[0] == w[1]));
+            accepted += serde_ok as usize;
+        }
+        assert!(accepted > 5_000);
+    }
+
+    #[test]
+    fn test_reads_values_like_serde() {
+        let json = br#"{"a":{"skip":[1,{"b":[2]}],"key":"caf\u00e9 \ud83d\ude00","n":-9223372036854775808},"z":-0}"#;
+        let mut parser = Parser::default();
+        let tape = parser.parse(json).unwrap();
+
+        let fields: Vec<_> = tape
+            .members(0)
+            .map(|(k, v)| (tape.str(k).unwrap(), v))
+            .collect();
+        assert_eq!(fields.len(), 2);
+        assert_eq!(tape.i64(fields[1].1), None);
+
+        let inner: Vec<_> = tape.members(fields[0].1).collect();
+        assert_eq!(tape.kind(inner[0].1), Kind::Array);
+        assert_eq!(tape.str(inner[1].0).unwrap(), "key");
+        assert_eq!(tape.str(inner[1].1).unwrap(), "café 😀");
+        assert_eq!(tape.i64(inner[2].1), Some(i64::MIN));
+
+        // Strings serde can skip but not keep
+        let lone = b"[\"\\udc00\", \"\xff\"]";
+        let tape = parser.parse(lone).unwrap();
+        assert_eq!((tape.str(1), tape.str(2)), (None, None));
+    }
+}
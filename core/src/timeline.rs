@@ -0,0 +1,108 @@
+//! Downsampled context-size timeline with compaction markers
+//!
+//! Keeps a fixed number of points for a whole session. When the buffer
+//! fills up, neighbouring points are merged pairwise and each point starts
+//! covering twice as many turns, so memory stays constant no matter how
+//! long the session runs.
+
+/// Number of points kept per session
+pub const TIMELINE_LEN: usize = 32;
+
+/// One point of the timeline
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct TimelinePoint {
+    /// Peak context size within the point's span
+    pub tokens: i64,
+    /// Whether the session compacted within the point's span
+    pub compacted: bool,
+}
+
+impl TimelinePoint {
+    fn merge(self, other: TimelinePoint) -> TimelinePoint {
+        TimelinePoint {
+            tokens: self.tokens.max(other.tokens),
+            compacted: self.compacted || other.compacted,
+        }
+    }
+}
+
+/// Fixed-size context timeline for one session
+#[derive(Debug, Clone)]
+pub struct ContextTimeline {
+    points: [TimelinePoint; TIMELINE_LEN],
+    len: usize,
+    /// Samples covered by each point
+    stride: u32,
+    /// Samples merged into the last point so far
+    filled: u32,
+    pending_compaction: bool,
+}
+
+impl Default for ContextTimeline {
+    fn default() -> Self {
+        ContextTimeline {
+            points: [TimelinePoint::default(); TIMELINE_LEN],
+            len: 0,
+            stride: 1,
+            filled: 0,
+            pending_compaction: false,
+        }
+    }
+}
+
+impl ContextTimeline {
+    /// Mark that the session compacted; attached to the next sample
+    pub fn mark_compaction(&mut self) {
+        self.pending_compaction = true;
+    }
+
+    /// Record the context size of a new turn
+    pub fn push(&mut self, tokens: i64) {
+        let point = TimelinePoint {
+            tokens,
+            compacted: std::mem::take(&mut self.pending_compaction),
+        };
+
+        if self.len > 0 && self.filled < self.stride {
+            self.points[self.len - 1] = self.points[self.len - 1].merge(point);
+            self.filled += 1;
+            return;
+        }
+
+        if self.len == TIMELINE_LEN {
+            for i in 0..TIMELINE_LEN / 2 {
+                self.points[i] = self.points[2 * i].merge(self.points[2 * i + 1]);
+            }
+            self.len = TIMELINE_LEN / 2;
+            self.stride *= 2;
+        }
+
+        self.points[self.len] = point;
+        self.len += 1;
+        self.filled = 1;
+    }
+
+    /// Points from oldest to newest
+    pub fn points(&self) -> &[TimelinePoint] {
+        &self.points[..self.len]
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_downsamples_without_losing_compaction() {
+        let mut t = ContextTimeline::default();
+        for i in 0..1000 {
+            if i == 500 {
+                t.mark_compaction();
+            }
+            t.push(i);
+        }
+        assert!(t.points().len() <= TIMELINE_LEN);
+        assert_eq!(t.points().last().unwrap().tokens, 999);
+        assert_eq!(t.points().iter().filter(|p| p.compacted).count(), 1);
+    }
+}
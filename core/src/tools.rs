@@ -0,0 +1,390 @@
+//! Per-tool context attribution
+//!
+//! Tool calls and their results are most of what fills a long session's
+//! context. Rather than deserializing every `tool_result` content array,
+//! this scanner walks the raw line: it picks the id and name out of
+//! `tool_use` blocks in assistant lines and measures the serialized size
+//! of `tool_use` inputs and `tool_result` contents by skipping over them,
+//! without decoding or copying any string.
+//!
+//! Sizes are bytes of JSON as written to the transcript, which tracks the
+//! tokens a result costs closely enough to rank tools.
+
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::ops::Range;
+
+/// Tools reported in `ContextInfo::tools`
+pub const TOP_TOOLS: usize = 5;
+
+/// Unanswered tool calls remembered before the oldest are forgotten
+const MAX_PENDING: usize = 4096;
+
+/// Tool call ids remembered for spotting repeated `tool_use` blocks
+const MAX_SEEN: usize = 4096;
+
+/// Share of the context taken by one tool
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ToolShare {
+    /// Tool name; MCP tools are grouped per server as `mcp:<server>`
+    pub name: String,
+    pub calls: i64,
+    /// Serialized size of the tool's inputs and results
+    pub bytes: i64,
+}
+
+/// Tool attribution for one session, updated line by line
+#[derive(Debug, Default, Clone)]
+pub struct ToolUsage {
+    names: Vec<String>,
+    calls: Vec<i64>,
+    bytes: Vec<i64>,
+    /// Tool of each call still waiting for its result, by tool_use id
+    pending: HashMap<String, usize>,
+    /// Recent tool_use ids, answered or not, oldest first in `seen_order`
+    seen: HashSet<String>,
+    seen_order: VecDeque<String>,
+}
+
+impl ToolUsage {
+    /// Account for the tool blocks of one transcript line
+    pub fn scan_line(&mut self, line: &[u8]) {
+        // Nearly all lines have no tool blocks at all
+        if !contains(line, b"\"tool_") {
+            return;
+        }
+        let mut entry_type = None;
+        let mut message = None;
+        for (key, value) in fields(line, skip_ws(line, 0)) {
+            match key {
+                b"type" => entry_type = str_at(line, value),
+                b"isSidechain" if &line[value.clone()] == b"true" => return,
+                b"message" => message = Some(value),
+                _ => {}
+            }
+        }
+        let content = match message.and_then(|m| field(line, m.start, b"content")) {
+            Some(c) if line.get(c.start) == Some(&b'[') => c,
+            _ => return,
+        };
+
+        match entry_type {
+            Some("assistant") => self.scan_tool_uses(line, content.start),
+            Some("user") => self.scan_tool_results(line, content.start),
+            _ => {}
+        }
+    }
+
+    fn scan_tool_uses(&mut self, line: &[u8], content: usize) {
+        for block in elements(line, content) {
+            let (mut kind, mut id, mut name, mut input) = (None, None, None, 0);
+            for (key, value) in fields(line, block.start) {
+                match key {
+                    b"type" => kind = str_at(line, value),
+                    b"id" => id = str_at(line, value),
+                    b"name" => name = str_at(line, value),
+                    b"input" => input = value.len(),
+                    _ => {}
+                }
+            }
+            if let (Some("tool_use"), Some(id), Some(name)) = (kind, id, name) {
+                // Streaming can repeat a block, even after its result;
+                // count each call once
+                if !self.seen.insert(id.to_string()) {
+                    continue;
+                }
+                if self.seen_order.len() >= MAX_SEEN {
+                    if let Some(old) = self.seen_order.pop_front() {
+                        self.seen.remove(&old);
+                    }
+                }
+                self.seen_order.push_back(id.to_string());
+                if self.pending.len() >= MAX_PENDING {
+                    self.pending.clear();
+                }
+                let tool = self.tool_index(name);
+                self.pending.insert(id.to_string(), tool);
+                self.calls[tool] += 1;
+                self.bytes[tool] += input as i64;
+            }
+        }
+    }
+
+    fn scan_tool_results(&mut self, line: &[u8], content: usize) {
+        for block in elements(line, content) {
+            let (mut kind, mut id, mut size) = (None, None, 0);
+            for (key, value) in fields(line, block.start) {
+                match key {
+                    b"type" => kind = str_at(line, value),
+                    b"tool_use_id" => id = str_at(line, value),
+                    b"content" => size = value.len(),
+                    _ => {}
+                }
+            }
+            if kind != Some("tool_result") {
+                continue;
+            }
+            // Results whose call was not seen (e.g. before a resume) still count
+            let tool = match id.and_then(|id| self.pending.remove(id)) {
+                Some(tool) => tool,
+                None => self.tool_index("unknown"),
+            };
+            self.bytes[tool] += size as i64;
+        }
+    }
+
+    fn tool_index(&mut self, name: &str) -> usize {
+        let name = display_name(name);
+        match self.names.iter().position(|n| *n == name) {
+            Some(idx) => idx,
+            None => {
+                self.names.push(name.into_owned());
+                self.calls.push(0);
+                self.bytes.push(0);
+                self.names.len() - 1
+            }
+        }
+    }
+
+    /// Forget what the context held, e.g. after compaction
+    pub fn reset(&mut self) {
+        self.calls.iter_mut().for_each(|n| *n = 0);
+        self.bytes.iter_mut().for_each(|n| *n = 0);
+    }
+
+    /// The `n` tools taking the most context, largest first
+    pub fn top(&self, n: usize) -> Vec<ToolShare> {
+        let mut order: Vec<usize> = (0..self.names.len()).filter(|&i| self.bytes[i] > 0).collect();
+        order.sort_by(|&a, &b| self.bytes[b].cmp(&self.bytes[a]).then(a.cmp(&b)));
+        order
+            .into_iter()
+            .take(n)
+            .map(|i| ToolShare {
+                name: self.names[i].clone(),
+                calls: self.calls[i],
+                bytes: self.bytes[i],
+            })
+            .collect()
+    }
+}
+
+/// `mcp__github__create_issue` becomes `mcp:github`
+fn display_name(name: &str) -> std::borrow::Cow<'_, str> {
+    match name.strip_prefix("mcp__").and_then(|rest| rest.split("__").next()) {
+        Some(server) => format!("mcp:{}", server).into(),
+        None => name.into(),
+    }
+}
+
+fn contains(haystack: &[u8], needle: &[u8]) -> bool {
+    let first = needle[0];
+    haystack
+        .iter()
+        .enumerate()
+        .filter(|&(_, &b)| b == first)
+        .any(|(i, _)| haystack[i..].starts_with(needle))
+}
+
+fn skip_ws(b: &[u8], mut i: usize) -> usize {
+    while i < b.len() && matches!(b[i], b' ' | b'\t' | b'\n' | b'\r') {
+        i += 1;
+    }
+    i
+}
+
+/// End of the string starting at the quote at `i`
+fn skip_string(b: &[u8], mut i: usize) -> Option<usize> {
+    i += 1;
+    loop {
+        i += b.get(i..)?.iter().position(|&c| c == b'"' || c == b'\\')?;
+        if b[i] == b'\\' {
+            i += 2;
+        } else {
+            return Some(i + 1);
+        }
+    }
+}
+
+/// End of the JSON value starting at `i`
+fn skip_value(b: &[u8], i: usize) -> Option<usize> {
+    match *b.get(i)? {
+        b'"' => skip_string(b, i),
+        b'{' | b'[' => {
+            let mut depth = 0usize;
+            let mut j = i;
+            loop {
+                match *b.get(j)? {
+                    b'"' => {
+                        j = skip_string(b, j)?;
+                        continue;
+                    }
+                    b'{' | b'[' => depth += 1,
+                    b'}' | b']' => {
+                        depth -= 1;
+                        if depth == 0 {
+                            return Some(j + 1);
+                        }
+                    }
+                    _ => {}
+                }
+                j += 1;
+            }
+        }
+        _ => {
+            let len = b[i..]
+                .iter()
+                .position(|&c| matches!(c, b',' | b'}' | b']' | b' ' | b'\t' | b'\n' | b'\r'))
+                .unwrap_or(b.len() - i);
+            Some(i + len)
+        }
+    }
+}
+
+/// Raw contents of a string value without escapes; `None` otherwise
+fn str_at(b: &[u8], value: Range<usize>) -> Option<&str> {
+    let raw = b.get(value.start + 1..value.end.checked_sub(1)?)?;
+    if b[value.start] != b'"' || raw.contains(&b'\\') {
+        return None;
+    }
+    std::str::from_utf8(raw).ok()
+}
+
+/// Key and value span of each member of the object at `i`
+fn fields(b: &[u8], i: usize) -> impl Iterator<Item = (&[u8], Range<usize>)> {
+    let mut pos = if b.get(i) == Some(&b'{') { Some(i + 1) } else { None };
+    std::iter::from_fn(move || {
+        let mut i = skip_ws(b, pos?);
+        if b.get(i) == Some(&b',') {
+            i = skip_ws(b, i + 1);
+        }
+        if b.get(i) != Some(&b'"') {
+            pos = None;
+            return None;
+        }
+        let key_end = skip_string(b, i)?;
+        let colon = skip_ws(b, key_end);
+        if b.get(colon) != Some(&b':') {
+            pos = None;
+            return None;
+        }
+        let start = skip_ws(b, colon + 1);
+        let end = skip_value(b, start)?;
+        pos = Some(end);
+        Some((&b[i + 1..key_end - 1], start..end))
+    })
+}
+
+/// Value span of `key` in the object at `i`
+fn field(b: &[u8], i: usize, key: &[u8]) -> Option<Range<usize>> {
+    fields(b, i).find(|(k, _)| *k == key).map(|(_, v)| v)
+}
+
+/// Span of each element of the array at `i`
+fn elements(b: &[u8], i: usize) -> impl Iterator<Item = Range<usize>> + '_ {
+    let mut pos = if b.get(i) == Some(&b'[') { Some(i + 1) } else { None };
+    std::iter::from_fn(move || {
+        let mut i = skip_ws(b, pos?);
+        if b.get(i) == Some(&b',') {
+            i = skip_ws(b, i + 1);
+        }
+        if matches!(b.get(i), None | Some(b']')) {
+            pos = None;
+            return None;
+        }
+        let end = skip_value(b, i)?;
+        pos = Some(end);
+        Some(i..end)
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::{json, Value};
+
+    /// Same attribution counted over unique call ids from parsed JSON
+    fn reference(lines: &[Value]) -> Vec<(String, i64, i64)> {
+        // Tool name of each call id, from the first block with that id
+        let mut calls: HashMap<String, String> = HashMap::new();
+        // (name, calls, bytes) in order of first appearance
+        let mut tools: Vec<(String, i64, i64)> = Vec::new();
+        let mut add = |name: &str, calls: i64, bytes: i64| {
+            let name = match name.strip_prefix("mcp__") {
+                Some(rest) => format!("mcp:{}", rest.split("__").next().unwrap()),
+                None => name.to_string(),
+            };
+            match tools.iter_mut().find(|t| t.0 == name) {
+                Some(t) => {
+                    t.1 += calls;
+                    t.2 += bytes;
+                }
+                None => tools.push((name, calls, bytes)),
+            }
+        };
+
+        for line in lines {
+            if line["isSidechain"] == json!(true) {
+                continue;
+            }
+            for block in line["message"]["content"].as_array().into_iter().flatten() {
+                match (line["type"].as_str(), block["type"].as_str()) {
+                    (Some("assistant"), Some("tool_use")) => {
+                        let id = block["id"].as_str().unwrap();
+                        if calls.contains_key(id) {
+                            continue;
+                        }
+                        let name = block["name"].as_str().unwrap();
+                        calls.insert(id.to_string(), name.to_string());
+                        add(name, 1, block["input"].to_string().len() as i64);
+                    }
+                    (Some("user"), Some("tool_result")) => {
+                        let id = block["tool_use_id"].as_str().unwrap();
+                        let name = calls.get(id).map_or("unknown", String::as_str);
+                        add(name, 0, block["content"].to_string().len() as i64);
+                    }
+                    _ => {}
+                }
+            }
+        }
+
+        let mut order: Vec<usize> = (0..tools.len()).filter(|&i| tools[i].2 > 0).collect();
+        order.sort_by(|&a, &b| tools[b].2.cmp(&tools[a].2).then(a.cmp(&b)));
+        order.into_iter().map(|i| tools[i].clone()).collect()
+    }
+
+    #[test]
+    fn test_scanner_matches_parsed_json() {
+        // Compact serialization, so raw spans equal re-serialized lengths
+        let lines = vec![
+            json!({"type":"assistant","message":{"content":[
+                {"type":"text","text":"reading \"a\" {["},
+                {"type":"tool_use","id":"t1","name":"Read","input":{"file_path":"/a.rs"}},
+                {"type":"tool_use","id":"t2","name":"mcp__github__get_issue","input":{"n":[1,2,{"x":"]}"}]}}]}}),
+            json!({"type":"user","message":{"content":[
+                {"type":"tool_result","tool_use_id":"t1","content":"fn main() {\n    println!(\"}\\\\\");\n}"},
+                {"type":"tool_result","tool_use_id":"t2","content":[{"type":"text","text":"héllo ✓"}]}]}}),
+            json!({"type":"assistant","isSidechain":true,"message":{"content":[
+                {"type":"tool_use","id":"t3","name":"Bash","input":{"command":"ls"}}]}}),
+            json!({"type":"assistant","message":{"content":[
+                {"type":"tool_use","id":"t1","name":"Read","input":{"file_path":"/a.rs"}},
+                {"type":"tool_use","id":"t4","name":"mcp__github__list","input":{}}]}}),
+            json!({"type":"user","message":{"content":[
+                {"type":"tool_result","tool_use_id":"t4","content":"[]"},
+                {"type":"tool_result","tool_use_id":"gone","content":"orphan"}]}}),
+            json!({"type":"user","message":{"content":"plain \"tool_use\" text"}}),
+        ];
+
+        let mut usage = ToolUsage::default();
+        for line in &lines {
+            usage.scan_line(line.to_string().as_bytes());
+        }
+        let got: Vec<_> = usage.top(usize::MAX).into_iter().map(|t| (t.name, t.calls, t.bytes)).collect();
+        assert_eq!(got, reference(&lines));
+        assert_eq!(got.iter().find(|t| t.0 == "mcp:github").unwrap().1, 2);
+        // t1 repeated after its result is still one call
+        assert_eq!(got.iter().find(|t| t.0 == "Read").unwrap().1, 1);
+        assert!(got.iter().all(|t| t.0 != "Bash"));
+
+        usage.reset();
+        assert!(usage.top(TOP_TOOLS).is_empty());
+    }
+}
@@ -1,12 +1,19 @@
 //! Transcript parsing for context window usage
 
+use chrono::DateTime;
 use serde::Deserialize;
+use std::collections::{HashMap, VecDeque};
 use std::fs::{self, File};
-use std::io::{BufRead, BufReader};
-use std::path::PathBuf;
+use std::io::{Read, Seek, SeekFrom};
+use std::path::{Path, PathBuf};
 use std::time::SystemTime;
 use thiserror::Error;
 
+use crate::forecast::{self, ContextForecast, GrowthForecast};
+use crate::tape::{self, Kind, Tape};
+use crate::timeline::{ContextTimeline, TimelinePoint};
+use crate::tools::{ToolShare, ToolUsage, TOP_TOOLS};
+
 #[derive(Debug, Error)]
 pub enum TranscriptError {
     #[error("Failed to read transcript: {0}")]
@@ -17,26 +24,59 @@ pub enum TranscriptError {
     ParseError(String),
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub struct ContextInfo {
     pub context_pct: f64,
     pub context_tokens: i64,
     pub context_window_size: i64,
     pub model_name: Option<String>,
+    pub forecast: Option<ContextForecast>,
+    pub timeline: Vec<TimelinePoint>,
+    /// Tokens spent by subagents spawned from this session
+    pub sidechain: SidechainUsage,
+    /// Tools whose calls and results take the most context, largest first
+    pub tools: Vec<ToolShare>,
+    /// Machine the session runs on, if it was reported by a remote agent
+    pub host: Option<String>,
+}
+
+/// Token usage of a session's subagent (sidechain) messages
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct SidechainUsage {
+    /// Distinct subagent API messages
+    pub messages: i64,
+    /// Input tokens, including cache reads and writes
+    pub input_tokens: i64,
+    pub output_tokens: i64,
 }
 
 /// Default context window size (200K tokens)
 const CONTEXT_WINDOW_DEFAULT: i64 = 200_000;
 
+/// Fraction of the window at which Claude Code auto-compacts a session
+const AUTO_COMPACT_FRACTION: f64 = 0.92;
+
+/// Maximum number of sessions whose tail state is kept
+const MAX_TRACKED_SESSIONS: usize = 8;
+
+/// Subagent messages remembered per session; parallel subagents interleave
+/// their streaming lines, but only a few messages are in flight at once
+const MAX_SIDECHAIN_MESSAGES: usize = 64;
+
 #[derive(Debug, Deserialize)]
 struct TranscriptEntry {
     #[serde(rename = "type")]
     entry_type: Option<String>,
+    subtype: Option<String>,
+    timestamp: Option<String>,
+    #[serde(rename = "isSidechain")]
+    is_sidechain: Option<bool>,
     message: Option<MessageData>,
 }
 
 #[derive(Debug, Deserialize)]
 struct MessageData {
+    id: Option<String>,
     model: Option<String>,
     usage: Option<UsageData>,
 }
@@ -44,26 +84,163 @@ struct MessageData {
 #[derive(Debug, Deserialize)]
 struct UsageData {
     input_tokens: Option<i64>,
+    output_tokens: Option<i64>,
     cache_creation_input_tokens: Option<i64>,
     cache_read_input_tokens: Option<i64>,
 }
 
-/// Find the most recently modified transcript file
-fn find_latest_transcript() -> Result<PathBuf, TranscriptError> {
-    let projects_dir = dirs::home_dir()
-        .ok_or(TranscriptError::NoTranscripts)?
-        .join(".claude")
-        .join("projects");
+/// JSON parser used for transcript lines
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum JsonBackend {
+    /// serde_json for every line
+    Serde,
+    /// Structural-index tape, falling back to serde for shapes it leaves out
+    Tape,
+}
+
+impl JsonBackend {
+    /// Backend named by `CLAUDE_STATUS_JSON` (`serde` or `tape`), the tape
+    /// if unset
+    pub fn from_env() -> Self {
+        match std::env::var("CLAUDE_STATUS_JSON").as_deref() {
+            Ok("serde") => JsonBackend::Serde,
+            _ => JsonBackend::Tape,
+        }
+    }
+}
+
+impl Default for JsonBackend {
+    fn default() -> Self {
+        JsonBackend::from_env()
+    }
+}
+
+/// Why a line was not decoded from its tape
+enum TapeMiss {
+    /// serde rejects the line as well
+    Invalid,
+    /// A struct written as an array, which serde decodes by position
+    Unsupported,
+}
+
+/// Value nodes of the fields `names` of a struct at `node`
+///
+/// Keys are checked the way serde's derive checks them: every key must be
+/// a valid string and a known field may appear only once.
+fn struct_fields<const N: usize>(
+    tape: &Tape,
+    node: usize,
+    names: [&str; N],
+) -> Result<[Option<usize>; N], TapeMiss> {
+    match tape.kind(node) {
+        Kind::Object => {}
+        Kind::Array => return Err(TapeMiss::Unsupported),
+        _ => return Err(TapeMiss::Invalid),
+    }
+    let mut values = [None; N];
+    for (key, value) in tape.members(node) {
+        let key = tape.str(key).ok_or(TapeMiss::Invalid)?;
+        if let Some(i) = names.iter().position(|name| *name == key) {
+            if values[i].replace(value).is_some() {
+                return Err(TapeMiss::Invalid);
+            }
+        }
+    }
+    Ok(values)
+}
+
+/// Value of an optional field; absent and null both read as `None`
+fn present(tape: &Tape, node: Option<usize>) -> Option<usize> {
+    node.filter(|&n| tape.kind(n) != Kind::Null)
+}
+
+fn opt_string(tape: &Tape, node: Option<usize>) -> Result<Option<String>, TapeMiss> {
+    match present(tape, node) {
+        None => Ok(None),
+        Some(n) if tape.kind(n) == Kind::String => {
+            tape.str(n).map(|s| Some(s.into_owned())).ok_or(TapeMiss::Invalid)
+        }
+        Some(_) => Err(TapeMiss::Invalid),
+    }
+}
+
+fn opt_i64(tape: &Tape, node: Option<usize>) -> Result<Option<i64>, TapeMiss> {
+    match present(tape, node) {
+        None => Ok(None),
+        Some(n) => tape.i64(n).map(Some).ok_or(TapeMiss::Invalid),
+    }
+}
+
+fn opt_usage(tape: &Tape, node: Option<usize>) -> Result<Option<UsageData>, TapeMiss> {
+    let node = match present(tape, node) {
+        Some(node) => node,
+        None => return Ok(None),
+    };
+    let [input, output, cache_creation, cache_read] = struct_fields(
+        tape,
+        node,
+        [
+            "input_tokens",
+            "output_tokens",
+            "cache_creation_input_tokens",
+            "cache_read_input_tokens",
+        ],
+    )?;
+    Ok(Some(UsageData {
+        input_tokens: opt_i64(tape, input)?,
+        output_tokens: opt_i64(tape, output)?,
+        cache_creation_input_tokens: opt_i64(tape, cache_creation)?,
+        cache_read_input_tokens: opt_i64(tape, cache_read)?,
+    }))
+}
+
+fn opt_message(tape: &Tape, node: Option<usize>) -> Result<Option<MessageData>, TapeMiss> {
+    let node = match present(tape, node) {
+        Some(node) => node,
+        None => return Ok(None),
+    };
+    let [id, model, usage] = struct_fields(tape, node, ["id", "model", "usage"])?;
+    Ok(Some(MessageData {
+        id: opt_string(tape, id)?,
+        model: opt_string(tape, model)?,
+        usage: opt_usage(tape, usage)?,
+    }))
+}
+
+/// Decode a transcript line from its tape, with serde's result
+fn entry_from_tape(tape: &Tape) -> Result<TranscriptEntry, TapeMiss> {
+    let [entry_type, subtype, timestamp, is_sidechain, message] =
+        struct_fields(tape, 0, ["type", "subtype", "timestamp", "isSidechain", "message"])?;
+    let is_sidechain = match is_sidechain.map(|n| tape.kind(n)) {
+        None | Some(Kind::Null) => None,
+        Some(Kind::False) => Some(false),
+        Some(Kind::True) => Some(true),
+        Some(_) => return Err(TapeMiss::Invalid),
+    };
+    Ok(TranscriptEntry {
+        entry_type: opt_string(tape, entry_type)?,
+        subtype: opt_string(tape, subtype)?,
+        timestamp: opt_string(tape, timestamp)?,
+        is_sidechain,
+        message: opt_message(tape, message)?,
+    })
+}
 
+/// Directory Claude Code writes transcripts into
+pub fn default_projects_dir() -> Option<PathBuf> {
+    dirs::home_dir().map(|h| h.join(".claude").join("projects"))
+}
+
+/// List transcript files below a projects directory with their mtimes
+pub(crate) fn list_transcripts(projects_dir: &Path) -> Result<Vec<(PathBuf, SystemTime)>, TranscriptError> {
     if !projects_dir.exists() {
         return Err(TranscriptError::NoTranscripts);
     }
 
-    let mut latest_path: Option<PathBuf> = None;
-    let mut latest_time: Option<SystemTime> = None;
+    let mut transcripts = Vec::new();
 
     // Iterate through project directories
-    for project_entry in fs::read_dir(&projects_dir)? {
+    for project_entry in fs::read_dir(projects_dir)? {
         let project_entry = project_entry?;
         let project_path = project_entry.path();
 
@@ -79,68 +256,502 @@ fn find_latest_transcript() -> Result<PathBuf, TranscriptError> {
             if file_path.extension().map_or(false, |ext| ext == "jsonl") {
                 if let Ok(metadata) = file_entry.metadata() {
                     if let Ok(modified) = metadata.modified() {
-                        if latest_time.is_none() || Some(modified) > latest_time {
-                            latest_time = Some(modified);
-                            latest_path = Some(file_path);
-                        }
+                        transcripts.push((file_path, modified));
                     }
                 }
             }
         }
     }
 
-    latest_path.ok_or(TranscriptError::NoTranscripts)
+    Ok(transcripts)
 }
 
-/// Read context window usage from the latest transcript
-pub fn read_context() -> Result<ContextInfo, TranscriptError> {
-    let transcript_path = find_latest_transcript()?;
-    let file = File::open(&transcript_path)?;
-    let reader = BufReader::new(file);
+/// Find the most recently modified transcript file and its mtime
+fn find_latest_transcript(projects_dir: &Path) -> Result<(PathBuf, SystemTime), TranscriptError> {
+    list_transcripts(projects_dir)?
+        .into_iter()
+        .max_by_key(|(_, modified)| *modified)
+        .ok_or(TranscriptError::NoTranscripts)
+}
 
-    let mut last_input: i64 = 0;
-    let mut last_cache_creation: i64 = 0;
-    let mut last_cache_read: i64 = 0;
-    let mut last_model: Option<String> = None;
+/// Seconds since the Unix epoch of a modification time
+pub(crate) fn unix_secs(time: SystemTime) -> Option<i64> {
+    time.duration_since(SystemTime::UNIX_EPOCH)
+        .ok()
+        .map(|d| d.as_secs() as i64)
+}
 
-    for line in reader.lines() {
-        let line = line?;
-        if line.is_empty() {
-            continue;
+/// Context state of one session, updated line by line
+#[derive(Debug, Default, Clone)]
+struct SessionState {
+    last_input: i64,
+    last_cache_creation: i64,
+    last_cache_read: i64,
+    last_model: Option<String>,
+    last_message_id: Option<String>,
+    forecast: GrowthForecast,
+    timeline: ContextTimeline,
+    sidechain: SidechainUsage,
+    /// What recent subagent messages have contributed so far, so that
+    /// later streaming lines of a message replace rather than add
+    sidechain_seen: HashMap<String, SidechainUsage>,
+    sidechain_order: VecDeque<String>,
+    tools: ToolUsage,
+    backend: JsonBackend,
+    parser: tape::Parser,
+}
+
+impl SessionState {
+    fn new(backend: JsonBackend) -> Self {
+        SessionState {
+            backend,
+            ..Default::default()
+        }
+    }
+
+    /// Decode a line, or None if serde rejects it
+    fn parse_entry(&mut self, line: &[u8]) -> Option<TranscriptEntry> {
+        if self.backend == JsonBackend::Tape && line.len() <= tape::MAX_LEN {
+            let parsed = match self.parser.parse(line) {
+                Some(tape) => entry_from_tape(&tape),
+                None => Err(TapeMiss::Invalid),
+            };
+            match parsed {
+                Ok(entry) => return Some(entry),
+                Err(TapeMiss::Invalid) => return None,
+                Err(TapeMiss::Unsupported) => {}
+            }
+        }
+        serde_json::from_slice(line).ok()
+    }
+
+    fn apply_line(&mut self, line: &[u8]) {
+        self.tools.scan_line(line);
+
+        // Silently skip lines that don't parse
+        let entry = match self.parse_entry(line) {
+            Some(entry) => entry,
+            None => return,
+        };
+
+        // Compaction writes a boundary marker before the summary
+        if entry.entry_type.as_deref() == Some("system")
+            && entry.subtype.as_deref() == Some("compact_boundary")
+        {
+            self.timeline.mark_compaction();
+            self.tools.reset();
+            return;
+        }
+
+        // Only process assistant messages
+        if entry.entry_type.as_deref() != Some("assistant") {
+            return;
         }
 
-        // Try to parse each line as JSON
-        if let Ok(entry) = serde_json::from_str::<TranscriptEntry>(&line) {
-            // Only process assistant messages
-            if entry.entry_type.as_deref() != Some("assistant") {
-                continue;
+        let message = match entry.message {
+            Some(m) => m,
+            None => return,
+        };
+
+        // Subagent traffic runs in its own context; keep it out of the
+        // main thread's numbers
+        if entry.is_sidechain == Some(true) {
+            if let Some(usage) = message.usage {
+                self.apply_sidechain_usage(message.id, &usage);
             }
+            return;
+        }
 
-            if let Some(message) = entry.message {
-                // Update model name if present
-                if let Some(model) = message.model {
-                    last_model = Some(model);
+        // Update model name if present
+        if let Some(model) = message.model {
+            self.last_model = Some(model);
+        }
+
+        // Update usage if present
+        if let Some(usage) = message.usage {
+            let prev_total = self.total_tokens();
+            self.last_input = usage.input_tokens.unwrap_or(0);
+            self.last_cache_creation = usage.cache_creation_input_tokens.unwrap_or(0);
+            self.last_cache_read = usage.cache_read_input_tokens.unwrap_or(0);
+
+            // Streaming writes several lines per API message; only the first
+            // one starts a new turn for the growth fit
+            let new_turn = message.id.is_none() || message.id != self.last_message_id;
+            if new_turn {
+                let ts = entry
+                    .timestamp
+                    .as_deref()
+                    .and_then(|t| DateTime::parse_from_rfc3339(t).ok())
+                    .map(|t| t.timestamp());
+                let total = self.total_tokens();
+                if forecast::is_compaction_drop(prev_total, total) {
+                    self.timeline.mark_compaction();
+                    self.tools.reset();
                 }
+                self.forecast.observe(total, ts);
+                self.timeline.push(total);
+            }
+            self.last_message_id = message.id;
+        }
+    }
+
+    fn apply_sidechain_usage(&mut self, id: Option<String>, usage: &UsageData) {
+        let counted = SidechainUsage {
+            messages: 1,
+            input_tokens: usage.input_tokens.unwrap_or(0)
+                + usage.cache_creation_input_tokens.unwrap_or(0)
+                + usage.cache_read_input_tokens.unwrap_or(0),
+            output_tokens: usage.output_tokens.unwrap_or(0),
+        };
 
-                // Update usage if present
-                if let Some(usage) = message.usage {
-                    last_input = usage.input_tokens.unwrap_or(0);
-                    last_cache_creation = usage.cache_creation_input_tokens.unwrap_or(0);
-                    last_cache_read = usage.cache_read_input_tokens.unwrap_or(0);
+        self.sidechain.messages += counted.messages;
+        self.sidechain.input_tokens += counted.input_tokens;
+        self.sidechain.output_tokens += counted.output_tokens;
+
+        let id = match id {
+            Some(id) => id,
+            None => return,
+        };
+        match self.sidechain_seen.insert(id.clone(), counted) {
+            Some(last) => {
+                self.sidechain.messages -= last.messages;
+                self.sidechain.input_tokens -= last.input_tokens;
+                self.sidechain.output_tokens -= last.output_tokens;
+            }
+            None => {
+                if self.sidechain_order.len() == MAX_SIDECHAIN_MESSAGES {
+                    if let Some(old) = self.sidechain_order.pop_front() {
+                        self.sidechain_seen.remove(&old);
+                    }
                 }
+                self.sidechain_order.push_back(id);
             }
         }
-        // Silently skip lines that don't parse
     }
 
-    let total_context = last_input + last_cache_creation + last_cache_read;
-    let context_window = CONTEXT_WINDOW_DEFAULT;
-    let context_pct = (total_context as f64 / context_window as f64 * 100.0).min(100.0);
+    fn total_tokens(&self) -> i64 {
+        self.last_input + self.last_cache_creation + self.last_cache_read
+    }
 
-    Ok(ContextInfo {
-        context_pct,
-        context_tokens: total_context,
-        context_window_size: context_window,
-        model_name: last_model,
-    })
+    fn context_info(&self) -> ContextInfo {
+        let total_context = self.total_tokens();
+        let context_window = CONTEXT_WINDOW_DEFAULT;
+        let context_pct = (total_context as f64 / context_window as f64 * 100.0).min(100.0);
+        let compact_at = (context_window as f64 * AUTO_COMPACT_FRACTION) as i64;
+
+        ContextInfo {
+            context_pct,
+            context_tokens: total_context,
+            context_window_size: context_window,
+            model_name: self.last_model.clone(),
+            forecast: self.forecast.predict(total_context, compact_at),
+            timeline: self.timeline.points().to_vec(),
+            sidechain: self.sidechain,
+            tools: self.tools.top(TOP_TOOLS),
+            host: None,
+        }
+    }
+}
+
+/// Read position within an append-only JSONL file
+///
+/// Only newline-terminated lines are handed out; a trailing partial write is
+/// kept until the rest of it arrives.
+#[derive(Debug, Default)]
+pub struct TailReader {
+    offset: u64,
+    pending: Vec<u8>,
+}
+
+impl TailReader {
+    /// Feed every line appended since the last call to `on_line`
+    ///
+    /// Returns `false` without reading anything if the file shrank; the
+    /// reader is rewound and the caller should drop derived state and call
+    /// again.
+    pub fn read_appended(
+        &mut self,
+        path: &Path,
+        mut on_line: impl FnMut(&[u8]),
+    ) -> std::io::Result<bool> {
+        let mut file = File::open(path)?;
+        let len = file.metadata()?.len();
+
+        if len < self.offset {
+            *self = TailReader::default();
+            return Ok(false);
+        }
+        if len == self.offset {
+            return Ok(true);
+        }
+
+        file.seek(SeekFrom::Start(self.offset))?;
+        // What is already pending holds no newline; only scan the new bytes
+        let mut scan = self.pending.len();
+        let read = file.take(len - self.offset).read_to_end(&mut self.pending)?;
+        self.offset += read as u64;
+
+        let mut start = 0;
+        while let Some(pos) = self.pending[scan..].iter().position(|&b| b == b'\n') {
+            let end = scan + pos;
+            let line = &self.pending[start..end];
+            if !line.is_empty() {
+                on_line(line);
+            }
+            start = end + 1;
+            scan = start;
+        }
+        self.pending.drain(..start);
+
+        Ok(true)
+    }
+
+    /// Bytes after the last newline, if any
+    fn pending_line(&self) -> Option<&[u8]> {
+        Some(&self.pending[..]).filter(|line| !line.is_empty())
+    }
+}
+
+/// Tail position and state for one transcript file
+#[derive(Debug)]
+struct TrackedSession {
+    path: PathBuf,
+    tail: TailReader,
+    state: SessionState,
+}
+
+impl TrackedSession {
+    fn new(path: PathBuf, backend: JsonBackend) -> Self {
+        TrackedSession {
+            path,
+            tail: TailReader::default(),
+            state: SessionState::new(backend),
+        }
+    }
+
+    /// Consume whatever was appended since the last call
+    fn update(&mut self) -> Result<(), TranscriptError> {
+        let state = &mut self.state;
+        if !self.tail.read_appended(&self.path, |line| state.apply_line(line))? {
+            // Truncated or replaced: start over
+            self.state = SessionState::new(self.state.backend);
+            let state = &mut self.state;
+            self.tail.read_appended(&self.path, |line| state.apply_line(line))?;
+        }
+        Ok(())
+    }
+
+    /// Context including a last line that has no newline yet
+    ///
+    /// Lines are only consumed once their newline arrives, since a writer
+    /// may be mid-line, but a transcript can also just end without one.
+    /// The last line is then applied to a copy of the state, as a read of
+    /// the whole file would.
+    fn context_info(&self) -> ContextInfo {
+        // Only a whole JSON value parses, and only tool blocks count without
+        // parsing; anything else is a torn write that changes nothing
+        let may_count = |line: &&[u8]| {
+            matches!(line.iter().rev().find(|b| !b.is_ascii_whitespace()), Some(b'}' | b']'))
+                || line.windows(6).any(|w| w == b"\"tool_")
+        };
+        match self.tail.pending_line().filter(may_count) {
+            Some(line) => {
+                let mut state = self.state.clone();
+                state.apply_line(line);
+                state.context_info()
+            }
+            None => self.state.context_info(),
+        }
+    }
+}
+
+/// Incremental reader for transcript context
+///
+/// Remembers how far each recently seen transcript has been read so that
+/// every refresh only parses newly appended lines.
+#[derive(Debug, Default)]
+pub struct TranscriptTracker {
+    /// Projects directory to scan; the default one if unset
+    root: Option<PathBuf>,
+    /// Most recently used session last
+    sessions: Vec<TrackedSession>,
+    /// Modification time of the transcript last read, as Unix timestamp
+    last_active: Option<i64>,
+    backend: JsonBackend,
+}
+
+impl TranscriptTracker {
+    pub fn new() -> Self {
+        TranscriptTracker::default()
+    }
+
+    /// Tracker for transcripts below `root` instead of the default directory
+    pub fn with_root(root: PathBuf) -> Self {
+        TranscriptTracker {
+            root: Some(root),
+            ..Default::default()
+        }
+    }
+
+    /// Parse transcript lines with `backend` from now on
+    ///
+    /// Sessions already tracked keep the backend they were started with.
+    pub fn set_json_backend(&mut self, backend: JsonBackend) {
+        self.backend = backend;
+    }
+
+    /// Read context window usage from the latest transcript
+    pub fn read_context(&mut self) -> Result<ContextInfo, TranscriptError> {
+        let root = match &self.root {
+            Some(root) => root.clone(),
+            None => default_projects_dir().ok_or(TranscriptError::NoTranscripts)?,
+        };
+        let (transcript_path, modified) = find_latest_transcript(&root)?;
+        self.last_active = unix_secs(modified);
+        self.read_context_from(&transcript_path)
+    }
+
+    /// When the transcript behind the last `read_context` was written to
+    pub fn last_active(&self) -> Option<i64> {
+        self.last_active
+    }
+
+    /// Read context window usage from a specific transcript
+    pub fn read_context_from(&mut self, path: &Path) -> Result<ContextInfo, TranscriptError> {
+        let session = self.session_mut(path);
+        session.update()?;
+        Ok(session.context_info())
+    }
+
+    fn session_mut(&mut self, path: &Path) -> &mut TrackedSession {
+        match self.sessions.iter().position(|s| s.path == path) {
+            Some(idx) => {
+                let session = self.sessions.remove(idx);
+                self.sessions.push(session);
+            }
+            None => {
+                if self.sessions.len() >= MAX_TRACKED_SESSIONS {
+                    self.sessions.remove(0);
+                }
+                self.sessions.push(TrackedSession::new(path.to_path_buf(), self.backend));
+            }
+        }
+        self.sessions.last_mut().unwrap()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    fn assistant_line(id: &str, input: i64, ts: &str) -> String {
+        format!(
+            r#"{{"type":"assistant","timestamp":"{}","message":{{"id":"{}","model":"claude-test","usage":{{"input_tokens":{},"cache_creation_input_tokens":0,"cache_read_input_tokens":0}}}}}}"#,
+            ts, id, input
+        )
+    }
+
+    #[test]
+    fn test_incremental_tail_matches_full_read() {
+        let dir = std::env::temp_dir().join(format!("cs-transcript-{}", std::process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("session.jsonl");
+        let mut file = File::create(&path).unwrap();
+
+        let mut tracker = TranscriptTracker::new();
+        writeln!(file, "{}", assistant_line("m1", 10_000, "2026-01-01T00:00:00Z")).unwrap();
+        writeln!(file, "{}", assistant_line("m1", 10_000, "2026-01-01T00:00:01Z")).unwrap();
+        assert_eq!(tracker.read_context_from(&path).unwrap().context_tokens, 10_000);
+
+        // Partial write: the half line must not be applied yet
+        let line = assistant_line("m2", 20_000, "2026-01-01T00:01:00Z");
+        let (head, tail) = line.split_at(line.len() / 2);
+        write!(file, "{}", head).unwrap();
+        assert_eq!(tracker.read_context_from(&path).unwrap().context_tokens, 10_000);
+        writeln!(file, "{}", tail).unwrap();
+        writeln!(file, "{}", assistant_line("m3", 30_000, "2026-01-01T00:02:00Z")).unwrap();
+
+        let info = tracker.read_context_from(&path).unwrap();
+        let fresh = TranscriptTracker::new().read_context_from(&path).unwrap();
+        assert_eq!(info.context_tokens, 30_000);
+        assert_eq!(info.forecast, fresh.forecast);
+        assert!(info.forecast.is_some());
+        assert_eq!(info.timeline, fresh.timeline);
+        assert_eq!(info.timeline.len(), 3);
+
+        // A complete last line counts before its newline, and only once
+        write!(file, "{}", assistant_line("m4", 40_000, "2026-01-01T00:03:00Z")).unwrap();
+        assert_eq!(tracker.read_context_from(&path).unwrap().context_tokens, 40_000);
+        writeln!(file).unwrap();
+        let info = tracker.read_context_from(&path).unwrap();
+        assert_eq!(info.context_tokens, 40_000);
+        assert_eq!(info.timeline.len(), 4);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_sidechain_kept_out_of_main_context() {
+        let mut state = SessionState::default();
+        state.apply_line(assistant_line("m1", 50_000, "2026-01-01T00:00:00Z").as_bytes());
+
+        let sidechain = |id: &str, output: i64| {
+            format!(
+                r#"{{"type":"assistant","isSidechain":true,"message":{{"id":"{}","usage":{{"input_tokens":3000,"output_tokens":{},"cache_read_input_tokens":1000}}}}}}"#,
+                id, output
+            )
+        };
+        // Streaming lines of two parallel subagents, interleaved
+        state.apply_line(sidechain("a1", 10).as_bytes());
+        state.apply_line(sidechain("b1", 20).as_bytes());
+        state.apply_line(sidechain("a1", 200).as_bytes());
+        state.apply_line(sidechain("b1", 300).as_bytes());
+        state.apply_line(
+            br#"{"type":"assistant","isSidechain":null,"message":{"id":"m2","usage":{"input_tokens":60000}}}"#,
+        );
+
+        let info = state.context_info();
+        assert_eq!(info.context_tokens, 60_000);
+        assert_eq!(
+            info.sidechain,
+            SidechainUsage { messages: 2, input_tokens: 8000, output_tokens: 500 }
+        );
+    }
+
+    #[test]
+    fn test_tape_backend_decodes_like_serde() {
+        let lines: &[&[u8]] = &[
+            br#"{"type":"assistant","message":{"model":"claude-\u00e9","content":[{"text":"\"}]"}],"usage":{"input_tokens":-9223372036854775808}}}"#,
+            br#"{"type":"assistant","isSidechain":true,"message":{"id":"s1","usage":{"output_tokens":12,"extra":[1.5e3,null]}}}"#,
+            br#"{"type":"assistant","message":{"usage":{"input_tokens":-0}}}"#,
+            br#"{"type":"assistant","message":{"usage":{"input_tokens":9223372036854775808}}}"#,
+            br#"{"type":"assistant","message":{"usage":{"input_tokens":1.0}}}"#,
+            br#"{"type":"assistant","message":{"usage":{"input_tokens":"12"}}}"#,
+            br#"{"type":"assistant","type":"user"}"#,
+            br#"{"type":"assistant","isSidechain":null}"#,
+            br#"{"type":"assistant","message":null,"timestamp":null}"#,
+            br#"{"typ\u0065":"assistant","message":{"model":"\ud83d\ude00"}}"#,
+            br#"{"type":"assistant","message":{"model":"\ud83d"}}"#,
+            b"{\"type\":\"assistant\",\"message\":{\"content\":\"\xff\"}}",
+            b"{\"type\":\"assistant\",\"message\":{\"model\":\"\xff\"}}",
+            b"{\"\xff\":1}",
+            br#"["assistant",null,null,true,["m1","claude-test",[5,6,7,8]]]"#,
+            br#"{"type":"assistant","message":["m1","claude-test",{"input_tokens":5}]}"#,
+            br#"{"type":"assistant"} {}"#,
+            br#"{"type":"assistant","message":{"content":[1,]}}"#,
+            b" 	",
+            b"42",
+        ];
+        let mut serde = SessionState::new(JsonBackend::Serde);
+        let mut tape = SessionState::new(JsonBackend::Tape);
+        for line in lines {
+            assert_eq!(
+                format!("{:?}", tape.parse_entry(line)),
+                format!("{:?}", serde.parse_entry(line)),
+                "{}",
+                String::from_utf8_lossy(line)
+            );
+        }
+    }
 }